@@ -3,9 +3,9 @@
 ################################################
 
 # Compiler name.
-#   On Windows desktop, could be "vc140", "vc120", "vc110", "vc100", "vc90", "mingw", "auto".
-#   On Windows store, could be "vc140", "vc120", "vc110", "auto".
-#   On Windows phone, could be "vc140", "vc120", "vc110", "auto".
+#   On Windows desktop, could be "vc140", "mingw", "auto".
+#   On Windows store, could be "vc140", "auto".
+#   On Windows phone, could be "vc140", "auto".
 #   On Android, could be "gcc", "auto".
 #   On Linux, could be "gcc", "auto".
 #   On MacOSX, could be "clang", "auto".
@@ -13,10 +13,10 @@
 compiler		= "auto"
 
 # Toolset name.
-#   On Windows desktop, could be "vc140", "v140_xp", "v120", "v120_xp", "v110", "v110_xp", "v100", "auto".
+#   On Windows desktop, could be "vc140", "v140_xp", "auto".
 #   On Windows store, could be "auto".
 #   On Windows phone, could be "auto".
-#   On Android, could be "4.4.3", "4.6", "4.8", "4.9", "auto".
+#   On Android, could be "4.8", "4.9", "auto".
 #   On Linux, could be "auto".
 #   On MacOSX, could be "auto".
 #   On iOS, could be "auto".
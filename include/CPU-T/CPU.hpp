@@ -32,8 +32,13 @@
 #define _CPUTSDK_CPU_HPP
 
 #include <CPU-T/Config.hpp>
+#include <CPU-T/CPUSet.hpp>
+#include <CPU-T/CPUIDDump.hpp>
 #include <vector>
 #include <string>
+#include <bitset>
+#include <mutex>
+#include <atomic>
 
 namespace CPUT
 {
@@ -42,9 +47,9 @@ namespace CPUT
 	public:
 		struct TLBInfo
 		{
-			std::string page;
-			int way;
-			std::string entry;
+			uint64 page_sizes;	// Bit n is set if it maps 2^n byte pages, 0 if there is no such TLB
+			int way;					// 0xFF if fully associative
+			int entries;
 		};
 		struct CacheInfo
 		{
@@ -53,43 +58,219 @@ namespace CPUT
 			int line;
 		};
 
+		enum CacheType
+		{
+			CT_Data = 1,
+			CT_Code = 2,
+			CT_Unified = 3
+		};
+		struct CacheLevelInfo
+		{
+			int level;
+			CacheType type;
+			int size;					// KB
+			int way;					// 0xFF if fully associative
+			int sets;
+			int line;					// Bytes
+			int partitions;
+			bool inclusive;				// Inclusive of the lower levels
+			int max_sharing;			// Maximum number of logical CPUs sharing one instance, 0 if unknown
+			std::vector<CPUSet> instances;	// The logical CPUs sharing each instance
+		};
+
+		enum TLBType
+		{
+			TT_Data = 1,
+			TT_Code = 2,
+			TT_Unified = 3,
+			TT_LoadOnly = 4,
+			TT_StoreOnly = 5
+		};
+		struct TLBLevelInfo
+		{
+			int level;					// 0 for the L0 data TLB of the leaf 2 descriptors
+			TLBType type;
+			uint64 page_sizes;	// Bit n is set if it maps 2^n byte pages
+			int way;					// 0xFF if fully associative
+			int entries;
+			int max_sharing;			// Maximum number of logical CPUs sharing one instance, 0 if unknown
+		};
+
+		struct CoreInfo
+		{
+			unsigned int id;			// From the APIC ID, unique in the system. From sysfs, unique in its package
+			CPUSet cpus;				// Its hardware threads
+		};
+		struct DieInfo
+		{
+			unsigned int id;
+			CPUSet cpus;
+			std::vector<CoreInfo> cores;
+		};
+		struct PackageInfo
+		{
+			unsigned int id;
+			CPUSet cpus;
+			std::vector<DieInfo> dies;
+		};
+		// Core types of hybrid CPUs, as in EAX[31:24] of CPUID leaf 0x1A
+		enum CoreType
+		{
+			HCT_Unknown = 0,			// Not a hybrid CPU, or the type isn't known
+			HCT_Atom = 0x20,			// Efficiency cores
+			HCT_Core = 0x40				// Performance cores
+		};
+		struct CoreTypeInfo
+		{
+			CoreType type;
+			unsigned int native_model;	// Native model ID from EAX[23:0] of leaf 0x1A, 0 if unknown
+			CPUSet cpus;
+			std::vector<CacheLevelInfo> caches;	// As CPUID reports them on a CPU of this type, with the instances of Caches() among its CPUs
+			unsigned int max_frequency;	// MHz, 0 if unknown
+		};
+
+		struct LogicalProcessorInfo
+		{
+			int os_index;				// The CPU number the OS uses, as in CPUSet
+			unsigned int apic_id;		// x2APIC ID, or the 8-bit initial APIC ID on CPUs without leaf 0xB. ~0U if read from sysfs
+			int package;				// Index into Packages()
+			int die;					// Index into PackageInfo::dies
+			int core;					// Index into DieInfo::cores
+			int thread;					// Position among the threads of its core
+			int node;					// Index into NumaNodes(), -1 if the OS puts it in none
+			CoreType core_type;
+		};
+		struct NumaNodeInfo
+		{
+			int id;						// The node number the OS uses
+			CPUSet cpus;
+			uint64 total_memory;	// Bytes, 0 if unknown
+			uint64 free_memory;	// Bytes when the topology was probed, or the probe cache written. 0 if unknown
+			std::vector<int> distances;	// Relative SLIT distance to each entry of NumaNodes(), 10 to itself. Empty if unknown
+		};
+
 	public:
+		// Bit indices into FeatureMask(). Append new features before CF_NumFeatures.
 		enum CPUFeature
 		{
-			CF_HTT = 1UL << 0,
-			CF_CMPXCHG8B = 1UL << 1,
-			CF_SYSENTER = 1UL << 2,
-			CF_CMOV = 1UL << 3,
-			CF_MMX = 1UL << 4,
-			CF_3DNow = 1UL << 5,
-			CF_3DNowExt = 1UL << 6,
-			CF_SSE = 1UL << 7,
-			CF_SSE2 = 1UL << 8,
-			CF_SSE3 = 1UL << 9,
-			CF_SSSE3 = 1UL << 10,
-			CF_SSE41 = 1UL << 11,
-			CF_SSE42 = 1UL << 12,
-			CF_SSE4A = 1UL << 13,
-			CF_MisalignedSSE = 1UL << 14,
-			CF_X64 = 1UL << 15,
-			CF_FMA3 = 1UL << 16,
-			CF_CMPXCHG16B = 1UL << 17,
-			CF_MOVBE = 1UL << 18,
-			CF_POPCNT = 1UL << 19,
-			CF_AES = 1UL << 20,
-			CF_AVX = 1UL << 21,
-			CF_LZCNT = 1UL << 22,
-			CF_AVX2 = 1UL << 23,
-			CF_FMA4 = 1UL << 24,
-			CF_F16C = 1UL << 25
+			CF_HTT = 0,
+			CF_CMPXCHG8B,
+			CF_SYSENTER,
+			CF_CMOV,
+			CF_MMX,
+			CF_3DNow,
+			CF_3DNowExt,
+			CF_SSE,
+			CF_SSE2,
+			CF_SSE3,
+			CF_SSSE3,
+			CF_SSE41,
+			CF_SSE42,
+			CF_SSE4A,
+			CF_MisalignedSSE,
+			CF_X64,
+			CF_FMA3,
+			CF_CMPXCHG16B,
+			CF_MOVBE,
+			CF_POPCNT,
+			CF_AES,
+			CF_AVX,
+			CF_LZCNT,
+			CF_AVX2,
+			CF_FMA4,
+			CF_F16C,
+			CF_PCLMULQDQ,
+			CF_RDRAND,
+			CF_RDSEED,
+			CF_XSAVE,
+			CF_XSAVEOPT,
+			CF_XSAVEC,
+			CF_XSAVES,
+			CF_FSGSBASE,
+			CF_BMI1,
+			CF_BMI2,
+			CF_ADX,
+			CF_SHA,
+			CF_ERMS,
+			CF_FSRM,
+			CF_PREFETCHW,
+			CF_RDTSCP,
+			CF_RDPID,
+			CF_CLFLUSHOPT,
+			CF_CLWB,
+			CF_CLZERO,
+			CF_WBNOINVD,
+			CF_MOVDIRI,
+			CF_MOVDIR64B,
+			CF_VAES,
+			CF_VPCLMULQDQ,
+			CF_GFNI,
+			CF_AVXVNNI,
+			CF_AVX512F,
+			CF_AVX512CD,
+			CF_AVX512BW,
+			CF_AVX512DQ,
+			CF_AVX512VL,
+			CF_AVX512IFMA,
+			CF_AVX512VBMI,
+			CF_AVX512VBMI2,
+			CF_AVX512VNNI,
+			CF_AVX512BITALG,
+			CF_AVX512VPOPCNTDQ,
+			CF_AVX512BF16,
+			CF_AVX512FP16,
+			CF_AMXTILE,
+			CF_AMXINT8,
+			CF_AMXBF16,
+
+			CF_NumFeatures
+		};
+
+		typedef std::bitset<CF_NumFeatures> FeatureSet;
+
+		// Values that keep changing while the process runs. They are published together through one
+		// atomic word, so a reader on any thread gets a consistent pair without locking.
+		struct LiveInfo
+		{
+			unsigned int frequency;		// MHz
+			unsigned int generation;	// Bumped every time a new frequency is published
 		};
 
 	public:
+		// Only runs CPUID, so vendor, family/model and the feature flags are ready right after
+		// construction. The core count and the frequency are probed the first time they are asked for.
 		CPUInfo();
+		// Same as above, but takes the CPUID dumps, the per-CPU topology leaves, the sysfs topology and the
+		// calibrated frequency from a file written by SaveProbeCache(), when it was written on this boot of a CPU
+		// with the same brand string, signature and microcode. Otherwise probes as usual.
+		explicit CPUInfo(char const * probe_cache_path);
+		// Decodes a dump recorded on another machine, without running CPUID, pinning threads or
+		// sleeping. The topology comes from the dump's per-CPU leaves and the frequency from its
+		// calibrated value when CPUID doesn't report one.
+		explicit CPUInfo(CPUIDDump const & dump);
+
+		// The process-wide instance, constructed on first use by whichever thread gets there first.
+		// All the const members can be called on it from any thread. It's never destroyed, so it stays
+		// valid while static objects are being torn down.
+		// If the CPUT_PROBE_CACHE environment variable is set, it's the probe cache to load from.
+		static CPUInfo const & Instance();
+
+		// Probes the topology and the frequency if not done yet, and writes everything a later
+		// CPUInfo(probe_cache_path) needs. Meant to run once per boot, for example from a service
+		// that starts before the short-lived processes using the cache.
+		bool SaveProbeCache(char const * path) const;
+		bool FromProbeCache() const
+		{
+			return from_probe_cache_;
+		}
+
+		// Everything this CPUInfo was decoded from. Probes the topology and the frequency first,
+		// so the dump is complete and can be saved to replay this machine elsewhere.
+		CPUIDDump const & Dump() const;
 
 		char const * CPUName() const
 		{
-			return cpu_name_.c_str();
+			return cpu_name_;
 		}
 		char const * VendorString() const
 		{
@@ -101,29 +282,52 @@ namespace CPUT
 		}
 		char const * Technology() const
 		{
-			return tech_.c_str();
+			return tech_;
 		}
 		char const * Transistors() const
 		{
-			return transistors_.c_str();
+			return transistors_;
 		}
 		char const * CodeName() const
 		{
-			return codename_.c_str();
+			return codename_;
 		}
 		char const * Package() const
 		{
-			return package_.c_str();
+			return package_;
 		}
+		// The 96-bit processor serial number as 24 hex digits, empty if there is none.
 		char const * SerialNumber() const
 		{
 			return serial_number_;
 		}
 
+		// True when the CPU implements the feature and the OS saves the register state it needs
+		// (checked against XCR0 for the AVX, AVX-512 and AMX families).
 		bool IsFeatureSupport(CPUFeature feature) const
 		{
-			return feature_mask_ & feature ? true : false;
+			return feature_mask_.test(feature);
 		}
+		// True when the CPU implements the feature, whether or not the OS has enabled it.
+		bool IsFeatureSupportByHardware(CPUFeature feature) const
+		{
+			return hw_feature_mask_.test(feature);
+		}
+		FeatureSet const & FeatureMask() const
+		{
+			return feature_mask_;
+		}
+		FeatureSet const & HardwareFeatureMask() const
+		{
+			return hw_feature_mask_;
+		}
+		// XCR0 as read by XGETBV, 0 when the OS hasn't set CR4.OSXSAVE.
+		// On Linux AMX additionally needs arch_prctl(ARCH_REQ_XCOMP_PERM) before the first tile instruction.
+		uint64 XCR0() const
+		{
+			return dump_.XCR0();
+		}
+		static char const * FeatureName(CPUFeature feature);
 
 		int Type() const
 		{
@@ -161,13 +365,23 @@ namespace CPUT
 		}
 		TLBInfo const & CodeTLB() const
 		{
-			return data_tlb_;
+			return code_tlb_;
 		}
 		TLBInfo const & DataTLB() const
 		{
 			return data_tlb_;
 		}
 
+		// Every TLB, from leaf 0x18 (Intel), 0x80000005/6/19 (AMD), or the leaf 2 descriptors on older CPUs.
+		// A TLB mapping several page sizes is listed once.
+		std::vector<TLBLevelInfo> const & TLBs() const
+		{
+			return tlbs_;
+		}
+		// Bytes of memory the data TLBs of a level map with pages of page_size bytes, for example
+		// 4096, 2 << 20 or 1 << 30. A negative level means the level with the largest reach. 0 if none maps such pages.
+		uint64 TLBReach(uint64 page_size, int level = -1) const;
+
 		CacheInfo const & L1CodeCache() const
 		{
 			return l1_code_cache_;
@@ -185,40 +399,123 @@ namespace CPUT
 			return l3_cache_;
 		}
 
+		// Every cache the CPU reports through leaf 4 (Intel) or 0x8000001D (AMD). Finding the CPUs sharing
+		// each instance needs the topology, so the first call probes it.
+		std::vector<CacheLevelInfo> const & Caches() const;
+
 		int NumHWThreads() const
 		{
 			return num_hw_threads_;
 		}
-		int NumCores() const
+		int NumCores() const;
+
+		// Packages -> dies -> cores -> hardware threads. On Linux it's read from sysfs and covers every online
+		// CPU, including those outside the process affinity. Otherwise, or if sysfs has no topology, it's
+		// decoded from the APIC ID of every logical CPU the process can run on. Dies are only reported by
+		// CPUID leaf 0x1F or Linux 5.2 and up, otherwise each package has one.
+		std::vector<PackageInfo> const & Packages() const;
+		// Sorted by OS index.
+		std::vector<LogicalProcessorInfo> const & LogicalProcessors() const;
+		LogicalProcessorInfo const * FindLogicalProcessor(int os_index) const;
+		// True on CPUs mixing core types, such as performance and efficiency cores (CPUID.7.0:EDX[15]).
+		bool IsHybrid() const;
+		// One entry per core type, performance cores first. A CPU that isn't hybrid has a single HCT_Unknown
+		// entry with every CPU, Caches() and MaxFrequency(). On a live hybrid machine the caches and the
+		// maximum frequency are read on a CPU of each type. A replay only has the types of the CPUs.
+		std::vector<CoreTypeInfo> const & CoreTypes() const;
+		// The CPUs of a type, empty if there are none.
+		CPUSet CPUsOfType(CoreType type) const;
+
+		// NUMA nodes with CPUs or memory, in ascending ID order. From /sys/devices/system/node on Linux and
+		// GetLogicalProcessorInformation on Windows. A machine without NUMA, or a replay, has one node holding every CPU.
+		std::vector<NumaNodeInfo> const & NumaNodes() const;
+		// The node of a CPU, nullptr if it's not in any.
+		NumaNodeInfo const * FindNumaNode(int os_index) const;
+		// Microseconds spent reading sysfs or running CPUID on every logical CPU. Probes the topology if not done yet.
+		unsigned int TopologyProbeTime() const;
+
+		// Samples the TSC over the calibration window, blocking the caller for that long, and publishes
+		// the result to Frequency() and Live(). Safe to call from any thread.
+		void UpdateFrequency() const;
+		// TSC frequency in MHz. Comes from CPUID leaf 0x15/0x16 when available, otherwise the
+		// first call runs UpdateFrequency().
+		unsigned int Frequency() const;
+		LiveInfo Live() const;
+
+		// Length of the TSC sampling window in milliseconds. Defaults to 50.
+		void CalibrationWindow(unsigned int ms)
+		{
+			calibration_window_ = ms;
+		}
+		unsigned int CalibrationWindow() const
 		{
-			return num_cores_;
+			return calibration_window_;
 		}
 
-		void UpdateFrequency();
-		unsigned int Frequency() const
+		// All frequencies are in MHz, 0 if the CPU doesn't report them.
+		unsigned int TSCFrequency() const
+		{
+			return tsc_frequency_;
+		}
+		unsigned int NominalFrequency() const
+		{
+			return nominal_frequency_;
+		}
+		unsigned int MaxFrequency() const
+		{
+			return max_frequency_;
+		}
+		unsigned int BusFrequency() const
+		{
+			return bus_frequency_;
+		}
+		bool IsInvariantTSC() const
 		{
-			return frequency_;
+			return invariant_tsc_;
 		}
 
 	private:
+		void Decode();
+		void DetectTopology() const;
+		void DetectNumaNodes() const;
+		void DetectCoreTypes() const;
+#if defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+		bool DetectSysfsTopology() const;
+		bool SaveSysfsTopology(std::vector<unsigned int>& words) const;
+		bool RestoreSysfsTopology() const;
+#endif
 #if (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)) && !defined(CPUT_PLATFORM_ANDROID)
-		void DumpCPUIDs();
+		void DetectApicTopology() const;
+		void DecodeDeterministicCaches();
+		void DecodeTLBs();
+#endif
+		void InitFrequency() const;
+		unsigned int MeasureFrequency() const;
+		void PublishFrequency(unsigned int frequency) const;
+
+#if (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)) && !defined(CPUT_PLATFORM_ANDROID)
+		void DecodeFeatures();
 		unsigned int CPUIDResult(unsigned int fn, unsigned int index) const;
+		unsigned int CPUIDResult(unsigned int fn, unsigned int sub_fn, unsigned int index) const;
 		unsigned int MaxStdFn() const;
 		unsigned int MaxExtFn() const;
+
+		bool LoadProbeCache(char const * path);
 #endif
 
 	private:
-		std::string cpu_name_;
+		char const * cpu_name_;
 		char vendor_[13];
 		char brand_string_[49];
-		char serial_number_[13];
-		unsigned int frequency_;
-		unsigned __int64 feature_mask_;
-		std::string tech_;
-		std::string transistors_;
-		std::string codename_;
-		std::string package_;
+		char serial_number_[25];
+		mutable std::atomic<uint64> live_;		// Generation in the high 32 bits, MHz in the low 32 bits
+		unsigned int calibration_window_;
+		FeatureSet feature_mask_;
+		FeatureSet hw_feature_mask_;
+		char const * tech_;
+		char const * transistors_;
+		char const * codename_;
+		char const * package_;
 
 		int type_;
 		int family_;
@@ -230,18 +527,38 @@ namespace CPUT
 		TLBInfo l2_data_tlb_;
 		TLBInfo code_tlb_;
 		TLBInfo data_tlb_;
+		std::vector<TLBLevelInfo> tlbs_;
 		CacheInfo l1_code_cache_;
 		CacheInfo l1_data_cache_;
 		CacheInfo l2_cache_;
 		CacheInfo l3_cache_;
+		mutable std::vector<CacheLevelInfo> caches_;
+
+		unsigned int tsc_frequency_;
+		unsigned int nominal_frequency_;
+		unsigned int max_frequency_;
+		unsigned int bus_frequency_;
+		bool invariant_tsc_;
 
 		int num_hw_threads_;
-		int num_cores_;
+		mutable int num_cores_;
+		mutable unsigned int topology_probe_time_;
+		mutable std::vector<PackageInfo> packages_;
+		mutable std::vector<LogicalProcessorInfo> logical_processors_;
+		mutable std::vector<NumaNodeInfo> numa_nodes_;
+		mutable std::vector<CoreTypeInfo> core_types_;
 
-#if (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)) && !defined(CPUT_PLATFORM_ANDROID)
-		std::vector<unsigned int> cpuid_std_fn_results_;
-		std::vector<unsigned int> cpuid_ext_fn_results_;
-#endif
+		mutable std::once_flag topology_once_;
+		mutable std::once_flag frequency_once_;
+		mutable std::once_flag per_cpu_once_;
+
+		// Leaf 1 and 0xB of every CPU are filled in by the topology probe
+		mutable CPUIDDump dump_;
+		bool replay_;
+		bool from_probe_cache_;
+		// The sysfs topology from the probe cache, empty if it had none. See SaveSysfsTopology().
+		std::vector<unsigned int> sysfs_topology_;
+		mutable bool topology_from_sysfs_;
 	};
 }
 
@@ -0,0 +1,131 @@
+/**
+ * @file CPUIDDump.hpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of CPUTSDK, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#ifndef _CPUTSDK_CPUIDDUMP_HPP
+#define _CPUTSDK_CPUIDDUMP_HPP
+
+#include <CPU-T/Config.hpp>
+#include <CPU-T/CPUSet.hpp>
+#include <vector>
+#include <string>
+
+namespace CPUT
+{
+	// The raw CPUID results CPUInfo decodes. Captured on the running machine, or read back from a text
+	// file, so a machine's decoding can be reproduced on any host.
+	//
+	// The text format has one leaf per line, "fn sub_fn eax ebx ecx edx" in hex, plus
+	//	xcr0 <hex>
+	//	frequency <MHz, decimal>
+	//	cpu <OS index> <leaf 1 EBX, hex> <leaf 0xB EDX, hex> [<leaf 0x1A EAX, hex>]
+	// Lines starting with '#' are comments. Leaves outside 0-0xFF and 0x80000000-0x800000FF are skipped, and a
+	// cpu line with an OS index outside 0-65535 fails the load. So does a line with a missing value or
+	// anything but blanks after its last one.
+	class CPUIDDump
+	{
+		friend class CPUInfo;
+
+	public:
+		// Leaves that differ between logical CPUs, read on each of them.
+		struct PerCPULeaves
+		{
+			int cpu;
+			bool valid;					// False if the CPU couldn't be probed
+			unsigned int leaf1_ebx;
+			unsigned int x2apic_id;		// EDX of leaf 0xB
+			unsigned int hybrid_info;	// EAX of leaf 0x1A, core type and native model. 0 on CPUs that aren't hybrid
+		};
+
+	public:
+		CPUIDDump();
+
+		// Runs CPUID on the calling thread. The per-CPU leaves are left empty.
+		static CPUIDDump Capture();
+		// Reads the per-CPU leaves on every CPU of the set, from threads pinned to each of them.
+		// Waits at most timeout_ms, CPUs that don't answer in time are marked invalid.
+		void CapturePerCPU(CPUSet const & cpus, unsigned int timeout_ms);
+		// Executes CPUID on the calling CPU. regs receives EAX, EBX, ECX, EDX.
+		static void Execute(unsigned int fn, unsigned int sub_fn, unsigned int regs[4]);
+
+		bool Save(char const * path) const;
+		bool Load(char const * path);
+		std::string ToString() const;
+		bool FromString(char const * text);
+
+		bool Empty() const
+		{
+			return std_fn_results_.empty();
+		}
+		unsigned int MaxStdFn() const;
+		unsigned int MaxExtFn() const;
+		// 0 for leaves and subleaves not in the dump.
+		unsigned int Result(unsigned int fn, unsigned int sub_fn, unsigned int index) const;
+		// Only leaves 0-0xFF and 0x80000000-0x800000FF are kept, others such as the hypervisor leaves are ignored.
+		void SetResult(unsigned int fn, unsigned int sub_fn, unsigned int const regs[4]);
+
+		// XCR0 as read by XGETBV, 0 when the OS hasn't enabled XSAVE.
+		uint64 XCR0() const
+		{
+			return xcr0_;
+		}
+		void XCR0(uint64 xcr0)
+		{
+			xcr0_ = xcr0;
+		}
+		// Calibrated TSC frequency in MHz, 0 if not known.
+		unsigned int Frequency() const
+		{
+			return frequency_;
+		}
+		void Frequency(unsigned int frequency)
+		{
+			frequency_ = frequency;
+		}
+		std::vector<PerCPULeaves> const & PerCPU() const
+		{
+			return per_cpu_;
+		}
+		void PerCPU(std::vector<PerCPULeaves> const & per_cpu)
+		{
+			per_cpu_ = per_cpu;
+		}
+
+	private:
+		std::vector<unsigned int> std_fn_results_;
+		std::vector<unsigned int> ext_fn_results_;
+		// (fn, sub_fn, eax, ebx, ecx, edx) of every subleaf above 0
+		std::vector<unsigned int> sub_fn_results_;
+		uint64 xcr0_;
+		unsigned int frequency_;
+		std::vector<PerCPULeaves> per_cpu_;
+	};
+}
+
+#endif		// _CPUTSDK_CPUIDDUMP_HPP
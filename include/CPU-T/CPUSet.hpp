@@ -0,0 +1,137 @@
+/**
+ * @file CPUSet.hpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of CPUTSDK, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#ifndef _CPUTSDK_CPUSET_HPP
+#define _CPUTSDK_CPUSET_HPP
+
+#include <CPU-T/Config.hpp>
+#include <vector>
+#include <string>
+#include <thread>
+
+#include <cstdint>
+
+namespace CPUT
+{
+	// A set of logical CPUs, indexed the way the OS numbers them.
+	class CPUSet
+	{
+	public:
+		CPUSet()
+		{
+		}
+		explicit CPUSet(int cpu)
+		{
+			this->Set(cpu);
+		}
+
+		void Set(int cpu);
+		void Reset(int cpu);
+		bool Test(int cpu) const;
+		void Clear()
+		{
+			bits_.clear();
+		}
+
+		int Count() const;
+		bool Empty() const
+		{
+			return this->First() < 0;
+		}
+
+		// Iterates with: for (int cpu = set.First(); cpu >= 0; cpu = set.Next(cpu))
+		int First() const
+		{
+			return this->Next(-1);
+		}
+		int Next(int cpu) const;
+		// The n-th CPU of the set, -1 if the set is smaller than that.
+		int Nth(int n) const;
+
+		CPUSet& operator|=(CPUSet const & rhs);
+		CPUSet& operator&=(CPUSet const & rhs);
+		CPUSet& operator-=(CPUSet const & rhs);
+
+		bool operator==(CPUSet const & rhs) const;
+		bool operator!=(CPUSet const & rhs) const
+		{
+			return !(*this == rhs);
+		}
+
+		// Linux cpulist format, such as "0-3,8,10-11".
+		std::string ToString() const;
+		bool FromString(char const * str);
+
+	private:
+		std::vector<std::uint64_t> bits_;
+	};
+
+	inline CPUSet operator|(CPUSet const & lhs, CPUSet const & rhs)
+	{
+		CPUSet ret = lhs;
+		ret |= rhs;
+		return ret;
+	}
+	inline CPUSet operator&(CPUSet const & lhs, CPUSet const & rhs)
+	{
+		CPUSet ret = lhs;
+		ret &= rhs;
+		return ret;
+	}
+	inline CPUSet operator-(CPUSet const & lhs, CPUSet const & rhs)
+	{
+		CPUSet ret = lhs;
+		ret -= rhs;
+		return ret;
+	}
+
+	// Affinity of the process and of the calling thread. Return an empty set if the OS refuses to tell.
+	CPUSet ProcessAffinity();
+	CPUSet ThreadAffinity();
+
+	// What the process can actually run on. A container usually sees every CPU of the host, while its
+	// cgroup only lets it use a few of them, or a fraction of their time.
+	struct EffectiveCPUs
+	{
+		CPUSet cpus;		// The process affinity, narrowed by the cgroup cpuset on Linux
+		double quota;		// CPUs worth of run time the cgroup (cpu.max or CFS quota) or job object allows, 0 if unlimited
+		double budget;		// The smaller of cpus.Count() and quota. What a thread pool should be sized from
+
+		// budget rounded up, at least 1
+		int Parallelism() const;
+	};
+	EffectiveCPUs QueryEffectiveCPUs();
+
+	// Restrict the calling thread, or another std::thread, to a set of CPUs.
+	bool BindThread(CPUSet const & cpus);
+	bool BindThread(std::thread& thread, CPUSet const & cpus);
+}
+
+#endif		// _CPUTSDK_CPUSET_HPP
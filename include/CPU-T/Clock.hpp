@@ -0,0 +1,60 @@
+/**
+ * @file Clock.hpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of CPUTSDK, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#ifndef _CPUTSDK_CLOCK_HPP
+#define _CPUTSDK_CLOCK_HPP
+
+#include <CPU-T/Config.hpp>
+#include <CPU-T/CPUSet.hpp>
+#include <vector>
+
+namespace CPUT
+{
+	struct CoreClock
+	{
+		int cpu;
+		unsigned int frequency;	// MHz, 0 if the thread couldn't be pinned to the CPU
+	};
+
+	// Measures the clock the cores actually run at, by timing a chain of dependent integer adds
+	// on a thread pinned to each CPU. Unlike CPUInfo::Frequency(), which is the TSC rate, this
+	// includes turbo, AVX offsets and power capping.
+	//
+	// With simultaneous == false the CPUs are measured one after another, which gives the
+	// single-core turbo clock. With simultaneous == true all of them are loaded at the same
+	// time, which gives the clock under an all-core load.
+	//
+	// duration_ms is the measured interval per CPU. A warm-up of a fifth of it comes first
+	// so the core has left its idle P-state.
+	std::vector<CoreClock> MeasureCoreClocks(CPUSet const & cpus, bool simultaneous, unsigned int duration_ms = 100);
+	unsigned int MeasureCoreClock(int cpu, unsigned int duration_ms = 100);
+}
+
+#endif		// _CPUTSDK_CLOCK_HPP
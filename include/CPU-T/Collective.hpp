@@ -0,0 +1,173 @@
+/**
+ * @file Collective.hpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of CPUTSDK, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#ifndef _CPUTSDK_COLLECTIVE_HPP
+#define _CPUTSDK_COLLECTIVE_HPP
+
+#include <CPU-T/Config.hpp>
+#include <CPU-T/CPU.hpp>
+#include <CPU-T/NumaArena.hpp>
+#include <CPU-T/Placement.hpp>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <cstdint>
+
+namespace CPUT
+{
+	// Barrier, all-reduce and broadcast for a fixed set of participants, such as the workers of a ThreadPool,
+	// combined along the topology:
+	// the SMT siblings of a core first, then the last level cache domain, then the package, then across packages.
+	// Levels with a single member are skipped.
+	// Each group keeps its arrival counter and its release flag on separate cache lines of the detected size,
+	// allocated on the NUMA node of its first member. A waiter only spins on the release flag of its own
+	// group, and the last arriver of each group carries the group up the tree, then wakes it on the way down.
+	//
+	//	CPUT::Collective collective(CPUT::CPUInfo::Instance(), pool.Placement());
+	//	// In the task of every worker, all running at once:
+	//	int const me = pool.CurrentWorker();
+	//	double const total = collective.AllReduce(me, partial, [](double a, double b) { return a + b; });
+	//	collective.Barrier(me);
+	//
+	// Every participant has to take part in every call, in the same order. Values are copied bytewise and
+	// are at most max_value_size bytes. Children are combined in a fixed order, so a floating point reduction
+	// gives the same result on every run.
+	class Collective
+	{
+	public:
+		Collective(CPUInfo const & cpu, PlacementAdvisor::Plan const & plan, size_t max_value_size = 64);
+
+		int NumParticipants() const
+		{
+			return static_cast<int>(participants_.size());
+		}
+		// Levels of the tree, 1 when every participant hangs off the root.
+		int NumLevels() const
+		{
+			return levels_;
+		}
+
+		void Barrier(int participant)
+		{
+			this->Combine(participant, nullptr, nullptr, 0, nullptr, nullptr);
+		}
+
+		// op(T, T) -> T is applied in place along the tree. Every participant gets the total.
+		template <typename T, typename Op>
+		T AllReduce(int participant, T const & value, Op op)
+		{
+			assert((sizeof(T) <= value_size_) && "The value is larger than max_value_size");
+
+			T result;
+			this->Combine(participant, &value, &result, sizeof(T),
+				[](void* acc, void const * rhs, void* context)
+				{
+					T& lhs = *static_cast<T*>(acc);
+					lhs = (*static_cast<Op*>(context))(lhs, *static_cast<T const *>(rhs));
+				}, &op);
+			return result;
+		}
+
+		// The value of the root participant, on every participant.
+		template <typename T>
+		T Broadcast(int participant, int root, T const & value)
+		{
+			struct Tagged
+			{
+				T value;
+				bool from_root;
+			};
+
+			Tagged tagged;
+			tagged.value = value;
+			tagged.from_root = (participant == root);
+			return this->AllReduce(participant, tagged,
+				[](Tagged const & lhs, Tagged const & rhs)
+				{
+					return lhs.from_root ? lhs : rhs;
+				}).value;
+		}
+
+	private:
+		Collective(Collective const & rhs);
+		Collective& operator=(Collective const & rhs);
+
+		typedef void (*CombineFunc)(void* acc, void const * rhs, void* context);
+
+		// Runs the tree once. Without a value, it's a barrier.
+		void Combine(int participant, void const * value, void* result, size_t size, CombineFunc func, void* context);
+
+		struct Group
+		{
+			char* arrive;			// Arrival counter, then one value slot per child
+			char* release;			// Generation, then the result
+			int children;
+			int parent;				// -1 for the root
+			int parent_slot;
+		};
+		struct Participant
+		{
+			std::uint32_t* generation;	// Alone on its line, only its participant touches it
+			int group;
+			int slot;
+		};
+
+		std::atomic<std::uint32_t>& Arrivals(Group const & group) const
+		{
+			return *reinterpret_cast<std::atomic<std::uint32_t>*>(group.arrive);
+		}
+		std::atomic<std::uint32_t>& Generation(Group const & group) const
+		{
+			return *reinterpret_cast<std::atomic<std::uint32_t>*>(group.release);
+		}
+		char* Slot(Group const & group, int slot) const
+		{
+			return group.arrive + VALUE_OFFSET + slot * value_size_;
+		}
+		char* Result(Group const & group) const
+		{
+			return group.release + VALUE_OFFSET;
+		}
+
+	private:
+		static size_t const VALUE_OFFSET = 16;
+
+		size_t value_size_;
+		int levels_;
+		std::vector<Group> groups_;
+		std::vector<Participant> participants_;
+		std::vector<std::unique_ptr<NumaArena> > arenas_;	// One per NUMA node, -1 last
+	};
+}
+
+#endif		// _CPUTSDK_COLLECTIVE_HPP
@@ -45,7 +45,12 @@
 
 	#define CPUT_COMPILER_GCC
 
-	#if __GNUC__ >= 4
+	#if defined(__clang__)
+		// Clang reports itself as GCC 4.2, but has everything GCC 4.8 has
+		#define CPUT_COMPILER_VERSION 48
+	#elif __GNUC__ > 4
+		#define CPUT_COMPILER_VERSION (__GNUC__ * 10 + __GNUC_MINOR__)
+	#elif __GNUC__ == 4
 		#if __GNUC_MINOR__ >= 8
 			#define CPUT_COMPILER_VERSION 48
 		#elif __GNUC_MINOR__ >= 7
@@ -65,118 +70,111 @@
 		#elif __GNUC_MINOR__ >= 0
 			#define CPUT_COMPILER_VERSION 40
 		#endif
-
-		#if __GNUC_MINOR__ >= 3
-			#ifdef __GXX_EXPERIMENTAL_CXX0X__
-				#define CPUT_CXX11_CORE_STATIC_ASSERT_SUPPORT
-				#define CPUT_CXX11_CORE_DECLTYPE_SUPPORT
-				#define CPUT_CXX11_CORE_RVALUE_REFERENCES_SUPPORT
-				#define CPUT_CXX11_CORE_EXTERN_TEMPLATES_SUPPORT
-				#define CPUT_CXX11_LIBRARY_ALGORITHM
-				#define CPUT_CXX11_LIBRARY_ARRAY_SUPPORT
-				#define CPUT_CXX11_LIBRARY_CSTDINT_SUPPORT
-				#define CPUT_CXX11_LIBRARY_FUNCTIONAL_SUPPORT
-				#define CPUT_CXX11_LIBRARY_RANDOM_SUPPORT
-				#define CPUT_CXX11_LIBRARY_REGEX_SUPPORT
-				#define CPUT_CXX11_LIBRARY_SMART_PTR_SUPPORT
-				#define CPUT_CXX11_LIBRARY_TUPLE_SUPPORT
-				#define CPUT_CXX11_LIBRARY_TYPE_TRAITS_SUPPORT
-				#define CPUT_CXX11_LIBRARY_UNORDERED_SUPPORT
-				#if __GNUC_MINOR__ >= 4
-					#define CPUT_CXX11_CORE_STRONGLY_TYPED_ENUMS_SUPPORT
-					#define CPUT_CXX11_LIBRARY_ATOMIC_SUPPORT
-					#define CPUT_CXX11_LIBRARY_SYSTEM_ERROR_SUPPORT
-					#ifdef _GLIBCXX_HAS_GTHREADS
-						#define CPUT_CXX11_LIBRARY_CHRONO_SUPPORT
-						#define CPUT_CXX11_LIBRARY_THREAD_SUPPORT
-					#endif
-				#endif
-				#if __GNUC_MINOR__ >= 6
-					#define CPUT_CXX11_CORE_NULLPTR_SUPPORT
-					#define CPUT_CXX11_CORE_FOREACH_SUPPORT
-					#define CPUT_CXX11_CORE_NOEXCEPT_SUPPORT
-				#endif
-				#if __GNUC_MINOR__ >= 7
-					#define CPUT_CXX11_CORE_OVERRIDE_SUPPORT
-				#endif
-			#endif
-		#endif
 	#else
 		#error Unknown compiler.
 	#endif
-#elif defined(_MSC_VER)
-	#define CPUT_COMPILER_MSVC
-	#define CPUT_COMPILER_NAME vc
-
-	#define CPUT_HAS_DECLSPEC
 
-	#if _MSC_VER >= 1700
-		#define CPUT_COMPILER_VERSION 110
-	#elif _MSC_VER >= 1600
-		#define CPUT_COMPILER_VERSION 100
-	#elif _MSC_VER >= 1500
-		#define CPUT_COMPILER_VERSION 90
-
-		#ifndef CPUT_DEBUG
-			#define _SECURE_SCL 0
-		#endif
-	#elif _MSC_VER >= 1400
-		#define CPUT_COMPILER_VERSION 80
-
-		#ifndef CPUT_DEBUG
-			#define _SECURE_SCL 0
-		#endif
-	#else
-		#error Unknown compiler.
+	// thread_local is the last C++11 feature GCC got
+	#if CPUT_COMPILER_VERSION < 48
+		#error Unsupported compiler. CPU-T needs GCC 4.8 or up.
 	#endif
 
-	#if _MSC_VER >= 1500
-		#define CPUT_CXX11_CORE_EXTERN_TEMPLATES_SUPPORT
-		#if _MSC_VER >= 1600
-			#define CPUT_CXX11_CORE_NULLPTR_SUPPORT
+	#if CPUT_COMPILER_VERSION >= 43
+		#if defined(__GXX_EXPERIMENTAL_CXX0X__) || (__cplusplus >= 201103L)
 			#define CPUT_CXX11_CORE_STATIC_ASSERT_SUPPORT
 			#define CPUT_CXX11_CORE_DECLTYPE_SUPPORT
+			#define CPUT_CXX11_CORE_RVALUE_REFERENCES_SUPPORT
+			#define CPUT_CXX11_CORE_EXTERN_TEMPLATES_SUPPORT
+			#define CPUT_CXX11_LIBRARY_ALGORITHM
 			#define CPUT_CXX11_LIBRARY_ARRAY_SUPPORT
 			#define CPUT_CXX11_LIBRARY_CSTDINT_SUPPORT
 			#define CPUT_CXX11_LIBRARY_FUNCTIONAL_SUPPORT
 			#define CPUT_CXX11_LIBRARY_RANDOM_SUPPORT
 			#define CPUT_CXX11_LIBRARY_REGEX_SUPPORT
-			#define CPUT_CXX11_LIBRARY_SYSTEM_ERROR_SUPPORT
+			#define CPUT_CXX11_LIBRARY_SMART_PTR_SUPPORT
 			#define CPUT_CXX11_LIBRARY_TUPLE_SUPPORT
 			#define CPUT_CXX11_LIBRARY_TYPE_TRAITS_SUPPORT
 			#define CPUT_CXX11_LIBRARY_UNORDERED_SUPPORT
-			#if _MSC_VER >= 1700
+			#if CPUT_COMPILER_VERSION >= 44
 				#define CPUT_CXX11_CORE_STRONGLY_TYPED_ENUMS_SUPPORT
+				#define CPUT_CXX11_LIBRARY_ATOMIC_SUPPORT
+				#define CPUT_CXX11_LIBRARY_SYSTEM_ERROR_SUPPORT
+				#if defined(_GLIBCXX_HAS_GTHREADS) || defined(__clang__)
+					#define CPUT_CXX11_LIBRARY_CHRONO_SUPPORT
+					#define CPUT_CXX11_LIBRARY_THREAD_SUPPORT
+				#endif
+			#endif
+			#if CPUT_COMPILER_VERSION >= 46
+				#define CPUT_CXX11_CORE_NULLPTR_SUPPORT
 				#define CPUT_CXX11_CORE_FOREACH_SUPPORT
+				#define CPUT_CXX11_CORE_NOEXCEPT_SUPPORT
+				#define CPUT_CXX11_CORE_CONSTEXPR_SUPPORT
+			#endif
+			#if CPUT_COMPILER_VERSION >= 47
 				#define CPUT_CXX11_CORE_OVERRIDE_SUPPORT
-				#define CPUT_CXX11_CORE_RVALUE_REFERENCES_SUPPORT
-				#define CPUT_CXX11_LIBRARY_ALGORITHM
-				#define CPUT_CXX11_LIBRARY_ATOMIC_SUPPORT
-				#define CPUT_CXX11_LIBRARY_CHRONO_SUPPORT
-				#define CPUT_CXX11_LIBRARY_SMART_PTR_SUPPORT
-				#define CPUT_CXX11_LIBRARY_THREAD_SUPPORT
-				#define CPUT_TR2_LIBRARY_FILESYSTEM_V2_SUPPORT
 			#endif
 		#endif
 	#endif
+#elif defined(_MSC_VER)
+	#define CPUT_COMPILER_MSVC
+	#define CPUT_COMPILER_NAME vc
 
-	#if _MSC_VER >= 1400
-		#pragma warning(disable: 4251 4275 4819)
+	#define CPUT_HAS_DECLSPEC
 
-		#ifndef _CRT_SECURE_NO_DEPRECATE
-			#define _CRT_SECURE_NO_DEPRECATE
-		#endif
-		#ifndef _SCL_SECURE_NO_DEPRECATE
-			#define _SCL_SECURE_NO_DEPRECATE
-		#endif
-		#ifndef _CRT_NON_CONFORMING_SWPRINTFS
-			#define _CRT_NON_CONFORMING_SWPRINTFS
-		#endif
+	// thread_local, magic statics and variadic templates are used throughout the SDK
+	#if _MSC_VER >= 1900
+		#define CPUT_COMPILER_VERSION 140
+	#else
+		#error Unsupported compiler. CPU-T needs Visual C++ 2015 or up.
+	#endif
+
+	#define CPUT_CXX11_CORE_EXTERN_TEMPLATES_SUPPORT
+	#define CPUT_CXX11_CORE_NULLPTR_SUPPORT
+	#define CPUT_CXX11_CORE_STATIC_ASSERT_SUPPORT
+	#define CPUT_CXX11_CORE_DECLTYPE_SUPPORT
+	#define CPUT_CXX11_CORE_STRONGLY_TYPED_ENUMS_SUPPORT
+	#define CPUT_CXX11_CORE_FOREACH_SUPPORT
+	#define CPUT_CXX11_CORE_OVERRIDE_SUPPORT
+	#define CPUT_CXX11_CORE_RVALUE_REFERENCES_SUPPORT
+	#define CPUT_CXX11_CORE_NOEXCEPT_SUPPORT
+	#define CPUT_CXX11_CORE_CONSTEXPR_SUPPORT
+	#define CPUT_CXX11_LIBRARY_ALGORITHM
+	#define CPUT_CXX11_LIBRARY_ARRAY_SUPPORT
+	#define CPUT_CXX11_LIBRARY_ATOMIC_SUPPORT
+	#define CPUT_CXX11_LIBRARY_CHRONO_SUPPORT
+	#define CPUT_CXX11_LIBRARY_CSTDINT_SUPPORT
+	#define CPUT_CXX11_LIBRARY_FUNCTIONAL_SUPPORT
+	#define CPUT_CXX11_LIBRARY_RANDOM_SUPPORT
+	#define CPUT_CXX11_LIBRARY_REGEX_SUPPORT
+	#define CPUT_CXX11_LIBRARY_SMART_PTR_SUPPORT
+	#define CPUT_CXX11_LIBRARY_SYSTEM_ERROR_SUPPORT
+	#define CPUT_CXX11_LIBRARY_THREAD_SUPPORT
+	#define CPUT_CXX11_LIBRARY_TUPLE_SUPPORT
+	#define CPUT_CXX11_LIBRARY_TYPE_TRAITS_SUPPORT
+	#define CPUT_CXX11_LIBRARY_UNORDERED_SUPPORT
+	#define CPUT_TR2_LIBRARY_FILESYSTEM_V2_SUPPORT
+
+	#pragma warning(disable: 4251 4275 4819)
+
+	#ifndef _CRT_SECURE_NO_DEPRECATE
+		#define _CRT_SECURE_NO_DEPRECATE
+	#endif
+	#ifndef _SCL_SECURE_NO_DEPRECATE
+		#define _SCL_SECURE_NO_DEPRECATE
+	#endif
+	#ifndef _CRT_NON_CONFORMING_SWPRINTFS
+		#define _CRT_NON_CONFORMING_SWPRINTFS
 	#endif
 #else
 	#error Unknown compiler.
 #endif
 
+#ifdef CPUT_CXX11_CORE_CONSTEXPR_SUPPORT
+	#define CPUT_CONSTEXPR constexpr
+#else
+	#define CPUT_CONSTEXPR
+#endif
+
 // Defines supported platforms
 #if defined(_WIN32) || defined(__WIN32__) || defined(WIN32)
 	#define CPUT_PLATFORM_WINDOWS
@@ -293,4 +291,12 @@
 	#define CPUT_HAS_STRUCT_PACK
 #endif
 
+#include <cstdint>
+
+namespace CPUT
+{
+	// 64-bit fields of the interfaces, on every compiler
+	typedef std::uint64_t uint64;
+}
+
 #endif		// _CPUTSDK_CONFIG_HPP
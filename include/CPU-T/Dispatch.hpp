@@ -0,0 +1,136 @@
+/**
+ * @file Dispatch.hpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of CPUTSDK, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#ifndef _CPUTSDK_DISPATCH_HPP
+#define _CPUTSDK_DISPATCH_HPP
+
+#include <CPU-T/Config.hpp>
+#include <CPU-T/CPU.hpp>
+#include <atomic>
+#include <cassert>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+namespace CPUT
+{
+	// Features that can be used in this process, CPUInfo::Instance().FeatureMask().
+	CPUInfo::FeatureSet const & HostFeatures();
+
+	inline CPUInfo::FeatureSet MakeFeatureSet()
+	{
+		return CPUInfo::FeatureSet();
+	}
+	template <typename... Features>
+	CPUInfo::FeatureSet MakeFeatureSet(CPUInfo::CPUFeature feature, Features... features)
+	{
+		CPUInfo::FeatureSet ret = MakeFeatureSet(features...);
+		ret.set(feature);
+		return ret;
+	}
+
+	// Picks one variant of a function for the running CPU, the first time it's called.
+	// Variants are listed from the most to the least demanding, and the first one whose features
+	// are all usable wins, so the last one should need nothing:
+	//
+	//	static CPUT::Dispatcher<float(float const *, size_t)> const sum =
+	//	{
+	//		{ CPUT::MakeFeatureSet(CPUInfo::CF_AVX512F), SumAVX512 },
+	//		{ CPUT::MakeFeatureSet(CPUInfo::CF_AVX2, CPUInfo::CF_FMA3), SumAVX2 },
+	//		{ CPUT::MakeFeatureSet(CPUInfo::CF_SSE42), SumSSE42 },
+	//		{ CPUT::MakeFeatureSet(), SumScalar }
+	//	};
+	//	float s = sum(data, n);
+	//
+	// After the first call, a call costs a relaxed load and an indirect call. Threads racing on
+	// the first call all resolve to the same function, so the pointer needs no ordering.
+	template <typename Signature>
+	class Dispatcher;
+
+	template <typename R, typename... Args>
+	class Dispatcher<R(Args...)>
+	{
+	public:
+		typedef R (*FunctionType)(Args...);
+
+		struct Variant
+		{
+			CPUInfo::FeatureSet required;
+			FunctionType function;
+		};
+
+	public:
+		Dispatcher(std::initializer_list<Variant> variants)
+			: variants_(variants), selected_(nullptr)
+		{
+		}
+
+		R operator()(Args... args) const
+		{
+			return this->Selected()(std::forward<Args>(args)...);
+		}
+
+		// The variant that would run with the given features, or nullptr if none fits.
+		FunctionType Select(CPUInfo::FeatureSet const & features) const
+		{
+			for (size_t i = 0; i < variants_.size(); ++ i)
+			{
+				if ((variants_[i].required & ~features).none())
+				{
+					return variants_[i].function;
+				}
+			}
+			assert(false && "No variant runs on this CPU, the last one should require no feature");
+			return nullptr;
+		}
+
+		// The variant bound to this dispatcher, resolving it if needed.
+		FunctionType Selected() const
+		{
+			FunctionType function = selected_.load(std::memory_order_relaxed);
+			if (nullptr == function)
+			{
+				function = this->Select(HostFeatures());
+				selected_.store(function, std::memory_order_relaxed);
+			}
+			return function;
+		}
+
+	private:
+		Dispatcher(Dispatcher const & rhs);
+		Dispatcher& operator=(Dispatcher const & rhs);
+
+	private:
+		std::vector<Variant> variants_;
+		mutable std::atomic<FunctionType> selected_;
+	};
+}
+
+#endif		// _CPUTSDK_DISPATCH_HPP
@@ -0,0 +1,140 @@
+/**
+ * @file HugePage.hpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of CPUTSDK, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#ifndef _CPUTSDK_HUGEPAGE_HPP
+#define _CPUTSDK_HUGEPAGE_HPP
+
+#include <CPU-T/Config.hpp>
+#include <CPU-T/CPU.hpp>
+#include <cstddef>
+#include <vector>
+
+namespace CPUT
+{
+	// Combines the TLB geometry of CPUInfo with the huge pages the kernel offers, to pick the page size
+	// of a large allocation:
+	//
+	//	CPUT::HugePageAdvisor advisor(CPUT::CPUInfo::Instance());
+	//	CPUT::HugePageAdvisor::Advice advice = advisor.Advise(table_size, CPUT::HugePageAdvisor::AP_Random);
+	//	CPUT::HugePageAdvisor::Block block;
+	//	if (advisor.Allocate(block, table_size, advice))
+	//	{
+	//		...
+	//		advisor.Free(block);
+	//	}
+	//
+	// The kernel settings are read in the constructor. Refresh() reads them again, the free pool sizes change
+	// as other processes allocate.
+	class HugePageAdvisor
+	{
+	public:
+		enum AccessPattern
+		{
+			AP_Sequential,			// Streaming, a TLB miss is amortized over a whole page
+			AP_Random				// Hash tables, graphs, every access can miss
+		};
+
+		enum PageSource
+		{
+			PS_Base,				// Normal pages
+			PS_Transparent,			// Transparent huge pages, through madvise
+			PS_HugeTLB				// Reserved huge pages. hugetlbfs on Linux, large pages on Windows
+		};
+
+		// A huge page size the kernel offers.
+		struct PoolInfo
+		{
+			uint64 page_size;
+			PageSource source;
+			uint64 total_pages;	// 0 for transparent huge pages, they have no pool
+			uint64 free_pages;
+		};
+
+		struct Coverage
+		{
+			uint64 page_size;
+			uint64 tlb_reach;		// Bytes, CPUInfo::TLBReach()
+			float coverage;					// Fraction of the working set the TLBs map, 1 at most
+			bool offered;					// The kernel can back an allocation with such pages now
+		};
+
+		struct Advice
+		{
+			uint64 page_size;
+			PageSource source;
+			float coverage;
+			std::vector<Coverage> coverages;	// Base pages first, then by page size
+		};
+
+		// What Allocate() got. Huge page sizes of PS_Transparent are what was asked for, the kernel
+		// may still back parts of the range with base pages.
+		struct Block
+		{
+			void* ptr;
+			size_t size;					// Mapped bytes, a multiple of page_size
+			uint64 page_size;
+			PageSource source;
+		};
+
+	public:
+		explicit HugePageAdvisor(CPUInfo const & cpu);
+
+		void Refresh();
+
+		uint64 BasePageSize() const
+		{
+			return base_page_size_;
+		}
+		std::vector<PoolInfo> const & Pools() const
+		{
+			return pools_;
+		}
+
+		// Coverage of a working set at every page size the TLBs map, and the smallest offered page size that
+		// covers it. If none does, the one covering the most. Sequential access only moves to huge pages once
+		// the working set outgrows the base page reach, and not beyond the transparent huge page size.
+		Advice Advise(uint64 working_set, AccessPattern pattern) const;
+
+		// Maps size bytes with the advised pages. Falls back to transparent huge pages, then to base pages,
+		// when the pool runs out or the process lacks the privilege. False only if no memory could be mapped.
+		bool Allocate(Block& block, size_t size, Advice const & advice) const;
+		void Free(Block& block) const;
+
+	private:
+		uint64 TLBReach(uint64 page_size) const;
+
+	private:
+		CPUInfo const & cpu_;
+		uint64 base_page_size_;
+		std::vector<PoolInfo> pools_;
+	};
+}
+
+#endif		// _CPUTSDK_HUGEPAGE_HPP
@@ -0,0 +1,152 @@
+/**
+ * @file NumaArena.hpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of CPUTSDK, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#ifndef _CPUTSDK_NUMAARENA_HPP
+#define _CPUTSDK_NUMAARENA_HPP
+
+#include <CPU-T/Config.hpp>
+#include <CPU-T/CPU.hpp>
+#include <CPU-T/ThreadPool.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace CPUT
+{
+	// A bump allocator whose pages live on one NUMA node. Memory comes in chunks, mapped on first use and
+	// bound to the node with mbind (Linux) or VirtualAllocExNuma (Windows). Where the kernel refuses, a thread
+	// pinned to the node's CPUs touches the pages first, so they're placed there anyway. Blocks are aligned to
+	// the L1 data cache line, so blocks of different owners never share a line. They're only released together,
+	// by Reset() or the destructor.
+	//
+	// An arena isn't thread safe. Give each thread its own, WorkerArenas does that for a ThreadPool.
+	class NumaArena
+	{
+	public:
+		// node is an index into CPUInfo::NumaNodes(). -1, or a machine with a single node, gets unbound memory.
+		// A request is carved from the current chunk when it fits. Otherwise one larger than a quarter of
+		// chunk_size gets a chunk of its own, so the rest of the current chunk isn't thrown away for it.
+		NumaArena(CPUInfo const & cpu, int node, size_t chunk_size = 2 * 1024 * 1024);
+		~NumaArena();
+
+		// Aligned to the cache line, or to alignment if that's larger. nullptr if out of memory, or if the
+		// size can't be represented.
+		void* Allocate(size_t size, size_t alignment = 0);
+		template <typename T>
+		T* Allocate(size_t count = 1)
+		{
+			if (count > SIZE_MAX / sizeof(T))
+			{
+				return nullptr;
+			}
+			return static_cast<T*>(this->Allocate(count * sizeof(T), alignof(T)));
+		}
+
+		// Forgets every block. The first chunk is kept for reuse, the others are unmapped.
+		void Reset();
+
+		int Node() const
+		{
+			return node_;
+		}
+		size_t LineSize() const
+		{
+			return line_size_;
+		}
+		// The chunks were bound to the node by the kernel, not only placed by first touch.
+		bool Bound() const
+		{
+			return bound_;
+		}
+		// Bytes mapped, and bytes handed out including alignment padding.
+		size_t Reserved() const;
+		size_t Used() const
+		{
+			return used_;
+		}
+
+	private:
+		NumaArena(NumaArena const & rhs);
+		NumaArena& operator=(NumaArena const & rhs);
+
+		struct Chunk
+		{
+			char* ptr;
+			size_t size;
+		};
+
+		bool MapChunk(Chunk& chunk, size_t size);
+		void UnmapChunk(Chunk& chunk);
+
+	private:
+		int node_;
+		int node_id_;				// The OS node number, -1 if unbound
+		CPUSet node_cpus_;
+		size_t line_size_;
+		size_t page_size_;
+		size_t chunk_size_;
+		bool bound_;
+
+		std::vector<Chunk> chunks_;	// The one being carved is the last
+		size_t offset_;				// Into the last chunk
+		size_t used_;
+	};
+
+	// One NumaArena per worker of a pool, on the node the worker is pinned to.
+	//
+	//	CPUT::WorkerArenas arenas(pool, CPUT::CPUInfo::Instance());
+	//	pool.Submit([&arenas]
+	//		{
+	//			Node* n = arenas.Local()->Allocate<Node>();
+	//			...
+	//		});
+	class WorkerArenas
+	{
+	public:
+		WorkerArenas(ThreadPool const & pool, CPUInfo const & cpu, size_t chunk_size = 2 * 1024 * 1024);
+
+		// The arena of the worker running the caller, nullptr outside the pool.
+		NumaArena* Local();
+		NumaArena& Arena(int worker)
+		{
+			return *arenas_[worker];
+		}
+
+		// Resets every arena. Only while no task allocates.
+		void Reset();
+
+	private:
+		ThreadPool const & pool_;
+		std::vector<std::unique_ptr<NumaArena> > arenas_;
+	};
+}
+
+#endif		// _CPUTSDK_NUMAARENA_HPP
@@ -0,0 +1,152 @@
+/**
+ * @file Placement.hpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of CPUTSDK, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#ifndef _CPUTSDK_PLACEMENT_HPP
+#define _CPUTSDK_PLACEMENT_HPP
+
+#include <CPU-T/Config.hpp>
+#include <CPU-T/CPU.hpp>
+#include <CPU-T/CPUSet.hpp>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <cstdint>
+
+namespace CPUT
+{
+	// Turns the topology of CPUInfo into the CPUs each worker of a pool should run on:
+	//
+	//	CPUT::PlacementAdvisor advisor(CPUT::CPUInfo::Instance());
+	//	CPUT::PlacementAdvisor::Plan plan = advisor.Place(0, CPUT::PlacementAdvisor::PP_Compact,
+	//		CPUT::PlacementAdvisor::PF_AvoidSMT | CPUT::PlacementAdvisor::PF_ReserveCore0);
+	//	std::vector<std::thread> workers;
+	//	for (size_t i = 0; i < plan.workers.size(); ++ i)
+	//	{
+	//		workers.push_back(std::thread(Work, i));
+	//	}
+	//	CPUT::ApplyPlacement(workers, plan);
+	//
+	// Only the CPUs the process can use are handed out, QueryEffectiveCPUs() unless the constructor is told
+	// otherwise. Cores are grouped by their last level cache, usually the L3, and those groups by NUMA node.
+	class PlacementAdvisor
+	{
+	public:
+		enum PlacementPolicy
+		{
+			PP_Compact,				// Fill one cache domain, SMT siblings included, before the next, and one node before the next
+			PP_Spread				// Round-robin over NUMA nodes, then over the cache domains of each node. SMT siblings come after every core has one
+		};
+
+		enum PlacementFlag
+		{
+			PF_AvoidSMT = 1UL << 0,			// At most one worker per core. Without it, siblings are ordered as the policy says
+			PF_ReserveCore0 = 1UL << 1,		// Leave the core of CPU 0 to the OS and the main thread, unless it's the only one
+			PF_PerformanceFirst = 1UL << 2	// On hybrid CPUs, hand out the threads of every performance core before an efficiency core
+		};
+
+		// What each worker is bound to.
+		enum PlacementScope
+		{
+			PS_Thread,				// The hardware thread picked for it
+			PS_Core,				// Every usable hardware thread of its core
+			PS_Domain,				// Every usable CPU sharing its last level cache
+			PS_Node					// Every usable CPU of its NUMA node
+		};
+
+		// Usable CPUs sharing a last level cache.
+		struct DomainInfo
+		{
+			CPUSet cpus;
+			int node;				// Index into CPUInfo::NumaNodes(), -1 if unknown
+			int cores;				// Number of cores with a usable CPU
+		};
+
+		struct WorkerPlacement
+		{
+			CPUSet cpus;			// What the worker should be bound to
+			int cpu;				// The hardware thread picked for it
+			int domain;				// Index into Domains()
+			int node;				// Index into CPUInfo::NumaNodes(), -1 if unknown
+		};
+
+		struct Plan
+		{
+			std::vector<WorkerPlacement> workers;
+			bool oversubscribed;	// More workers than hardware threads the flags allow, some share one
+		};
+
+	public:
+		explicit PlacementAdvisor(CPUInfo const & cpu);
+		PlacementAdvisor(CPUInfo const & cpu, CPUSet const & allowed);
+
+		CPUSet const & UsableCPUs() const
+		{
+			return usable_;
+		}
+		// Compact order, by node first.
+		std::vector<DomainInfo> const & Domains() const
+		{
+			return domains_;
+		}
+		int NumUsableCores() const
+		{
+			return static_cast<int>(cores_.size());
+		}
+
+		// A worker count of 0 or less asks for one worker per hardware thread the flags allow, which with
+		// PF_AvoidSMT is one per physical core. Beyond that count, the order starts over.
+		Plan Place(int workers, PlacementPolicy policy, std::uint32_t flags = 0, PlacementScope scope = PS_Thread) const;
+
+	private:
+		struct CoreSlot
+		{
+			std::vector<int> threads;	// Usable hardware threads, ascending
+			int domain;
+			CPUInfo::CoreType type;
+		};
+
+		void Build(CPUSet const & allowed);
+		// (index into cores_, hardware thread) in the order workers get them
+		std::vector<std::pair<int, int> > Order(PlacementPolicy policy, std::uint32_t flags) const;
+
+	private:
+		CPUInfo const & cpu_;
+		CPUSet usable_;
+		std::vector<DomainInfo> domains_;
+		std::vector<CoreSlot> cores_;	// Grouped by domain, in topology order within each
+		int core0_;						// Index into cores_ of the core of CPU 0, -1 if it has no usable thread
+	};
+
+	// Binds threads[i] to the CPUs of worker i of the plan, modulo the plan size. False if any bind failed.
+	bool ApplyPlacement(std::vector<std::thread>& threads, PlacementAdvisor::Plan const & plan);
+}
+
+#endif		// _CPUTSDK_PLACEMENT_HPP
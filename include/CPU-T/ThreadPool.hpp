@@ -0,0 +1,179 @@
+/**
+ * @file ThreadPool.hpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of CPUTSDK, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#ifndef _CPUTSDK_THREADPOOL_HPP
+#define _CPUTSDK_THREADPOOL_HPP
+
+#include <CPU-T/Config.hpp>
+#include <CPU-T/CPU.hpp>
+#include <CPU-T/Placement.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <cstdint>
+
+namespace CPUT
+{
+	class ThreadPool;
+
+	// Tasks that can be waited for together. Waiting from a worker runs other tasks meanwhile, so a task can
+	// fork and join without tying up its worker:
+	//
+	//	CPUT::TaskGroup group;
+	//	pool.Submit(group, [] { Left(); });
+	//	pool.Submit(group, [] { Right(); });
+	//	pool.Wait(group);
+	class TaskGroup
+	{
+		friend class ThreadPool;
+
+	public:
+		TaskGroup()
+			: pending_(0)
+		{
+		}
+
+		bool Done() const
+		{
+			return 0 == pending_.load(std::memory_order_acquire);
+		}
+
+	private:
+		TaskGroup(TaskGroup const & rhs);
+		TaskGroup& operator=(TaskGroup const & rhs);
+
+	private:
+		std::atomic<std::int64_t> pending_;
+	};
+
+	// A work-stealing pool whose workers are pinned by a PlacementAdvisor plan. Each worker owns a lock-free
+	// deque. It pushes and pops its own tasks at the bottom, and an idle worker steals from the top of the
+	// others, nearest first:
+	// its SMT siblings, then the cores sharing its L2, then its L3, then its NUMA node, then its package,
+	// and the rest last.
+	// Tasks submitted from outside the pool go through a shared queue. Workers that find nothing park
+	// on a condition variable until a task is submitted.
+	//
+	//	CPUT::ThreadPool pool(CPUT::CPUInfo::Instance());
+	//	for (int i = 0; i < n; ++ i)
+	//	{
+	//		pool.Submit([i] { Work(i); });
+	//	}
+	//	pool.Wait();
+	class ThreadPool
+	{
+	public:
+		typedef std::function<void()> Task;
+
+		// How far a steal reached, from the thief's point of view.
+		enum StealDistance
+		{
+			SD_SMT,					// A hardware thread of the same core
+			SD_L2,					// A core sharing the L2
+			SD_L3,					// A core sharing the last level cache
+			SD_Node,				// The same NUMA node
+			SD_Package,				// The same package, on another node
+			SD_Remote,				// Another package
+
+			SD_NumDistances
+		};
+
+	public:
+		// A worker count of 0 or less sizes the pool from the placement slots, capped by
+		// QueryEffectiveCPUs().Parallelism() so a CPU quota isn't oversubscribed.
+		explicit ThreadPool(CPUInfo const & cpu, int workers = 0,
+			PlacementAdvisor::PlacementPolicy policy = PlacementAdvisor::PP_Compact, std::uint32_t flags = 0);
+		// Runs every task submitted so far, then joins the workers.
+		~ThreadPool();
+
+		int NumWorkers() const
+		{
+			return static_cast<int>(workers_.size());
+		}
+		PlacementAdvisor::Plan const & Placement() const
+		{
+			return plan_;
+		}
+		// The workers the given one steals from, nearest first.
+		std::vector<int> const & Victims(int worker) const;
+		// Distance from a worker to another, as used to order the victims.
+		StealDistance Distance(int thief, int victim) const;
+
+		void Submit(Task task);
+		void Submit(TaskGroup& group, Task task);
+
+		// Block until every task submitted so far, or every task of the group, has run. From inside a task,
+		// only the group version can be used, and the worker runs other tasks while it waits.
+		void Wait();
+		void Wait(TaskGroup& group);
+
+		// Index of the worker running the caller, -1 outside this pool.
+		int CurrentWorker() const;
+
+		// Successful steals of every worker at each distance, since the pool started.
+		std::vector<std::uint64_t> StealCounts() const;
+
+	private:
+		struct TaskNode;
+		class WorkDeque;
+		struct Worker;
+
+		void Push(TaskNode* node);
+		TaskNode* FindTask(int worker);
+		void Run(TaskNode* node);
+		void WorkerMain(int worker);
+		void WakeOne();
+
+	private:
+		PlacementAdvisor::Plan plan_;
+		std::vector<std::unique_ptr<Worker> > workers_;
+		std::vector<std::vector<StealDistance> > distances_;
+
+		std::mutex inject_mutex_;
+		std::deque<TaskNode*> inject_;
+		std::atomic<std::int64_t> inject_size_;
+
+		std::atomic<std::int64_t> pending_;
+		std::atomic<std::uint64_t> epoch_;
+		std::atomic<int> sleepers_;
+		std::atomic<bool> stop_;
+		std::mutex park_mutex_;
+		std::condition_variable park_cv_;
+		std::mutex done_mutex_;
+		std::condition_variable done_cv_;
+	};
+}
+
+#endif		// _CPUTSDK_THREADPOOL_HPP
@@ -29,16 +29,34 @@
  */
 
 #include <CPU-T/CPU.hpp>
+#include <CPU-T/CPUSet.hpp>
+#include <CPU-T/CPUIDDump.hpp>
+#include "SDKUtil.hpp"
 
+#if defined CPUT_PLATFORM_WINDOWS
 #include <windows.h>
 #if (_WIN32_WINNT >= 0x0603 /*_WIN32_WINNT_WINBLUE*/)
 #include <VersionHelpers.h>
 #endif
+#else
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#endif
 #include <cstring>
 #include <cstdio>
+#include <cstdlib>
 #include <cassert>
 #include <vector>
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
 
 #include <cstdint>
 namespace CPUT
@@ -53,10 +71,10 @@ namespace CPUT
 	using std::int8_t;
 }
 
+#if defined(CPUT_COMPILER_MSVC)
 #include <intrin.h>
-
-#ifdef CPUT_CPU_X86
-#define RDMSR __asm _emit 0x0F __asm _emit 0x32
+#elif defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)
+#include <x86intrin.h>
 #endif
 
 namespace
@@ -64,6 +82,73 @@ namespace
 #include "CPUIdentifier.cpp"
 #include "CacheIdentifier.cpp"
 
+	bool operator<(CPUModelDesc const & lhs, uint32_t rhs)
+	{
+		return lhs.key < rhs;
+	}
+
+	bool operator<(CacheDesc const & lhs, uint32_t rhs)
+	{
+		return lhs.code < rhs;
+	}
+
+	CPUModelDesc const * FindCPUModel(CPUVendorDesc const & vendor, uint32_t family, uint32_t model, uint32_t stepping)
+	{
+		CPUModelDesc const * first = CPU_MODELS + vendor.first_model;
+		CPUModelDesc const * last = CPU_MODELS + vendor.last_model;
+		uint32_t const key = (family << 16) | (model << 4) | stepping;
+		CPUModelDesc const * iter = std::lower_bound(first, last, key);
+		if ((iter != last) && ((iter->key >> 4) == (key >> 4)) && (iter->first_stepping <= stepping))
+		{
+			return iter;
+		}
+		else
+		{
+			return nullptr;
+		}
+	}
+
+	// Never fails. The unknown vendors and families have their own entries in CPU_MODELS.
+	CPUModelDesc const & CPUIdentify(uint32_t const vendor_id[3], uint32_t family, uint32_t model, uint32_t stepping)
+	{
+		for (size_t i = 0; i < sizeof(CPU_VENDORS) / sizeof(CPU_VENDORS[0]); ++ i)
+		{
+			CPUVendorDesc const & vendor = CPU_VENDORS[i];
+			if ((vendor.id[0] == vendor_id[0]) && (vendor.id[1] == vendor_id[1]) && (vendor.id[2] == vendor_id[2]))
+			{
+				CPUModelDesc const * desc = FindCPUModel(vendor, family, model & 0xFF, stepping & 0xF);
+				if (!desc)
+				{
+					desc = FindCPUModel(vendor, family, CPU_ANY_MODEL, stepping & 0xF);
+				}
+				return desc ? *desc : CPU_MODELS[vendor.fallback];
+			}
+		}
+
+		return CPU_MODELS[0];
+	}
+
+	// The entry of the family, or the one for all families. Null if the descriptor is unknown.
+	CacheDesc const * CacheIdentify(uint32_t code, uint32_t family)
+	{
+		CacheDesc const * first = CACHE_DESCS;
+		CacheDesc const * last = CACHE_DESCS + sizeof(CACHE_DESCS) / sizeof(CACHE_DESCS[0]);
+		CacheDesc const * iter = std::lower_bound(first, last, code);
+		CacheDesc const * ret = nullptr;
+		for (; (iter != last) && (iter->code == code); ++ iter)
+		{
+			if (iter->family == family)
+			{
+				return iter;
+			}
+			if (0 == iter->family)
+			{
+				ret = iter;
+			}
+		}
+		return ret;
+	}
+
 	int Cy6x86PR[6][2] =
 	{
 		{80, 90},
@@ -127,53 +212,7 @@ namespace
 	};
 
 
-#ifndef CPUT_CPU_ARM
-	void get_cpuid(uint32_t* peax, uint32_t* pebx, uint32_t* pecx, uint32_t* pedx)
-	{	
-#ifdef CPUT_COMPILER_MSVC
-	#if CPUT_COMPILER_VERSION >= 90 
-		int CPUInfo[4];
-		__cpuidex(CPUInfo, *peax, *pecx);
-		*peax = CPUInfo[0];
-		*pebx = CPUInfo[1];
-		*pecx = CPUInfo[2];
-		*pedx = CPUInfo[3];
-	#else
-		__asm
-		{
-			mov		eax, [peax]
-			mov		ecx, [pecx]
-			cpuid
-			mov		[peax], eax
-			mov		[pebx], ebx
-			mov		[pecx], ecx
-			mov		[pedx], edx
-		}
-	#endif
-#elif defined CPUT_COMPILER_GCC
-	#ifdef CPUT_CPU_X64
-		__asm__
-		(
-			"cpuid"
-			: "=a" (*peax), "=b" (*pebx), "=c" (*pecx), "=d" (*pedx)
-			: "a" (*peax), "c" (*pecx)
-		);
-	#else
-		__asm__
-		(
-			"pushl  %%ebx			\n\t"
-			"cpuid					\n\t"
-			"movl   %%ebx, %%edi	\n\t"
-			"popl   %%ebx			\n\t"
-			: "=a" (*peax), "=D" (*pebx), "=c" (*pecx), "=d" (*pedx)
-			: "a" (*peax), "c" (*pecx)
-		);
-	#endif
-#else
-		// TODO: Supports other compiler
-#endif
-	}
-#endif
+
 	
 
 #if (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)) && !defined(CPUT_PLATFORM_ANDROID)
@@ -183,53 +222,190 @@ namespace
 		CFM_LogicalProcessorCount_Intel = 0x00FF0000,
 		CFM_ApicId_Intel = 0xFF000000,
 
-		// In ECX of type 1
-		CFM_SSE3		= 1UL << 0,		// SSE3
-		CFM_SSSE3		= 1UL << 9,		// SSSE3
-		CFM_FMA3		= 1UL << 12,	// 256-bit FMA (Intel Haswell, AMD Piledriver)
-		CFM_CMPXCHG16B	= 1UL << 13,	// CMPXCHG16B instruction
-		CFM_SSE41		= 1UL << 19,	// SSE4.1 (Intel Core 2 Penryn, Intel Core i7 Nehalem, AMD Bulldozer)
-		CFM_SSE42		= 1UL << 20,	// SSE4.2 (Intel Core i7 Nehalem, AMD Bulldozer)
-		CFM_MOVBE		= 1UL << 22,	// MOVBE (Intel)
-		CFM_POPCNT		= 1UL << 23,	// POPCNT
-		CFM_AES			= 1UL << 25,	// AES support (Intel)
-		CFM_OSXSAVE		= 1UL << 27,	// OSX save
-		CFM_AVX			= 1UL << 28,	// 256-bit AVX (Intel Sandy Bridge, AMD Bulldozer)
-		CFM_F16C		= 1UL << 29,	// F16C (Intel Ivy Bridge, AMD Piledriver)
-
-		// In EDX of type 1
-		CFM_CMPXCHG8B	= 1UL << 8,		// CMPXCHG8B instruction
-		CFM_SYSENTER	= 1UL << 11,	// SYSENTER/SYSEXIT instructions
-		CFM_CMOV		= 1UL << 15,	// Conditional move instruction
-		CFM_MMX			= 1UL << 23,	// MMX technology
-		CFM_SSE			= 1UL << 25,	// SSE
-		CFM_SSE2		= 1UL << 26,	// SSE2
-		CFM_HTT			= 1UL << 28,	// Hyper-threading technology
-		CFM_3DNowExt_AMD	= 1UL << 30,	// 3DNow! extension (AMD only)
-		CFM_3DNow_AMD		= 1UL << 31,	// 3DNow! (AMD only)
-
-
-		// In EBX of type 7
-		CFM_AVX2		= 1UL << 5,
+		// In EDX of type 1. Intel only.
+		CFM_PSN						= 1UL << 18,
 
 		// In EAX of type 4. Intel only.
 		CFM_NC_Intel                = 0xFC000000,
+		// In EAX/EDX of type 4 and 0x8000001D
+		CFM_FullyAssociative		= 1UL << 9,
+		CFM_CacheInclusive			= 1UL << 1,
+
+		// In EDX of type 7. Intel only.
+		CFM_Hybrid					= 1UL << 15,
+
+		// In EDX of type 0x18. Intel only.
+		CFM_TLBFullyAssociative		= 1UL << 8,
 
 		// In ECX of type 0x80000001. AMD only.
 		CFM_CmpLegacy_AMD           = 0x00000002,
-		CFM_LZCNT_AMD				= 1UL << 5,
-		CFM_SSE4A_AMD				= 1UL << 6,
-		CFM_MisalignedSSE_AMD		= 1UL << 7,
-		CFM_FMA4_AMD				= 1UL << 16,	// FMA4 (AMD Bulldozer)
-
-		// In EDX of type 0x80000001
-		CFM_X64						= 1UL << 29,
+		CFM_TopologyExtensions_AMD	= 1UL << 22,	// Leaf 0x8000001D/0x8000001E
 
 		// In ECX of type 0x80000008. AMD only.
 		CFM_NC_AMD                  = 0x000000FF,
 		CFM_ApicIdCoreIdSize_AMD    = 0x0000F000,
+
+		// In EDX of type 0x80000007
+		CFM_InvariantTSC			= 1UL << 8,
+	};
+#endif
+
+	// XCR0 state components
+	enum XCR0Mask
+	{
+		XCR0_SSE		= 1UL << 1,
+		XCR0_AVX		= 1UL << 2,
+		XCR0_Opmask		= 1UL << 5,
+		XCR0_ZMM_Hi256	= 1UL << 6,
+		XCR0_Hi16_ZMM	= 1UL << 7,
+		XCR0_TileCfg	= 1UL << 17,
+		XCR0_TileData	= 1UL << 18,
+
+		XCR0_YMMState = XCR0_SSE | XCR0_AVX,
+		XCR0_ZMMState = XCR0_YMMState | XCR0_Opmask | XCR0_ZMM_Hi256 | XCR0_Hi16_ZMM,
+		XCR0_TileState = XCR0_TileCfg | XCR0_TileData
+	};
+
+	enum FeatureVendor
+	{
+		FV_Any,
+		FV_AMD
+	};
+
+	// Where a feature bit lives, and which register state the OS has to save before it can be used.
+	struct FeatureBit
+	{
+		CPUT::CPUInfo::CPUFeature feature;
+		char const * name;
+		uint32_t fn;
+		uint32_t sub_fn;
+		uint8_t reg;			// 0 = EAX, 1 = EBX, 2 = ECX, 3 = EDX
+		uint8_t bit;
+		uint8_t vendor;			// FeatureVendor
+		uint32_t os_state;		// XCR0 bits that must all be set, 0 if none
 	};
 
+	// Ordered as CPUInfo::CPUFeature.
+	FeatureBit const FEATURE_BITS[] =
+	{
+		{ CPUT::CPUInfo::CF_HTT,				"HTT",				1, 0, 3, 28, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_CMPXCHG8B,			"CX8",				1, 0, 3, 8, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_SYSENTER,			"SYSENTER",			1, 0, 3, 11, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_CMOV,				"CMOV",				1, 0, 3, 15, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_MMX,				"MMX",				1, 0, 3, 23, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_3DNow,				"3DNow!",			0x80000001, 0, 3, 31, FV_AMD, 0 },
+		{ CPUT::CPUInfo::CF_3DNowExt,			"Extended 3DNow!",	0x80000001, 0, 3, 30, FV_AMD, 0 },
+		{ CPUT::CPUInfo::CF_SSE,				"SSE",				1, 0, 3, 25, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_SSE2,				"SSE2",				1, 0, 3, 26, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_SSE3,				"SSE3",				1, 0, 2, 0, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_SSSE3,				"SSSE3",			1, 0, 2, 9, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_SSE41,				"SSE4.1",			1, 0, 2, 19, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_SSE42,				"SSE4.2",			1, 0, 2, 20, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_SSE4A,				"SSE4.A",			0x80000001, 0, 2, 6, FV_AMD, 0 },
+		{ CPUT::CPUInfo::CF_MisalignedSSE,		"MisalignedSSE",	0x80000001, 0, 2, 7, FV_AMD, 0 },
+		{ CPUT::CPUInfo::CF_X64,				"X64",				0x80000001, 0, 3, 29, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_FMA3,				"FMA3",				1, 0, 2, 12, FV_Any, XCR0_YMMState },
+		{ CPUT::CPUInfo::CF_CMPXCHG16B,			"CX16",				1, 0, 2, 13, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_MOVBE,				"MOVBE",			1, 0, 2, 22, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_POPCNT,				"POPCNT",			1, 0, 2, 23, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_AES,				"AES",				1, 0, 2, 25, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_AVX,				"AVX",				1, 0, 2, 28, FV_Any, XCR0_YMMState },
+		{ CPUT::CPUInfo::CF_LZCNT,				"LZCNT",			0x80000001, 0, 2, 5, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_AVX2,				"AVX2",				7, 0, 1, 5, FV_Any, XCR0_YMMState },
+		{ CPUT::CPUInfo::CF_FMA4,				"FMA4",				0x80000001, 0, 2, 16, FV_AMD, XCR0_YMMState },
+		{ CPUT::CPUInfo::CF_F16C,				"F16C",				1, 0, 2, 29, FV_Any, XCR0_YMMState },
+		{ CPUT::CPUInfo::CF_PCLMULQDQ,			"PCLMULQDQ",		1, 0, 2, 1, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_RDRAND,				"RDRAND",			1, 0, 2, 30, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_RDSEED,				"RDSEED",			7, 0, 1, 18, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_XSAVE,				"XSAVE",			1, 0, 2, 26, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_XSAVEOPT,			"XSAVEOPT",			0xD, 1, 0, 0, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_XSAVEC,				"XSAVEC",			0xD, 1, 0, 1, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_XSAVES,				"XSAVES",			0xD, 1, 0, 3, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_FSGSBASE,			"FSGSBASE",			7, 0, 1, 0, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_BMI1,				"BMI1",				7, 0, 1, 3, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_BMI2,				"BMI2",				7, 0, 1, 8, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_ADX,				"ADX",				7, 0, 1, 19, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_SHA,				"SHA",				7, 0, 1, 29, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_ERMS,				"ERMS",				7, 0, 1, 9, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_FSRM,				"FSRM",				7, 0, 3, 4, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_PREFETCHW,			"PREFETCHW",		0x80000001, 0, 2, 8, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_RDTSCP,				"RDTSCP",			0x80000001, 0, 3, 27, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_RDPID,				"RDPID",			7, 0, 2, 22, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_CLFLUSHOPT,			"CLFLUSHOPT",		7, 0, 1, 23, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_CLWB,				"CLWB",				7, 0, 1, 24, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_CLZERO,				"CLZERO",			0x80000008, 0, 1, 0, FV_AMD, 0 },
+		{ CPUT::CPUInfo::CF_WBNOINVD,			"WBNOINVD",			0x80000008, 0, 1, 9, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_MOVDIRI,			"MOVDIRI",			7, 0, 2, 27, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_MOVDIR64B,			"MOVDIR64B",		7, 0, 2, 28, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_VAES,				"VAES",				7, 0, 2, 9, FV_Any, XCR0_YMMState },
+		{ CPUT::CPUInfo::CF_VPCLMULQDQ,			"VPCLMULQDQ",		7, 0, 2, 10, FV_Any, XCR0_YMMState },
+		{ CPUT::CPUInfo::CF_GFNI,				"GFNI",				7, 0, 2, 8, FV_Any, 0 },
+		{ CPUT::CPUInfo::CF_AVXVNNI,			"AVX-VNNI",			7, 1, 0, 4, FV_Any, XCR0_YMMState },
+		{ CPUT::CPUInfo::CF_AVX512F,			"AVX512F",			7, 0, 1, 16, FV_Any, XCR0_ZMMState },
+		{ CPUT::CPUInfo::CF_AVX512CD,			"AVX512CD",			7, 0, 1, 28, FV_Any, XCR0_ZMMState },
+		{ CPUT::CPUInfo::CF_AVX512BW,			"AVX512BW",			7, 0, 1, 30, FV_Any, XCR0_ZMMState },
+		{ CPUT::CPUInfo::CF_AVX512DQ,			"AVX512DQ",			7, 0, 1, 17, FV_Any, XCR0_ZMMState },
+		{ CPUT::CPUInfo::CF_AVX512VL,			"AVX512VL",			7, 0, 1, 31, FV_Any, XCR0_ZMMState },
+		{ CPUT::CPUInfo::CF_AVX512IFMA,			"AVX512IFMA",		7, 0, 1, 21, FV_Any, XCR0_ZMMState },
+		{ CPUT::CPUInfo::CF_AVX512VBMI,			"AVX512VBMI",		7, 0, 2, 1, FV_Any, XCR0_ZMMState },
+		{ CPUT::CPUInfo::CF_AVX512VBMI2,		"AVX512VBMI2",		7, 0, 2, 6, FV_Any, XCR0_ZMMState },
+		{ CPUT::CPUInfo::CF_AVX512VNNI,			"AVX512VNNI",		7, 0, 2, 11, FV_Any, XCR0_ZMMState },
+		{ CPUT::CPUInfo::CF_AVX512BITALG,		"AVX512BITALG",		7, 0, 2, 12, FV_Any, XCR0_ZMMState },
+		{ CPUT::CPUInfo::CF_AVX512VPOPCNTDQ,	"AVX512VPOPCNTDQ",	7, 0, 2, 14, FV_Any, XCR0_ZMMState },
+		{ CPUT::CPUInfo::CF_AVX512BF16,			"AVX512BF16",		7, 1, 0, 5, FV_Any, XCR0_ZMMState },
+		{ CPUT::CPUInfo::CF_AVX512FP16,			"AVX512FP16",		7, 0, 3, 23, FV_Any, XCR0_ZMMState },
+		{ CPUT::CPUInfo::CF_AMXTILE,			"AMX-TILE",			7, 0, 3, 24, FV_Any, XCR0_TileState },
+		{ CPUT::CPUInfo::CF_AMXINT8,			"AMX-INT8",			7, 0, 3, 25, FV_Any, XCR0_TileState },
+		{ CPUT::CPUInfo::CF_AMXBF16,			"AMX-BF16",			7, 0, 3, 22, FV_Any, XCR0_TileState }
+	};
+	static_assert(sizeof(FEATURE_BITS) / sizeof(FEATURE_BITS[0]) == CPUT::CPUInfo::CF_NumFeatures,
+		"FEATURE_BITS must have an entry for every CPUFeature");
+
+#if (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)) && !defined(CPUT_PLATFORM_ANDROID)
+	// Decodes the 4-bit associativity field of leaf 0x80000006. 0xFF is fully associative, 0 disabled.
+	int AMDAssociativity(uint32_t code)
+	{
+		static int const ways[16] = { 0, 1, 2, 3, 4, 6, 8, 0, 16, 0, 32, 48, 64, 96, 128, 0xFF };
+		return ways[code & 0xF];
+	}
+
+	// Sets of a cache described by the AMD summary leaves, which only report size, way and line.
+	int AMDSets(CPUT::CPUInfo::CacheLevelInfo const & cache)
+	{
+		if ((0xFF == cache.way) || (0 == cache.way) || (0 == cache.line))
+		{
+			return 1;
+		}
+		return cache.size * 1024 / (cache.way * cache.line);
+	}
+
+	// Crystal clock of the parts that report a TSC/crystal ratio in leaf 0x15 but leave ECX zero.
+	// Values are from Intel SDM Vol. 3B, 18.7.3.
+	uint32_t IntelCrystalClockHz(int family, int model)
+	{
+		if (6 == family)
+		{
+			switch (model)
+			{
+			case 0x4E:
+			case 0x5E:
+			case 0x8E:
+			case 0x9E:
+				return 24000000;
+
+			case 0x5F:
+				return 25000000;
+
+			case 0x5C:
+				return 19200000;
+
+			default:
+				break;
+			}
+		}
+		return 0;
+	}
+
 #ifdef CPUT_PLATFORM_WINDOWS
 #ifdef CPUT_COMPILER_GCC
 	typedef enum _LOGICAL_PROCESSOR_RELATIONSHIP
@@ -279,145 +455,519 @@ namespace
 	typedef BOOL (WINAPI* GetLogicalProcessorInformationPtr)(SYSTEM_LOGICAL_PROCESSOR_INFORMATION*, uint32_t*);
 #endif
 
-	class ApicExtractor
+	// Level types of CPUID leaf 0xB/0x1F, in ECX[15:8]
+	enum TopologyLevelType
+	{
+		TLT_Invalid = 0,
+		TLT_SMT = 1,
+		TLT_Core = 2,
+		TLT_Module = 3,
+		TLT_Tile = 4,
+		TLT_Die = 5,
+		TLT_DieGroup = 6
+	};
+
+	// Number of bits needed to hold max_ids different IDs.
+	uint32_t GetMaskWidth(uint32_t max_ids)
+	{
+		uint32_t width = 0;
+		while ((width < 32) && ((1ULL << width) < max_ids))
+		{
+			++ width;
+		}
+		return width;
+	}
+
+	// Splits a 32-bit (x2)APIC ID into thread, core, die and package IDs. The core, die and
+	// package IDs keep the upper bits, so they are unique across the whole system.
+	class TopologyExtractor
 	{
 	public:
-		ApicExtractor(uint8_t log_procs_per_pkg = 1, uint8_t cores_per_pkg = 1)
+		TopologyExtractor()
+			: smt_shift_(0), die_shift_(0), pkg_shift_(0)
+		{
+		}
+
+		void SetShifts(uint32_t smt_shift, uint32_t die_shift, uint32_t pkg_shift)
 		{
-			this->SetPackageTopology(log_procs_per_pkg, cores_per_pkg);
+			smt_shift_ = smt_shift;
+			die_shift_ = std::max(die_shift, smt_shift);
+			pkg_shift_ = std::max(pkg_shift, die_shift_);
 		}
 
-		uint8_t SmtId(uint8_t apic_id) const
+		uint32_t ThreadId(uint32_t apic_id) const
 		{
-			return apic_id & smt_id_mask_.mask;
+			return apic_id & static_cast<uint32_t>((1ULL << smt_shift_) - 1);
 		}
 
-		uint8_t CoreId(uint8_t apic_id) const
+		uint32_t CoreId(uint32_t apic_id) const
 		{
-			return (apic_id & core_id_mask_.mask) >> smt_id_mask_.width;
+			return Shift(apic_id, smt_shift_);
 		}
 
-		uint8_t PackageId(uint8_t apic_id) const
+		uint32_t DieId(uint32_t apic_id) const
 		{
-			return (apic_id & pkg_id_mask_.mask) >> (smt_id_mask_.width + core_id_mask_.width);
+			return Shift(apic_id, die_shift_);
 		}
 
-		uint8_t PackageCoreId(uint8_t apic_id) const
+		uint32_t PackageId(uint32_t apic_id) const
 		{
-			return (apic_id & (pkg_id_mask_.mask | core_id_mask_.mask)) >> smt_id_mask_.width;
+			return Shift(apic_id, pkg_shift_);
 		}
 
-		uint8_t LogProcsPerPkg() const
+	private:
+		static uint32_t Shift(uint32_t apic_id, uint32_t shift)
 		{
-			return log_procs_per_pkg_;
+			return (shift >= 32) ? 0 : (apic_id >> shift);
 		}
 
-		uint8_t CoresPerPkg() const
+	private:
+		uint32_t smt_shift_;
+		uint32_t die_shift_;
+		uint32_t pkg_shift_;
+	};
+
+	unsigned int const PER_CPU_PROBE_TIMEOUT_MS = 1000;
+
+	// Upper bound of the subleaves walked in a dump
+	uint32_t const MAX_SUB_FNS = 64;
+
+	char const GenuineIntel[] = "GenuineIntel";
+	char const AuthenticAMD[] = "AuthenticAMD";
+#endif
+
+	// One logical CPU, located in the package/die/core tree.
+	struct TopologyEntry
+	{
+		uint32_t pkg_id;
+		uint32_t die_id;
+		uint32_t core_id;
+		uint32_t thread_id;
+		uint32_t apic_id;
+		int os_index;
+
+		bool operator<(TopologyEntry const & rhs) const
 		{
-			return cores_per_pkg_;
+			if (pkg_id != rhs.pkg_id)
+			{
+				return pkg_id < rhs.pkg_id;
+			}
+			if (die_id != rhs.die_id)
+			{
+				return die_id < rhs.die_id;
+			}
+			if (core_id != rhs.core_id)
+			{
+				return core_id < rhs.core_id;
+			}
+			if (thread_id != rhs.thread_id)
+			{
+				return thread_id < rhs.thread_id;
+			}
+			return os_index < rhs.os_index;
 		}
+	};
+
+	// Sorts the entries and builds the tree and the per-CPU table from them. Returns the number of cores.
+	int BuildTopologyTree(std::vector<TopologyEntry>& entries, std::vector<CPUT::CPUInfo::PackageInfo>& packages,
+		std::vector<CPUT::CPUInfo::LogicalProcessorInfo>& logical_processors)
+	{
+		std::sort(entries.begin(), entries.end());
 
-		void SetPackageTopology(uint8_t log_procs_per_pkg, uint8_t cores_per_pkg)
+		packages.clear();
+		logical_processors.clear();
+		int num_cores = 0;
+		for (size_t i = 0; i < entries.size(); ++ i)
 		{
-			log_procs_per_pkg_	= log_procs_per_pkg;
-			cores_per_pkg_		= cores_per_pkg;
+			TopologyEntry const & entry = entries[i];
+
+			if (packages.empty() || (packages.back().id != entry.pkg_id))
+			{
+				packages.push_back(CPUT::CPUInfo::PackageInfo());
+				packages.back().id = entry.pkg_id;
+			}
+			CPUT::CPUInfo::PackageInfo& pkg = packages.back();
+			if (pkg.dies.empty() || (pkg.dies.back().id != entry.die_id))
+			{
+				pkg.dies.push_back(CPUT::CPUInfo::DieInfo());
+				pkg.dies.back().id = entry.die_id;
+			}
+			CPUT::CPUInfo::DieInfo& die = pkg.dies.back();
+			if (die.cores.empty() || (die.cores.back().id != entry.core_id))
+			{
+				die.cores.push_back(CPUT::CPUInfo::CoreInfo());
+				die.cores.back().id = entry.core_id;
+				++ num_cores;
+			}
+			CPUT::CPUInfo::CoreInfo& core = die.cores.back();
+
+			CPUT::CPUInfo::LogicalProcessorInfo lp;
+			lp.os_index = entry.os_index;
+			lp.apic_id = entry.apic_id;
+			lp.package = static_cast<int>(packages.size() - 1);
+			lp.die = static_cast<int>(pkg.dies.size() - 1);
+			lp.core = static_cast<int>(die.cores.size() - 1);
+			lp.thread = core.cpus.Count();
+			lp.node = -1;
+			lp.core_type = CPUT::CPUInfo::HCT_Unknown;
+			logical_processors.push_back(lp);
+
+			pkg.cpus.Set(entry.os_index);
+			die.cpus.Set(entry.os_index);
+			core.cpus.Set(entry.os_index);
+		}
+
+		std::sort(logical_processors.begin(), logical_processors.end(),
+			[](CPUT::CPUInfo::LogicalProcessorInfo const & lhs, CPUT::CPUInfo::LogicalProcessorInfo const & rhs)
+			{
+				return lhs.os_index < rhs.os_index;
+			});
+
+		return std::max(num_cores, 1);
+	}
+
+#if defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+	using CPUT::ReadFirstLine;
 
-			smt_id_mask_.width	= this->GetMaskWidth(log_procs_per_pkg_ / cores_per_pkg_);
-			core_id_mask_.width	= this->GetMaskWidth(cores_per_pkg_);
-			pkg_id_mask_.width	= 8 - (smt_id_mask_.width + core_id_mask_.width);
+	char const SYSFS_CPU_DIR[] = "/sys/devices/system/cpu";
 
-			pkg_id_mask_.mask	= static_cast<uint8_t>(0xFF << (smt_id_mask_.width + core_id_mask_.width));
-			core_id_mask_.mask	= static_cast<uint8_t>((0xFF << smt_id_mask_.width) ^ pkg_id_mask_.mask);
-			smt_id_mask_.mask	= static_cast<uint8_t>(~(0xFF << smt_id_mask_.width));
+	// Collects the CPUs the kernel has configured (the cpuN directories) and the online ones in one
+	// walk of /sys/devices/system/cpu. Returns false if sysfs isn't there.
+	bool EnumerateSysfsCPUs(CPUT::CPUSet& configured, CPUT::CPUSet& online)
+	{
+		configured.Clear();
+		online.Clear();
+
+		DIR* dir = opendir(SYSFS_CPU_DIR);
+		if (nullptr == dir)
+		{
+			return false;
 		}
 
-	private:
-		static uint8_t GetMaskWidth(uint8_t max_ids)
+		bool has_online = false;
+		while (dirent const * entry = readdir(dir))
 		{
-			-- max_ids;
+			char const * name = entry->d_name;
+			if ((0 == strncmp(name, "cpu", 3)) && (name[3] >= '0') && (name[3] <= '9'))
+			{
+				char* end;
+				long const cpu = strtol(name + 3, &end, 10);
+				if ('\0' == *end)
+				{
+					configured.Set(static_cast<int>(cpu));
+				}
+			}
+			else if (0 == strcmp(name, "online"))
+			{
+				char buf[4096];
+				has_online = ReadFirstLine((std::string(SYSFS_CPU_DIR) + "/online").c_str(), buf, sizeof(buf))
+					&& online.FromString(buf);
+			}
+		}
+		closedir(dir);
+
+		// Kernels without CPU hotplug don't have the online file. Everything configured is online there.
+		if (!has_online)
+		{
+			online = configured;
+		}
+		online &= configured;
+		return !configured.Empty();
+	}
+
+	// The CPUs a probe thread can be pinned to: the online ones inside the process affinity. Numbering may
+	// have holes once CPUs are taken offline, so counting up to the number of CPUs isn't enough.
+	CPUT::CPUSet ProbeableCPUs(int num_hw_threads)
+	{
+		CPUT::CPUSet configured;
+		CPUT::CPUSet online;
+		CPUT::CPUSet cpus = CPUT::ProcessAffinity();
+		if (EnumerateSysfsCPUs(configured, online))
+		{
+			cpus = cpus.Empty() ? online : (cpus & online);
+		}
+		for (int i = 0; cpus.Empty() && (i < num_hw_threads); ++ i)
+		{
+			cpus.Set(i);
+		}
+		return cpus;
+	}
+
+	char const SYSFS_NODE_DIR[] = "/sys/devices/system/node";
+
+	// Reads the small files under /sys/devices/system/cpu/cpuN/ and /sys/devices/system/node/nodeN/. Every
+	// read goes through the same path and content buffers and plain open/read, so a walk doesn't allocate.
+	class SysfsReader
+	{
+	public:
+		SysfsReader()
+			: prefix_len_(0)
+		{
+			path_[0] = '\0';
+			buf_[0] = '\0';
+		}
+
+		void SelectCPU(int cpu)
+		{
+			this->Select(SYSFS_CPU_DIR, "cpu", cpu);
+		}
+		void SelectNode(int node)
+		{
+			this->Select(SYSFS_NODE_DIR, "node", node);
+		}
+
+		// The first line of the file, nullptr if it doesn't exist.
+		char const * Read(char const * name)
+		{
+			char* str = this->ReadAll(name);
+			if (str != nullptr)
+			{
+				str[strcspn(str, "\r\n")] = '\0';
+			}
+			return str;
+		}
+
+		// The whole file, up to the size of the buffer.
+		char* ReadAll(char const * name)
+		{
+			size_t const name_len = strlen(name);
+			if ((0 == prefix_len_) || (prefix_len_ + name_len >= sizeof(path_)))
+			{
+				return nullptr;
+			}
+			memcpy(path_ + prefix_len_, name, name_len + 1);
+
+			int const fd = open(path_, O_RDONLY | O_CLOEXEC);
+			if (fd < 0)
+			{
+				return nullptr;
+			}
+			ssize_t size;
+			do
+			{
+				size = read(fd, buf_, sizeof(buf_) - 1);
+			} while ((size < 0) && (EINTR == errno));
+			close(fd);
+			if (size < 0)
+			{
+				return nullptr;
+			}
+			buf_[size] = '\0';
+			return buf_;
+		}
 
-			// find index of msb
-			uint8_t msb_idx = 8;
-			uint8_t msb_mask = 0x80;
-			while (msb_mask && !(msb_mask & max_ids))
+		bool ReadInt(char const * name, int& value)
+		{
+			char const * str = this->Read(name);
+			if (nullptr == str)
+			{
+				return false;
+			}
+			char* end;
+			long const v = strtol(str, &end, 10);
+			if (end == str)
 			{
-				-- msb_idx;
-				msb_mask >>= 1;
+				return false;
 			}
-			return msb_idx;
+			value = static_cast<int>(v);
+			return true;
+		}
+
+		bool ReadCPUSet(char const * name, CPUT::CPUSet& cpus)
+		{
+			char const * str = this->Read(name);
+			return (str != nullptr) && cpus.FromString(str);
 		}
 
 	private:
-		struct id_mask_t
+		void Select(char const * dir, char const * kind, int index)
 		{
-			uint8_t width;
-			uint8_t mask;
-		};
+			int const len = snprintf(path_, sizeof(path_), "%s/%s%d/", dir, kind, index);
+			prefix_len_ = ((len > 0) && (static_cast<size_t>(len) < sizeof(path_))) ? len : 0;
+		}
 
-		uint8_t		log_procs_per_pkg_;
-		uint8_t		cores_per_pkg_;
-		id_mask_t	smt_id_mask_;
-		id_mask_t	core_id_mask_;
-		id_mask_t	pkg_id_mask_;
+	private:
+		char path_[128];
+		size_t prefix_len_;
+		char buf_[8192];
 	};
 
-	class Cpuid
+	// The sysfs topology as the probe cache stores it, in 32-bit words.
+	void WriteCPUSet(std::vector<unsigned int>& words, CPUT::CPUSet const & cpus)
 	{
-	public:
-		Cpuid()
-			: eax_(0), ebx_(0), ecx_(0), edx_(0)
+		words.push_back(static_cast<unsigned int>(cpus.Count()));
+		for (int cpu = cpus.First(); cpu >= 0; cpu = cpus.Next(cpu))
 		{
+			words.push_back(static_cast<unsigned int>(cpu));
 		}
+	}
 
-		uint32_t Eax() const
+	// Reads the words back, failing rather than reading past their end. The cache is checksummed, but
+	// a CPU number still has to be sane before a CPUSet grows to hold it.
+	class TopologyWordReader
+	{
+	public:
+		explicit TopologyWordReader(std::vector<unsigned int> const & words)
+			: words_(words), pos_(0)
 		{
-			return eax_;
 		}
-		uint32_t Ebx() const
+
+		bool Read(unsigned int& value)
 		{
-			return ebx_;
+			if (pos_ >= words_.size())
+			{
+				return false;
+			}
+			value = words_[pos_];
+			++ pos_;
+			return true;
 		}
-		uint32_t Ecx() const
+
+		bool ReadCPU(int& cpu)
 		{
-			return ecx_;
+			unsigned int value;
+			if (!this->Read(value) || (value >= MAX_CACHED_CPUS))
+			{
+				return false;
+			}
+			cpu = static_cast<int>(value);
+			return true;
 		}
-		uint32_t Edx() const
+
+		bool ReadCPUSet(CPUT::CPUSet& cpus)
 		{
-			return edx_;
+			unsigned int count;
+			if (!this->Read(count))
+			{
+				return false;
+			}
+			cpus.Clear();
+			for (unsigned int i = 0; i < count; ++ i)
+			{
+				int cpu;
+				if (!this->ReadCPU(cpu))
+				{
+					return false;
+				}
+				cpus.Set(cpu);
+			}
+			return true;
 		}
 
-		void Call(uint32_t fn)
+		bool AtEnd() const
 		{
-			eax_ = fn;
-			get_cpuid(&eax_, &ebx_, &ecx_, &edx_);
+			return pos_ == words_.size();
 		}
 
 	private:
-		uint32_t eax_;
-		uint32_t ebx_;
-		uint32_t ecx_;
-		uint32_t edx_;
+		TopologyWordReader& operator=(TopologyWordReader const & rhs);
+
+	private:
+		static unsigned int const MAX_CACHED_CPUS = 65536;
+
+		std::vector<unsigned int> const & words_;
+		size_t pos_;
 	};
+#endif
 
-	char const GenuineIntel[] = "GenuineIntel";
-	char const AuthenticAMD[] = "AuthenticAMD";
+	// Seconds on a clock that neither jumps nor gets slewed, for the TSC calibration.
+	double MonotonicSeconds()
+	{
+#if defined CPUT_PLATFORM_WINDOWS
+		LARGE_INTEGER counter;
+		LARGE_INTEGER freq;
+		::QueryPerformanceCounter(&counter);
+		::QueryPerformanceFrequency(&freq);
+		return static_cast<double>(counter.QuadPart) / freq.QuadPart;
+#else
+		timespec ts;
+#ifdef CLOCK_MONOTONIC_RAW
+		if (clock_gettime(CLOCK_MONOTONIC_RAW, &ts) != 0)
+#endif
+		{
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+		}
+		return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+	}
+
+	void SleepMilliseconds(unsigned int ms)
+	{
+#if defined CPUT_PLATFORM_WINDOWS
+		::Sleep(ms);
+#else
+		timespec req;
+		req.tv_sec = ms / 1000;
+		req.tv_nsec = (ms % 1000) * 1000000L;
+		while ((nanosleep(&req, &req) != 0) && (EINTR == errno))
+		{
+		}
 #endif
+	}
 }
 
 namespace CPUT
 {
 	CPUInfo::CPUInfo()
-		: feature_mask_(0)
+		: CPUInfo(nullptr)
+	{
+	}
+
+	CPUInfo::CPUInfo(char const * probe_cache_path)
+		: live_(0), calibration_window_(50),
+			tsc_frequency_(0), nominal_frequency_(0), max_frequency_(0), bus_frequency_(0), invariant_tsc_(false),
+			topology_probe_time_(0), replay_(false), from_probe_cache_(false), topology_from_sysfs_(false)
+	{
+#if (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)) && !defined(CPUT_PLATFORM_ANDROID)
+		from_probe_cache_ = (probe_cache_path != nullptr) && this->LoadProbeCache(probe_cache_path);
+		if (!from_probe_cache_)
+		{
+			dump_ = CPUIDDump::Capture();
+		}
+#else
+		(void)probe_cache_path;
+#endif
+
+		this->Decode();
+	}
+
+	CPUInfo::CPUInfo(CPUIDDump const & dump)
+		: live_(0), calibration_window_(50),
+			tsc_frequency_(0), nominal_frequency_(0), max_frequency_(0), bus_frequency_(0), invariant_tsc_(false),
+			topology_probe_time_(0), dump_(dump), replay_(true), from_probe_cache_(false), topology_from_sysfs_(false)
+	{
+		this->Decode();
+	}
+
+	void CPUInfo::Decode()
 	{
 		memset(vendor_, 0, sizeof(vendor_));
 		memset(brand_string_, 0, sizeof(brand_string_));
+		memset(&l1_code_cache_, 0, sizeof(l1_code_cache_));
+		memset(&l1_data_cache_, 0, sizeof(l1_data_cache_));
+		memset(&l2_cache_, 0, sizeof(l2_cache_));
+		memset(&l3_cache_, 0, sizeof(l3_cache_));
+		memset(&l0_data_tlb_, 0, sizeof(l0_data_tlb_));
+		memset(&l1_data_tlb_, 0, sizeof(l1_data_tlb_));
+		memset(&l2_data_tlb_, 0, sizeof(l2_data_tlb_));
+		memset(&code_tlb_, 0, sizeof(code_tlb_));
+		memset(&data_tlb_, 0, sizeof(data_tlb_));
+		tlbs_.clear();
+		cpu_name_ = "Unknown CPU";
+		tech_ = "Unknown";
+		transistors_ = "Unknown";
+		codename_ = "Unknown";
+		package_ = "Unknown";
+		type_ = 0;
+		family_ = 0;
+		model_ = 0;
+		stepping_ = 0;
+		memset(serial_number_, 0, sizeof(serial_number_));
 
 		num_hw_threads_ = 1;
 		num_cores_ = 1;
 
 #if (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)) && !defined(CPUT_PLATFORM_ANDROID)
-		this->DumpCPUIDs();
-
 		*reinterpret_cast<uint32_t*>(&vendor_[0]) = this->CPUIDResult(0, 1);
 		*reinterpret_cast<uint32_t*>(&vendor_[4]) = this->CPUIDResult(0, 3);
 		*reinterpret_cast<uint32_t*>(&vendor_[8]) = this->CPUIDResult(0, 2);
@@ -440,53 +990,48 @@ namespace CPUT
 			}
 			stepping_ = id & 0x0000000F;
 
-			if (this->CPUIDResult(1, 0) & 0x00040000)
+			if ((this->MaxStdFn() >= 3) && (this->CPUIDResult(1, 3) & CFM_PSN))
 			{
-				sprintf(serial_number_, "%d%d%d", id, this->CPUIDResult(3, 3), this->CPUIDResult(3, 2));
+				// 96 bits: the signature, then EDX:ECX of leaf 3
+				snprintf(serial_number_, sizeof(serial_number_), "%08X%08X%08X", id, this->CPUIDResult(3, 3), this->CPUIDResult(3, 2));
 			}
+		}
 
-			feature_mask_ |= this->CPUIDResult(1, 3) & CFM_CMPXCHG8B ? CF_CMPXCHG8B : 0;
-			feature_mask_ |= this->CPUIDResult(1, 3) & CFM_SYSENTER ? CF_SYSENTER : 0;
-			feature_mask_ |= this->CPUIDResult(1, 3) & CFM_CMOV ? CF_CMOV : 0;
-			feature_mask_ |= this->CPUIDResult(1, 3) & CFM_MMX ? CF_MMX : 0;
-			feature_mask_ |= this->CPUIDResult(1, 3) & CFM_SSE ? CF_SSE : 0;
-			feature_mask_ |= this->CPUIDResult(1, 3) & CFM_SSE2 ? CF_SSE2 : 0;
-			feature_mask_ |= this->CPUIDResult(1, 2) & CFM_SSE3 ? CF_SSE3 : 0;
-			feature_mask_ |= this->CPUIDResult(1, 3) & CFM_HTT ? CF_HTT : 0;
-			feature_mask_ |= this->CPUIDResult(1, 2) & CFM_SSSE3 ? CF_SSSE3 : 0;
-			feature_mask_ |= this->CPUIDResult(1, 2) & CFM_SSE41 ? CF_SSE41 : 0;
-			feature_mask_ |= this->CPUIDResult(1, 2) & CFM_SSE42 ? CF_SSE42 : 0;
-			feature_mask_ |= (this->CPUIDResult(1, 2) & CFM_OSXSAVE) && (this->CPUIDResult(1, 2) & CFM_FMA3 ? CF_FMA3 : 0);
-			feature_mask_ |= this->CPUIDResult(1, 2) & CFM_CMPXCHG16B ? CF_CMPXCHG16B : 0;
-			feature_mask_ |= this->CPUIDResult(1, 2) & CFM_MOVBE ? CF_MOVBE : 0;
-			feature_mask_ |= this->CPUIDResult(1, 2) & CFM_POPCNT ? CF_POPCNT : 0;
-			feature_mask_ |= this->CPUIDResult(1, 2) & CFM_AES ? CF_AES : 0;
-			feature_mask_ |= (this->CPUIDResult(1, 2) & CFM_OSXSAVE) && (this->CPUIDResult(1, 2) & CFM_AVX) ? CF_AVX : 0;
-			feature_mask_ |= (this->CPUIDResult(1, 2) & CFM_OSXSAVE) && (this->CPUIDResult(1, 2) & CFM_F16C ? CF_F16C : 0);
-			if (0 == strcmp(AuthenticAMD, vendor_))
-			{
-				feature_mask_ |= this->CPUIDResult(1, 3) & CFM_3DNow_AMD ? CF_3DNow : 0;
-				feature_mask_ |= this->CPUIDResult(1, 3) & CFM_3DNowExt_AMD ? CF_3DNowExt : 0;
-			}
+		this->DecodeFeatures();
 
-			if (this->MaxStdFn() >= 7)
-			{
-				feature_mask_ |= this->CPUIDResult(7, 1) & CFM_AVX2 ? CF_AVX2 : 0;
-			}
+		if (this->MaxStdFn() >= 0x16)
+		{
+			nominal_frequency_ = this->CPUIDResult(0x16, 0) & 0xFFFF;
+			max_frequency_ = this->CPUIDResult(0x16, 1) & 0xFFFF;
+			bus_frequency_ = this->CPUIDResult(0x16, 2) & 0xFFFF;
 		}
-
-		if (this->MaxExtFn() >= 0x80000001)
+		if (this->MaxStdFn() >= 0x15)
 		{
-			if (0 == strcmp(AuthenticAMD, vendor_))
+			uint32_t const denominator = this->CPUIDResult(0x15, 0);
+			uint32_t const numerator = this->CPUIDResult(0x15, 1);
+			if ((denominator != 0) && (numerator != 0))
 			{
-				feature_mask_ |= this->CPUIDResult(0x80000001, 2) & CFM_LZCNT_AMD ? CF_LZCNT : 0;
-				feature_mask_ |= this->CPUIDResult(0x80000001, 2) & CFM_SSE4A_AMD ? CF_SSE4A : 0;
-				feature_mask_ |= this->CPUIDResult(0x80000001, 2) & CFM_MisalignedSSE_AMD ? CF_MisalignedSSE : 0;
+				uint64_t crystal_hz = this->CPUIDResult(0x15, 2);
+				if (0 == crystal_hz)
+				{
+					crystal_hz = IntelCrystalClockHz(family_, model_);
+				}
+				if (crystal_hz != 0)
+				{
+					tsc_frequency_ = static_cast<unsigned int>(crystal_hz * numerator / denominator / 1000000);
+				}
+				else
+				{
+					// Without the crystal clock the TSC runs at the nominal frequency.
+					tsc_frequency_ = nominal_frequency_;
+				}
 			}
-			feature_mask_ |= this->CPUIDResult(0x80000001, 3) & CFM_X64 ? CF_X64 : 0;
-			feature_mask_ |= (this->CPUIDResult(0x80000001, 2) & CFM_OSXSAVE) && (this->CPUIDResult(0x80000001, 2) & CFM_FMA4_AMD ? CF_FMA4 : 0);
 		}
-
+		if (this->MaxExtFn() >= 0x80000007)
+		{
+			invariant_tsc_ = (this->CPUIDResult(0x80000007, 3) & CFM_InvariantTSC) ? true : false;
+		}
+
 		if (this->MaxExtFn() >= 0x80000004)
 		{
 			*reinterpret_cast<uint32_t*>(&brand_string_[0]) = this->CPUIDResult(0x80000002, 0);
@@ -505,147 +1050,132 @@ namespace CPUT
 			*reinterpret_cast<uint32_t*>(&brand_string_[44]) = this->CPUIDResult(0x80000004, 3);
 		}
 
-		for (uint32_t i = 0; i < 4; ++ i)
+		if (this->MaxStdFn() >= 2)
 		{
-			uint32_t d = this->CPUIDResult(2, i);
-			uint32_t start = (0 == i) ? 8 : 0;
-			for (uint32_t offset = start; offset < 32; offset += 8)
+			for (uint32_t i = 0; i < 4; ++ i)
 			{
-				uint32_t code = (d >> offset) & 0xFF;
-				if (0xFF == code)
+				uint32_t d = this->CPUIDResult(2, i);
+				if (d & 0x80000000)
 				{
-					uint32_t eax, ebx, ecx, edx;
-					for (int l = 0; l < 8; ++ l)
-					{
-						eax = 4;
-						ecx = l;
-						get_cpuid(&eax, &ebx, &ecx, &edx);
-
-						uint32_t cache_level = (eax >> 5) & 0x7;
-						uint32_t cache_type = eax & 0x1F;
-						uint32_t way = ((ebx >> 22) & 0x03FF) + 1;
-						uint32_t partition = ((ebx >> 12) & 0x03FF) + 1;
-						uint32_t line = (ebx & 0x0FFF) + 1;
-						uint32_t sets = ecx + 1;
-						uint32_t size = (way * partition * line * sets) / 1024;
-
-						switch (cache_level)
-						{
-						case 1:
-							switch (cache_type)
-							{
-							case 1:
-								l1_data_cache_.size = size;
-								l1_data_cache_.way = way;
-								l1_data_cache_.line = line;
-								break;
-
-							case 2:
-								l1_code_cache_.size = size;
-								l1_code_cache_.way = way;
-								l1_code_cache_.line = line;
-								break;
-
-							default:
-								break;
-							}
-							break;
-
-						case 2:
-							l2_cache_.size = size;
-							l2_cache_.way = way;
-							l2_cache_.line = line;
-							break;
-
-						case 3:
-							l3_cache_.size = size;
-							l3_cache_.way = way;
-							l3_cache_.line = line;
-							break;
-
-						default:
-							break;
-						}
-					}
+					// The register has no valid descriptors
+					continue;
 				}
-				else
+
+				uint32_t start = (0 == i) ? 8 : 0;
+				for (uint32_t offset = start; offset < 32; offset += 8)
 				{
-					std::string type;
-					std::string page;
-					int size;
-					int way;
-					std::string entry;
-					int line;
-					CacheIdentify(code, family_, type, page, size, way, entry, line);
-					
-					if ("L0 data TLB" == type)
-					{
-						l0_data_tlb_.page = page;
-						l0_data_tlb_.way = way;
-						l0_data_tlb_.entry = entry;
-					}
-					else if ("L1 data TLB" == type)
-					{
-						l1_data_tlb_.page = page;
-						l1_data_tlb_.way = way;
-						l1_data_tlb_.entry = entry;
-					}
-					else if ("L2 data TLB" == type)
-					{
-						l2_data_tlb_.page = page;
-						l2_data_tlb_.way = way;
-						l2_data_tlb_.entry = entry;
-					}
-					else if ("Code TLB" == type)
+					uint32_t code = (d >> offset) & 0xFF;
+					if (0xFF == code)
 					{
-						code_tlb_.page = page;
-						code_tlb_.way = way;
-						code_tlb_.entry = entry;
+						// No descriptors, the caches are only reported by leaf 4. DecodeDeterministicCaches() handles it.
+						continue;
 					}
-					else if ("Data TLB" == type)
+
+					CacheDesc const * desc = CacheIdentify(code, family_);
+					if (!desc)
 					{
-						data_tlb_.page = page;
-						data_tlb_.way = way;
-						data_tlb_.entry = entry;
+						continue;
 					}
-					else if ("L1 code cache" == type)
+
+					TLBInfo* tlb = nullptr;
+					CacheInfo* cache = nullptr;
+					TLBLevelInfo tlb_level = { -1, TT_Data, desc->page_sizes, desc->way, desc->entries, 0 };
+					switch (desc->kind)
 					{
-						l1_code_cache_.size = size;
-						l1_code_cache_.way = way;
-						l1_code_cache_.line = line;
+					case CDK_L0DataTLB:
+						tlb = &l0_data_tlb_;
+						tlb_level.level = 0;
+						break;
+
+					case CDK_L1DataTLB:
+						tlb = &l1_data_tlb_;
+						tlb_level.level = 1;
+						break;
+
+					case CDK_L2DataTLB:
+						tlb = &l2_data_tlb_;
+						tlb_level.level = 2;
+						break;
+
+					case CDK_CodeTLB:
+						tlb = &code_tlb_;
+						tlb_level.level = 1;
+						tlb_level.type = TT_Code;
+						break;
+
+					case CDK_DataTLB:
+						tlb = &data_tlb_;
+						tlb_level.level = 1;
+						break;
+
+					case CDK_L2TLB:
+						tlb_level.level = 2;
+						tlb_level.type = TT_Unified;
+						break;
+
+					case CDK_L1CodeCache:
+						cache = &l1_code_cache_;
+						break;
+
+					case CDK_L1DataCache:
+						cache = &l1_data_cache_;
+						break;
+
+					case CDK_L2Cache:
+						cache = &l2_cache_;
+						break;
+
+					case CDK_L3Cache:
+						cache = &l3_cache_;
+						break;
+
+					default:
+						break;
 					}
-					else if ("L1 data cache" == type)
+
+					if (tlb)
 					{
-						l1_data_cache_.size = size;
-						l1_data_cache_.way = way;
-						l1_data_cache_.line = line;
+						tlb->page_sizes = desc->page_sizes;
+						tlb->way = desc->way;
+						tlb->entries = desc->entries;
 					}
-					else if ("L2 cache" == type)
+					if (tlb_level.level >= 0)
 					{
-						l2_cache_.size = size;
-						l2_cache_.way = way;
-						l2_cache_.line = line;
+						tlbs_.push_back(tlb_level);
 					}
-					else if ("L3 cache" == type)
+					if (cache)
 					{
-						l3_cache_.size = size;
-						l3_cache_.way = way;
-						l3_cache_.line = line;
+						cache->size = desc->size;
+						cache->way = desc->way;
+						cache->line = desc->line;
 					}
 				}
 			}
 		}
 
-		tech_ = "Unknown";
-		transistors_ = "Unknown";
-		codename_ = "Unknown";
-		package_ = "Unknown";
-		CPUIdentify(vendor_, family_, model_, stepping_, cpu_name_, tech_, transistors_, codename_, package_);
+		this->DecodeDeterministicCaches();
+		this->DecodeTLBs();
 
-		this->UpdateFrequency();
+		uint32_t const vendor_id[] = { this->CPUIDResult(0, 1), this->CPUIDResult(0, 3), this->CPUIDResult(0, 2) };
+		CPUModelDesc const & model_desc = CPUIdentify(vendor_id, family_, model_, stepping_);
+		cpu_name_ = CPU_STRINGS + model_desc.name;
+		tech_ = CPU_STRINGS + model_desc.tech;
+		transistors_ = CPU_STRINGS + model_desc.transistors;
+		codename_ = CPU_STRINGS + model_desc.codename;
+		package_ = CPU_STRINGS + model_desc.package;
 
-#if defined CPUT_PLATFORM_WINDOWS
+		if (replay_)
 		{
+			int num_valid = 0;
+			for (size_t i = 0; i < dump_.PerCPU().size(); ++ i)
+			{
+				num_valid += dump_.PerCPU()[i].valid ? 1 : 0;
+			}
+			num_hw_threads_ = std::max(num_valid, 1);
+		}
+		else
+		{
+#if defined CPUT_PLATFORM_WINDOWS
 			SYSTEM_INFO si;
 #if defined CPUT_PLATFORM_WINDOWS_DESKTOP
 			::GetSystemInfo(&si);
@@ -653,357 +1183,1464 @@ namespace CPUT
 			::GetNativeSystemInfo(&si);
 #endif
 			num_hw_threads_ = si.dwNumberOfProcessors;
-		}
 #elif defined CPUT_PLATFORM_LINUX
-		// Linux doesn't easily allow us to look at the Affinity Bitmask directly,
-		// but it does provide an API to test affinity maskbits of the current process
-		// against each logical processor visible under OS.
-		num_hw_threads_ = sysconf(_SC_NPROCESSORS_CONF);	// This will tell us how many CPUs are currently enabled.
+			CPUSet configured;
+			CPUSet online;
+			if (EnumerateSysfsCPUs(configured, online))
+			{
+				num_hw_threads_ = online.Count();
+			}
+			else
+			{
+				num_hw_threads_ = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+			}
+			num_hw_threads_ = std::max(num_hw_threads_, 1);
+#endif
+		}
 #endif
+	}
 
-#if defined CPUT_PLATFORM_WINDOWS
-#if defined CPUT_PLATFORM_WINDOWS_DESKTOP
-		GetLogicalProcessorInformationPtr glpi = nullptr;
-		{
-#if (_WIN32_WINNT >= 0x0603 /*_WIN32_WINNT_WINBLUE*/)
-			if (IsWindowsVistaOrGreater())
-#else
-			OSVERSIONINFO os_ver_info;
-			memset(&os_ver_info, 0, sizeof(os_ver_info));
-			os_ver_info.dwOSVersionInfoSize = sizeof(os_ver_info);
-			::GetVersionEx(&os_ver_info);
+	CPUInfo const & CPUInfo::Instance()
+	{
+		// Leaked on purpose, see the header.
+		static std::once_flag once;
+		static CPUInfo* instance = nullptr;
+		std::call_once(once, []
+			{
+				instance = new CPUInfo(getenv("CPUT_PROBE_CACHE"));
+			});
+		return *instance;
+	}
 
-			// There is a bug with the implementation of GetLogicalProcessorInformation
-			// on Windows Server 2003 and XP64. Therefore, only
-			// GetLogicalProcessorInformation on Windows Vista and up are supported for now.
-			if (os_ver_info.dwMajorVersion >= 6)
-#endif
+	CPUIDDump const & CPUInfo::Dump() const
+	{
+		std::call_once(topology_once_, &CPUInfo::DetectTopology, this);
+		std::call_once(frequency_once_, &CPUInfo::InitFrequency, this);
+#if (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)) && defined(CPUT_PLATFORM_LINUX)
+		// The sysfs topology doesn't need the per-CPU leaves, but a replay of the dump does
+		std::call_once(per_cpu_once_, [this]
 			{
-				HMODULE hMod = ::GetModuleHandle(TEXT("kernel32"));
-				if (hMod)
+				if (!replay_ && dump_.PerCPU().empty())
 				{
-					glpi = (GetLogicalProcessorInformationPtr)::GetProcAddress(hMod,
-						"GetLogicalProcessorInformation");
+					dump_.CapturePerCPU(ProbeableCPUs(num_hw_threads_), PER_CPU_PROBE_TIMEOUT_MS);
 				}
-			}
-		}
+			});
+#endif
+		return dump_;
+	}
 
-		if (glpi != nullptr)
-		{
-			std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> slpi_;
+	int CPUInfo::NumCores() const
+	{
+		std::call_once(topology_once_, &CPUInfo::DetectTopology, this);
+		return num_cores_;
+	}
 
-			uint32_t cbBuffer = 0;
-			glpi(nullptr, &cbBuffer);
+	unsigned int CPUInfo::TopologyProbeTime() const
+	{
+		std::call_once(topology_once_, &CPUInfo::DetectTopology, this);
+		return topology_probe_time_;
+	}
 
-			slpi_.resize(cbBuffer / sizeof(slpi_[0]));
-			glpi(&slpi_[0], &cbBuffer);
+	unsigned int CPUInfo::Frequency() const
+	{
+		return this->Live().frequency;
+	}
 
-			num_cores_ = 0;
-			for (size_t i = 0; i < slpi_.size(); ++ i)
-			{
-				if (::RelationProcessorCore == slpi_[i].Relationship)
-				{
-					++ num_cores_;
-				}
-			}
+	CPUInfo::LiveInfo CPUInfo::Live() const
+	{
+		std::call_once(frequency_once_, &CPUInfo::InitFrequency, this);
+
+		uint64 const live = live_.load(std::memory_order_acquire);
+		LiveInfo ret;
+		ret.frequency = static_cast<unsigned int>(live & 0xFFFFFFFF);
+		ret.generation = static_cast<unsigned int>(live >> 32);
+		return ret;
+	}
+
+	void CPUInfo::InitFrequency() const
+	{
+		// Prefer what CPUID reports, it is exact and costs nothing. Only sample the TSC when the leaves are absent.
+		if (tsc_frequency_ != 0)
+		{
+			this->PublishFrequency(tsc_frequency_);
+		}
+		else if (nominal_frequency_ != 0)
+		{
+			this->PublishFrequency(nominal_frequency_);
+		}
+		else if ((dump_.Frequency() != 0) || replay_)
+		{
+			// Calibrated earlier, by a probe cache or on the machine a dump was recorded on.
+			this->PublishFrequency(dump_.Frequency());
 		}
 		else
 		{
-			// Indicates if a CpuidImpl object is supported on this platform.
-			// Support is only granted on Intel and AMD platforms where the current
-			// calling process has security rights to query process affinity and
-			// change it if the process and system affinity differ.  CpuidImpl is
-			// also not supported if thread affinity cannot be set on systems with
-			// more than 1 logical processor.
+			unsigned int const frequency = this->MeasureFrequency();
+			dump_.Frequency(frequency);
+			this->PublishFrequency(frequency);
+		}
+	}
 
-			bool supported = (0 == strcmp(GenuineIntel, vendor_)) || (0 == strcmp(AuthenticAMD, vendor_));
+	void CPUInfo::PublishFrequency(unsigned int frequency) const
+	{
+		uint64 old_live = live_.load(std::memory_order_relaxed);
+		uint64 new_live;
+		do
+		{
+			new_live = (((old_live >> 32) + 1) << 32) | frequency;
+		} while (!live_.compare_exchange_weak(old_live, new_live, std::memory_order_release, std::memory_order_relaxed));
+	}
 
-			if (supported)
-			{
-				DWORD_PTR process_affinity, system_affinity;
-				HANDLE process_handle = ::GetCurrentProcess();
+	void CPUInfo::DetectCoreTypes() const
+	{
+		core_types_.clear();
 
-				// Query process affinity mask
-				supported = (::GetProcessAffinityMask(process_handle, &process_affinity, &system_affinity) != 0);
-				if (supported)
+		// Leaf 0x1A EAX of every CPU, the core type in the top byte
+		std::vector<std::pair<int, uint32_t> > hybrid_infos;
+#if (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)) && !defined(CPUT_PLATFORM_ANDROID)
+		if (this->IsHybrid())
+		{
+#if defined CPUT_PLATFORM_LINUX
+			// The probe cache has leaf 0x1A of every CPU
+			if (!replay_ && !from_probe_cache_)
+			{
+				// The hybrid PMUs list the CPUs of each type, with no need to pin to them
+				static struct
+				{
+					char const * name;
+					CoreType type;
+				} const pmus[] =
 				{
-					if (process_affinity != system_affinity)
+					{ "/sys/devices/cpu_core/cpus", HCT_Core },
+					{ "/sys/devices/cpu_atom/cpus", HCT_Atom }
+				};
+				for (size_t i = 0; i < sizeof(pmus) / sizeof(pmus[0]); ++ i)
+				{
+					char buf[4096];
+					CPUSet cpus;
+					if (ReadFirstLine(pmus[i].name, buf, sizeof(buf)) && cpus.FromString(buf))
 					{
-						// The process and system affinities differ.  Attempt to set
-						// the process affinity to the system affinity.
-						supported = (::SetProcessAffinityMask(process_handle, system_affinity) != 0);
-						if (supported)
+						for (int cpu = cpus.First(); cpu >= 0; cpu = cpus.Next(cpu))
 						{
-							// Restore previous process affinity
-							supported = (::SetProcessAffinityMask(process_handle, process_affinity) != 0);
+							hybrid_infos.push_back(std::make_pair(cpu, static_cast<uint32_t>(pmus[i].type) << 24));
 						}
 					}
+				}
 
-					if (supported && (system_affinity > 1))
-					{
-						// Attempt to set the thread affinity
-						HANDLE thread_handle = ::GetCurrentThread();
-						DWORD_PTR thread_affinity = ::SetThreadAffinityMask(thread_handle, process_affinity);
-						if (thread_affinity)
-						{
-							// Restore the previous thread affinity
-							supported = (::SetThreadAffinityMask(thread_handle, thread_affinity) != 0);
-						}
-						else
+				// The sysfs topology doesn't probe the CPUs, but the native models are only in their leaves
+				if (hybrid_infos.empty())
+				{
+					std::call_once(per_cpu_once_, [this]
 						{
-							supported = false;
-						}
-					}
+							if (dump_.PerCPU().empty())
+							{
+								dump_.CapturePerCPU(ProbeableCPUs(num_hw_threads_), PER_CPU_PROBE_TIMEOUT_MS);
+							}
+						});
 				}
 			}
-#else
-		{
-			bool supported = false;
-#endif
-#elif defined CPUT_PLATFORM_LINUX
-		{
-			bool supported = (0 == strcmp(GenuineIntel, vendor_)) || (0 == strcmp(AuthenticAMD, vendor_));
 #endif
 
-			if (supported)
+			std::vector<CPUIDDump::PerCPULeaves> const & per_cpu = dump_.PerCPU();
+			for (size_t i = 0; i < per_cpu.size(); ++ i)
 			{
-				uint8_t log_procs_per_pkg = 1;
-				uint8_t cores_per_pkg = 1;
-
-				// Determine if hyper-threading is enabled.
-				if (this->IsFeatureSupport(CF_HTT))
+				if (per_cpu[i].valid && (per_cpu[i].hybrid_info != 0))
 				{
-					// Determine the total number of logical processors per package.
-					log_procs_per_pkg = static_cast<uint8_t>((this->CPUIDResult(1, 1) & CFM_LogicalProcessorCount_Intel) >> 16);
-
-					// Determine the total number of cores per package.  This info
-					// is extracted differently dependending on the cpu vendor.
-					if (0 == strcmp(GenuineIntel, vendor_))
+					bool found = false;
+					for (size_t j = 0; j < hybrid_infos.size(); ++ j)
 					{
-						if (this->MaxStdFn() >= 4)
+						if (hybrid_infos[j].first == per_cpu[i].cpu)
 						{
-							cores_per_pkg = static_cast<uint8_t>(((this->CPUIDResult(4, 0) & CFM_NC_Intel) >> 26) + 1);
+							hybrid_infos[j].second = per_cpu[i].hybrid_info;
+							found = true;
+							break;
 						}
 					}
-					else
+					if (!found)
 					{
-						assert(strcmp(AuthenticAMD, vendor_));
-
-						if (this->MaxExtFn() >= 0x80000008)
-						{
-							// AMD reports the msb width of the CORE_ID bit field of the APIC ID
-							// in ApicIdCoreIdSize_Amd.  The maximum value represented by the msb
-							// width is the theoretical number of cores the processor can support
-							// and not the actual number of current cores, which is how the msb width
-							// of the CORE_ID bit field has been traditionally determined.  If the
-							// ApicIdCoreIdSize_Amd value is zero, then you use the traditional method
-							// to determine the CORE_ID msb width.
-							uint32_t msb_width = this->CPUIDResult(0x80000008, 2) & CFM_ApicIdCoreIdSize_AMD;
-							if (msb_width)
-							{
-								// Set cores_per_pkg to the maximum theortical number of cores
-								// the processor package can support (2 ^ width) so the APIC
-								// extractor object can be configured to extract the proper
-								// values from an APIC.
-								cores_per_pkg = static_cast<uint8_t>(1 << ((msb_width >> 12) - 1));
-							}
-							else
-							{
-								// Set cores_per_pkg to the actual number of cores being reported
-								// by the CPUID instruction.
-								cores_per_pkg = static_cast<uint8_t>((this->CPUIDResult(0x80000008, 2) & CFM_NC_AMD) + 1);
-							}
-						}
+						hybrid_infos.push_back(std::make_pair(per_cpu[i].cpu, per_cpu[i].hybrid_info));
 					}
 				}
+			}
+		}
+#endif
 
-				std::vector<uint8_t> apic_ids;
+		for (size_t i = 0; i < hybrid_infos.size(); ++ i)
+		{
+			CoreType const type = static_cast<CoreType>(hybrid_infos[i].second >> 24);
+			size_t t = 0;
+			while ((t < core_types_.size()) && (core_types_[t].type != type))
+			{
+				++ t;
+			}
+			if (t == core_types_.size())
+			{
+				CoreTypeInfo info;
+				info.type = type;
+				info.native_model = hybrid_infos[i].second & 0xFFFFFF;
+				info.max_frequency = max_frequency_;
+				core_types_.push_back(info);
+			}
+			core_types_[t].cpus.Set(hybrid_infos[i].first);
+		}
+		std::sort(core_types_.begin(), core_types_.end(),
+			[](CoreTypeInfo const & lhs, CoreTypeInfo const & rhs)
+			{
+				return lhs.type > rhs.type;
+			});
 
-				// Configure the APIC extractor object with the information it needs to
-				// be able to decode the APIC.
-				ApicExtractor apic_extractor;
-				apic_extractor.SetPackageTopology(log_procs_per_pkg, cores_per_pkg);
+		if (core_types_.empty())
+		{
+			CoreTypeInfo info;
+			info.type = HCT_Unknown;
+			info.native_model = 0;
+			info.max_frequency = max_frequency_;
+			for (size_t i = 0; i < logical_processors_.size(); ++ i)
+			{
+				info.cpus.Set(logical_processors_[i].os_index);
+			}
+			for (int i = 0; info.cpus.Empty() && (i < num_hw_threads_); ++ i)
+			{
+				info.cpus.Set(i);
+			}
+			core_types_.push_back(info);
+		}
 
-#if defined CPUT_PLATFORM_WINDOWS
-#if defined CPUT_PLATFORM_WINDOWS_DESKTOP
-				DWORD_PTR process_affinity, system_affinity;
-				HANDLE process_handle = ::GetCurrentProcess();
-				HANDLE thread_handle = ::GetCurrentThread();
-				::GetProcessAffinityMask(process_handle, &process_affinity, &system_affinity);
-				if (1 == system_affinity)
-				{
-					// Since we only have 1 logical processor present on the system, we
-					// can explicitly set a single APIC ID to zero.
-					assert(1 == log_procs_per_pkg);
-					apic_ids.push_back(0);
-				}
-				else
+		for (size_t t = 0; t < core_types_.size(); ++ t)
+		{
+			CoreTypeInfo& info = core_types_[t];
+			info.caches = caches_;
+
+#if (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)) && !defined(CPUT_PLATFORM_ANDROID)
+			if ((info.type != HCT_Unknown) && !replay_)
+			{
+				// Leaves 4 and 0x16 describe the core they run on, so read them on a CPU of this type
+#if defined CPUT_PLATFORM_LINUX
+				CPUSet const reachable = info.cpus & ProbeableCPUs(num_hw_threads_);
+#else
+				CPUSet const reachable = info.cpus & ProcessAffinity();
+#endif
+				int const cpu = reachable.First();
+				if (cpu >= 0)
 				{
-					// Set the process affinity to the system affinity if they are not
-					// equal so that all logical processors can be accounted for.
-					if (process_affinity != system_affinity)
+					CPUIDDump type_dump;
+					bool captured = false;
+					try
+					{
+						std::thread([cpu, &type_dump, &captured]
+							{
+								if (BindThread(CPUSet(cpu)))
+								{
+									type_dump = CPUIDDump::Capture();
+									captured = true;
+								}
+							}).join();
+					}
+					catch (std::system_error const &)
 					{
-						::SetProcessAffinityMask(process_handle, system_affinity);
 					}
 
-					// Call cpuid on each active logical processor in the system affinity.
-					DWORD_PTR prev_thread_affinity = 0;
-					for (DWORD_PTR thread_affinity = 1; thread_affinity && (thread_affinity <= system_affinity);
-						thread_affinity <<= 1)
+					if (captured)
 					{
-						if (system_affinity & thread_affinity)
+						CPUInfo const type_info(type_dump);
+						info.caches = type_info.caches_;
+						if (type_info.max_frequency_ != 0)
 						{
-							if (0 == prev_thread_affinity)
-							{
-								// Save the previous thread affinity so we can return
-								// the executing thread affinity back to this state.
-								assert(apic_ids.empty());
-								prev_thread_affinity = ::SetThreadAffinityMask(thread_handle, thread_affinity);
-							}
-							else
-							{
-								assert(!apic_ids.empty());
-								::SetThreadAffinityMask(thread_handle, thread_affinity);
-							}
-
-							// Allow the thread to switch to masked logical processor.
-							::Sleep(0);
-
-							// Store the APIC ID
-							apic_ids.push_back(static_cast<uint8_t>((this->CPUIDResult(1, 1) & CFM_ApicId_Intel) >> 24));
+							info.max_frequency = type_info.max_frequency_;
 						}
 					}
 
-					// Restore the previous process and thread affinity state.
-					::SetProcessAffinityMask(process_handle, process_affinity);
-					::SetThreadAffinityMask(thread_handle, prev_thread_affinity);
-					::Sleep(0);
-				}
+#if defined CPUT_PLATFORM_LINUX
+					// Leaf 0x16 may report the same maximum on every type, cpufreq knows better
+					SysfsReader reader;
+					reader.SelectCPU(cpu);
+					int max_khz;
+					if (reader.ReadInt("cpufreq/cpuinfo_max_freq", max_khz) && (max_khz > 0))
+					{
+						info.max_frequency = static_cast<unsigned int>(max_khz / 1000);
+					}
 #endif
-#elif defined CPUT_PLATFORM_LINUX
-				if (1 == num_hw_threads_)
-				{
-					// Since we only have 1 logical processor present on the system, we
-					// can explicitly set a single APIC ID to zero.
-					BOOST_ASSERT(1 == log_procs_per_pkg);
-					apic_ids.push_back(0);
 				}
-				else
-				{
-					cpu_set_t backup_cpu;
-					sched_getaffinity(0, sizeof(backup_cpu), &backup_cpu);
+			}
+#endif
 
-					cpu_set_t current_cpu;
-					// Call cpuid on each active logical processor in the system affinity.
-					for (int j = 0; j < num_hw_threads_; ++ j)
+			for (size_t c = 0; c < info.caches.size(); ++ c)
+			{
+				CacheLevelInfo& cache = info.caches[c];
+				cache.instances.clear();
+				for (size_t i = 0; i < caches_.size(); ++ i)
+				{
+					if ((caches_[i].level == cache.level) && (caches_[i].type == cache.type))
 					{
-						CPU_ZERO(&current_cpu);
-						CPU_SET(j, &current_cpu);
-						if (0 == sched_setaffinity(0, sizeof(current_cpu), &current_cpu))
+						for (size_t j = 0; j < caches_[i].instances.size(); ++ j)
 						{
-							// Allow the thread to switch to masked logical processor.
-							sleep(0);
-
-							// Store the APIC ID
-							apic_ids.push_back(static_cast<uint8_t>((this->CPUIDResult(1, 1) & CFM_ApicId_Intel) >> 24));
+							CPUSet const instance = caches_[i].instances[j] & info.cpus;
+							if (!instance.Empty())
+							{
+								cache.instances.push_back(instance);
+							}
 						}
+						break;
 					}
-
-					// Restore the previous process and thread affinity state.
-					sched_setaffinity(0, sizeof(backup_cpu), &backup_cpu);
-					sleep(0);
 				}
-#endif
+			}
+		}
 
-#if defined CPUT_PLATFORM_WINDOWS_METRO
-				num_cores_ = num_hw_threads_;
-#else
-				std::vector<uint8_t> pkg_core_ids(apic_ids.size());
-				for (size_t i = 0; i < apic_ids.size(); ++ i)
+		for (size_t i = 0; i < logical_processors_.size(); ++ i)
+		{
+			LogicalProcessorInfo& lp = logical_processors_[i];
+			lp.core_type = HCT_Unknown;
+			for (size_t t = 0; t < core_types_.size(); ++ t)
+			{
+				if (core_types_[t].cpus.Test(lp.os_index))
 				{
-					pkg_core_ids[i] = apic_extractor.PackageCoreId(apic_ids[i]);
+					lp.core_type = core_types_[t].type;
+					break;
 				}
-				std::sort(pkg_core_ids.begin(), pkg_core_ids.end());
-				pkg_core_ids.erase(std::unique(pkg_core_ids.begin(), pkg_core_ids.end()), pkg_core_ids.end());
-				num_cores_ = static_cast<int>(pkg_core_ids.size());
-#endif
 			}
 		}
-#endif
 	}
 
-	void CPUInfo::UpdateFrequency()
+	std::vector<CPUInfo::CacheLevelInfo> const & CPUInfo::Caches() const
 	{
-		LARGE_INTEGER start_time;
-		QueryPerformanceCounter(&start_time);
+		std::call_once(topology_once_, &CPUInfo::DetectTopology, this);
+		return caches_;
+	}
 
-		unsigned __int64 start_cycle = __rdtsc();
-		Sleep(750);
-		unsigned __int64 cycles = __rdtsc() - start_cycle;
+	uint64 CPUInfo::TLBReach(uint64 page_size, int level) const
+	{
+		uint64 reaches[8] = { 0 };
+		for (size_t i = 0; i < tlbs_.size(); ++ i)
+		{
+			TLBLevelInfo const & tlb = tlbs_[i];
+			if ((tlb.type != TT_Code) && (tlb.type != TT_StoreOnly) && (tlb.page_sizes & page_size)
+				&& (tlb.level >= 0) && (tlb.level < 8))
+			{
+				reaches[tlb.level] += page_size * tlb.entries;
+			}
+		}
 
-		LARGE_INTEGER end_time;
-		QueryPerformanceCounter(&end_time);
+		if (level >= 0)
+		{
+			return (level < 8) ? reaches[level] : 0;
+		}
+		else
+		{
+			return *std::max_element(reaches, reaches + 8);
+		}
+	}
 
-		LARGE_INTEGER freq;
-		QueryPerformanceFrequency(&freq);
+	std::vector<CPUInfo::PackageInfo> const & CPUInfo::Packages() const
+	{
+		std::call_once(topology_once_, &CPUInfo::DetectTopology, this);
+		return packages_;
+	}
 
-		double duration = static_cast<double>(end_time.QuadPart - start_time.QuadPart) / freq.QuadPart;
-		frequency_ = static_cast<int>(cycles / duration / 1000000);
+	std::vector<CPUInfo::LogicalProcessorInfo> const & CPUInfo::LogicalProcessors() const
+	{
+		std::call_once(topology_once_, &CPUInfo::DetectTopology, this);
+		return logical_processors_;
 	}
 
-	void CPUInfo::DumpCPUIDs()
+	bool CPUInfo::IsHybrid() const
 	{
-		Cpuid cpuid;
+#if (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)) && !defined(CPUT_PLATFORM_ANDROID)
+		return (this->MaxStdFn() >= 7) && (this->CPUIDResult(7, 0, 3) & CFM_Hybrid);
+#else
+		return false;
+#endif
+	}
 
-		cpuid.Call(0);
-		uint32_t max_std_fn = cpuid.Eax();
+	std::vector<CPUInfo::CoreTypeInfo> const & CPUInfo::CoreTypes() const
+	{
+		std::call_once(topology_once_, &CPUInfo::DetectTopology, this);
+		return core_types_;
+	}
 
-		cpuid_std_fn_results_.resize(max_std_fn * 4);
-		for (uint32_t i = 0; i < max_std_fn; ++ i)
+	CPUSet CPUInfo::CPUsOfType(CoreType type) const
+	{
+		std::vector<CoreTypeInfo> const & types = this->CoreTypes();
+		for (size_t i = 0; i < types.size(); ++ i)
 		{
-			cpuid.Call(i);
-			cpuid_std_fn_results_[i * 4 + 0] = cpuid.Eax();
-			cpuid_std_fn_results_[i * 4 + 1] = cpuid.Ebx();
-			cpuid_std_fn_results_[i * 4 + 2] = cpuid.Ecx();
-			cpuid_std_fn_results_[i * 4 + 3] = cpuid.Edx();
+			if (types[i].type == type)
+			{
+				return types[i].cpus;
+			}
 		}
+		return CPUSet();
+	}
 
-		cpuid.Call(0x80000000);
-		uint32_t max_ext_fn = cpuid.Eax();
-		if (max_ext_fn & 0x80000000)
+	std::vector<CPUInfo::NumaNodeInfo> const & CPUInfo::NumaNodes() const
+	{
+		std::call_once(topology_once_, &CPUInfo::DetectTopology, this);
+		return numa_nodes_;
+	}
+
+	CPUInfo::NumaNodeInfo const * CPUInfo::FindNumaNode(int os_index) const
+	{
+		std::vector<NumaNodeInfo> const & nodes = this->NumaNodes();
+		for (size_t i = 0; i < nodes.size(); ++ i)
 		{
-			max_ext_fn -= 0x80000000;
-			cpuid_ext_fn_results_.resize(max_ext_fn * 4);
-			for (uint32_t i = 0; i < max_ext_fn; ++ i)
+			if (nodes[i].cpus.Test(os_index))
 			{
-				cpuid.Call(i + 0x80000000);
-				cpuid_ext_fn_results_[i * 4 + 0] = cpuid.Eax();
-				cpuid_ext_fn_results_[i * 4 + 1] = cpuid.Ebx();
-				cpuid_ext_fn_results_[i * 4 + 2] = cpuid.Ecx();
-				cpuid_ext_fn_results_[i * 4 + 3] = cpuid.Edx();
+				return &nodes[i];
 			}
 		}
+		return nullptr;
 	}
 
-	unsigned int CPUInfo::CPUIDResult(unsigned int fn, unsigned int index) const
+	CPUInfo::LogicalProcessorInfo const * CPUInfo::FindLogicalProcessor(int os_index) const
 	{
-		if (fn < 0x80000000)
+		std::vector<LogicalProcessorInfo> const & lps = this->LogicalProcessors();
+		for (size_t i = 0; i < lps.size(); ++ i)
 		{
-			return cpuid_std_fn_results_[fn * 4 + index];
+			if (lps[i].os_index == os_index)
+			{
+				return &lps[i];
+			}
 		}
-		else
+		return nullptr;
+	}
+
+	char const * CPUInfo::FeatureName(CPUFeature feature)
+	{
+		return ((feature >= 0) && (feature < CF_NumFeatures)) ? FEATURE_BITS[feature].name : "";
+	}
+
+	// Everything below needs either per-CPU probe threads or OS queries that are much more expensive
+	// than the CPUID decoding in the constructor, so it only runs the first time the topology is asked for.
+	void CPUInfo::DetectTopology() const
+	{
+#if defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+		// A replay describes another machine, whose sysfs isn't here. A probe cache has what sysfs said.
+		bool const from_sysfs = !replay_ && (this->RestoreSysfsTopology() || this->DetectSysfsTopology());
+#else
+		bool const from_sysfs = false;
+#endif
+
+#if (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)) && !defined(CPUT_PLATFORM_ANDROID) && !defined(CPUT_PLATFORM_WINDOWS_METRO)
+		if (!from_sysfs && ((0 == strcmp(GenuineIntel, vendor_)) || (0 == strcmp(AuthenticAMD, vendor_))))
 		{
-			return cpuid_ext_fn_results_[(fn - 0x80000000) * 4 + index];
+			this->DetectApicTopology();
 		}
+#else
+		(void)from_sysfs;
+#endif
+
+#if defined CPUT_PLATFORM_WINDOWS_METRO
+		num_cores_ = num_hw_threads_;
+#elif defined CPUT_PLATFORM_WINDOWS_DESKTOP
+		GetLogicalProcessorInformationPtr glpi = nullptr;
+		if (!replay_)
+		{
+#if (_WIN32_WINNT >= 0x0603 /*_WIN32_WINNT_WINBLUE*/)
+			if (IsWindowsVistaOrGreater())
+#else
+			OSVERSIONINFO os_ver_info;
+			memset(&os_ver_info, 0, sizeof(os_ver_info));
+			os_ver_info.dwOSVersionInfoSize = sizeof(os_ver_info);
+			::GetVersionEx(&os_ver_info);
+
+			// There is a bug with the implementation of GetLogicalProcessorInformation
+			// on Windows Server 2003 and XP64. Therefore, only
+			// GetLogicalProcessorInformation on Windows Vista and up are supported for now.
+			if (os_ver_info.dwMajorVersion >= 6)
+#endif
+			{
+				HMODULE hMod = ::GetModuleHandle(TEXT("kernel32"));
+				if (hMod)
+				{
+					glpi = (GetLogicalProcessorInformationPtr)::GetProcAddress(hMod,
+						"GetLogicalProcessorInformation");
+				}
+			}
+		}
+
+		if (glpi != nullptr)
+		{
+			std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> slpi_;
+
+			uint32_t cbBuffer = 0;
+			glpi(nullptr, &cbBuffer);
+
+			slpi_.resize(cbBuffer / sizeof(slpi_[0]));
+			glpi(&slpi_[0], &cbBuffer);
+
+			// The OS also counts cores outside the process affinity, which the APIC walk can't reach.
+			num_cores_ = 0;
+			numa_nodes_.clear();
+			for (size_t i = 0; i < slpi_.size(); ++ i)
+			{
+				if (::RelationProcessorCore == slpi_[i].Relationship)
+				{
+					++ num_cores_;
+				}
+				else if (::RelationNumaNode == slpi_[i].Relationship)
+				{
+					NumaNodeInfo node;
+					node.id = static_cast<int>(slpi_[i].NumaNode.NodeNumber);
+					node.total_memory = 0;
+					node.free_memory = 0;
+					ULONGLONG available;
+					if (::GetNumaAvailableMemoryNode(static_cast<UCHAR>(node.id), &available))
+					{
+						node.free_memory = available;
+					}
+					ULONG_PTR mask = slpi_[i].ProcessorMask;
+					for (int cpu = 0; mask; ++ cpu, mask >>= 1)
+					{
+						if (mask & 1)
+						{
+							node.cpus.Set(cpu);
+						}
+					}
+					numa_nodes_.push_back(node);
+				}
+			}
+		}
+#endif
+
+		this->DetectNumaNodes();
+		this->DetectCoreTypes();
+	}
+
+	void CPUInfo::DetectNumaNodes() const
+	{
+#if defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+		// Already there if the topology came from the probe cache
+		char list[4096];
+		CPUSet online_nodes;
+		if (numa_nodes_.empty() && !replay_ && ReadFirstLine((std::string(SYSFS_NODE_DIR) + "/online").c_str(), list, sizeof(list))
+			&& online_nodes.FromString(list))
+		{
+			SysfsReader reader;
+			for (int id = online_nodes.First(); id >= 0; id = online_nodes.Next(id))
+			{
+				reader.SelectNode(id);
+
+				NumaNodeInfo node;
+				node.id = id;
+				node.total_memory = 0;
+				node.free_memory = 0;
+				reader.ReadCPUSet("cpulist", node.cpus);
+
+				// Lines like "Node 0 MemTotal:       65536000 kB"
+				if (char const * meminfo = reader.ReadAll("meminfo"))
+				{
+					char const * total = strstr(meminfo, "MemTotal:");
+					char const * free = strstr(meminfo, "MemFree:");
+					if (total != nullptr)
+					{
+						node.total_memory = strtoull(total + sizeof("MemTotal:") - 1, nullptr, 10) * 1024;
+					}
+					if (free != nullptr)
+					{
+						node.free_memory = strtoull(free + sizeof("MemFree:") - 1, nullptr, 10) * 1024;
+					}
+				}
+
+				// One distance per online node, in the same order as the online list
+				if (char const * distance = reader.Read("distance"))
+				{
+					char* end;
+					for (long d = strtol(distance, &end, 10); end != distance; d = strtol(distance, &end, 10))
+					{
+						node.distances.push_back(static_cast<int>(d));
+						distance = end;
+					}
+					if (node.distances.size() != static_cast<size_t>(online_nodes.Count()))
+					{
+						node.distances.clear();
+					}
+				}
+
+				numa_nodes_.push_back(node);
+			}
+		}
+#endif
+
+		if (numa_nodes_.empty())
+		{
+			NumaNodeInfo node;
+			node.id = 0;
+			node.total_memory = 0;
+			node.free_memory = 0;
+			node.distances.push_back(10);
+			for (size_t i = 0; i < logical_processors_.size(); ++ i)
+			{
+				node.cpus.Set(logical_processors_[i].os_index);
+			}
+			for (int i = 0; node.cpus.Empty() && (i < num_hw_threads_); ++ i)
+			{
+				node.cpus.Set(i);
+			}
+
+			if (!replay_)
+			{
+#if defined CPUT_PLATFORM_WINDOWS_DESKTOP
+				MEMORYSTATUSEX status;
+				status.dwLength = sizeof(status);
+				if (::GlobalMemoryStatusEx(&status))
+				{
+					node.total_memory = status.ullTotalPhys;
+					node.free_memory = status.ullAvailPhys;
+				}
+#elif defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+				long const page_size = sysconf(_SC_PAGESIZE);
+				long const phys_pages = sysconf(_SC_PHYS_PAGES);
+				long const avail_pages = sysconf(_SC_AVPHYS_PAGES);
+				if ((page_size > 0) && (phys_pages > 0) && (avail_pages >= 0))
+				{
+					node.total_memory = static_cast<uint64>(phys_pages) * page_size;
+					node.free_memory = static_cast<uint64>(avail_pages) * page_size;
+				}
+#endif
+			}
+
+			numa_nodes_.push_back(node);
+		}
+		else
+		{
+			std::sort(numa_nodes_.begin(), numa_nodes_.end(),
+				[](NumaNodeInfo const & lhs, NumaNodeInfo const & rhs)
+				{
+					return lhs.id < rhs.id;
+				});
+		}
+
+		for (size_t i = 0; i < logical_processors_.size(); ++ i)
+		{
+			LogicalProcessorInfo& lp = logical_processors_[i];
+			lp.node = -1;
+			for (size_t n = 0; n < numa_nodes_.size(); ++ n)
+			{
+				if (numa_nodes_[n].cpus.Test(lp.os_index))
+				{
+					lp.node = static_cast<int>(n);
+					break;
+				}
+			}
+		}
+	}
+
+#if defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+	bool CPUInfo::DetectSysfsTopology() const
+	{
+		std::chrono::steady_clock::time_point const probe_start = std::chrono::steady_clock::now();
+
+		CPUSet configured;
+		CPUSet online;
+		if (!EnumerateSysfsCPUs(configured, online))
+		{
+			return false;
+		}
+
+		for (size_t c = 0; c < caches_.size(); ++ c)
+		{
+			caches_[c].instances.clear();
+		}
+
+		SysfsReader reader;
+		std::vector<TopologyEntry> entries;
+		for (int cpu = online.First(); cpu >= 0; cpu = online.Next(cpu))
+		{
+			reader.SelectCPU(cpu);
+
+			int pkg_id;
+			int core_id;
+			CPUSet siblings;
+			if (!reader.ReadInt("topology/physical_package_id", pkg_id) || !reader.ReadInt("topology/core_id", core_id)
+				|| !reader.ReadCPUSet("topology/thread_siblings_list", siblings))
+			{
+				// No topology directory, an old kernel or a restricted container
+				return false;
+			}
+			int die_id;
+			if (!reader.ReadInt("topology/die_id", die_id) || (die_id < 0))
+			{
+				// Before Linux 5.2, or no dies
+				die_id = 0;
+			}
+
+			TopologyEntry entry;
+			// Some architectures report -1 for an unknown package
+			entry.pkg_id = static_cast<uint32_t>(std::max(pkg_id, 0));
+			entry.die_id = static_cast<uint32_t>(die_id);
+			entry.core_id = static_cast<uint32_t>(std::max(core_id, 0));
+			entry.thread_id = 0;
+			for (int sibling = siblings.First(); (sibling >= 0) && (sibling < cpu); sibling = siblings.Next(sibling))
+			{
+				++ entry.thread_id;
+			}
+			entry.apic_id = ~0U;
+			entry.os_index = cpu;
+			entries.push_back(entry);
+
+			// A cache instance is read from the first of its CPUs and skipped on the others
+			for (int index = 0; ; ++ index)
+			{
+				char name[64];
+				snprintf(name, sizeof(name), "cache/index%d/level", index);
+				int level;
+				if (!reader.ReadInt(name, level))
+				{
+					break;
+				}
+				snprintf(name, sizeof(name), "cache/index%d/type", index);
+				char const * type_str = reader.Read(name);
+				if (nullptr == type_str)
+				{
+					continue;
+				}
+				CacheType type;
+				if (0 == strcmp(type_str, "Data"))
+				{
+					type = CT_Data;
+				}
+				else if (0 == strcmp(type_str, "Instruction"))
+				{
+					type = CT_Code;
+				}
+				else if (0 == strcmp(type_str, "Unified"))
+				{
+					type = CT_Unified;
+				}
+				else
+				{
+					continue;
+				}
+
+				for (size_t c = 0; c < caches_.size(); ++ c)
+				{
+					CacheLevelInfo& cache = caches_[c];
+					if ((cache.level != level) || (cache.type != type))
+					{
+						continue;
+					}
+
+					bool known = false;
+					for (size_t i = 0; (i < cache.instances.size()) && !known; ++ i)
+					{
+						known = cache.instances[i].Test(cpu);
+					}
+					if (!known)
+					{
+						snprintf(name, sizeof(name), "cache/index%d/shared_cpu_list", index);
+						CPUSet shared;
+						if (reader.ReadCPUSet(name, shared))
+						{
+							cache.instances.push_back(shared & online);
+						}
+					}
+					break;
+				}
+			}
+		}
+
+		num_cores_ = BuildTopologyTree(entries, packages_, logical_processors_);
+		topology_probe_time_ = static_cast<unsigned int>(std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - probe_start).count());
+		topology_from_sysfs_ = true;
+		return true;
+	}
+
+	// The words are the number of logical CPUs, then the OS index, package, die and core IDs and thread of each.
+	// Then for each entry of caches_, its number of instances and their CPUs. Then the number of NUMA nodes, and
+	// for each its ID, CPUs, total and free memory as low and high halves, and distances. A CPU set is a count
+	// followed by the CPUs.
+	bool CPUInfo::SaveSysfsTopology(std::vector<unsigned int>& words) const
+	{
+		std::call_once(topology_once_, &CPUInfo::DetectTopology, this);
+
+		words.clear();
+		if (!topology_from_sysfs_)
+		{
+			return false;
+		}
+
+		words.push_back(static_cast<unsigned int>(logical_processors_.size()));
+		for (size_t i = 0; i < logical_processors_.size(); ++ i)
+		{
+			LogicalProcessorInfo const & lp = logical_processors_[i];
+			PackageInfo const & pkg = packages_[lp.package];
+			words.push_back(static_cast<unsigned int>(lp.os_index));
+			words.push_back(pkg.id);
+			words.push_back(pkg.dies[lp.die].id);
+			words.push_back(pkg.dies[lp.die].cores[lp.core].id);
+			words.push_back(static_cast<unsigned int>(lp.thread));
+		}
+
+		for (size_t c = 0; c < caches_.size(); ++ c)
+		{
+			words.push_back(static_cast<unsigned int>(caches_[c].instances.size()));
+			for (size_t i = 0; i < caches_[c].instances.size(); ++ i)
+			{
+				WriteCPUSet(words, caches_[c].instances[i]);
+			}
+		}
+
+		words.push_back(static_cast<unsigned int>(numa_nodes_.size()));
+		for (size_t n = 0; n < numa_nodes_.size(); ++ n)
+		{
+			NumaNodeInfo const & node = numa_nodes_[n];
+			words.push_back(static_cast<unsigned int>(node.id));
+			WriteCPUSet(words, node.cpus);
+			words.push_back(static_cast<unsigned int>(node.total_memory));
+			words.push_back(static_cast<unsigned int>(node.total_memory >> 32));
+			words.push_back(static_cast<unsigned int>(node.free_memory));
+			words.push_back(static_cast<unsigned int>(node.free_memory >> 32));
+			words.push_back(static_cast<unsigned int>(node.distances.size()));
+			for (size_t d = 0; d < node.distances.size(); ++ d)
+			{
+				words.push_back(static_cast<unsigned int>(node.distances[d]));
+			}
+		}
+
+		return true;
+	}
+
+	// Rebuilds what DetectSysfsTopology() and DetectNumaNodes() found from the words of the probe cache.
+	// Nothing is changed if they don't parse.
+	bool CPUInfo::RestoreSysfsTopology() const
+	{
+		if (sysfs_topology_.empty())
+		{
+			return false;
+		}
+
+		std::chrono::steady_clock::time_point const probe_start = std::chrono::steady_clock::now();
+
+		TopologyWordReader reader(sysfs_topology_);
+		unsigned int num;
+		if (!reader.Read(num) || (0 == num))
+		{
+			return false;
+		}
+		std::vector<TopologyEntry> entries;
+		for (unsigned int i = 0; i < num; ++ i)
+		{
+			TopologyEntry entry;
+			if (!reader.ReadCPU(entry.os_index) || !reader.Read(entry.pkg_id) || !reader.Read(entry.die_id)
+				|| !reader.Read(entry.core_id) || !reader.Read(entry.thread_id))
+			{
+				return false;
+			}
+			entry.apic_id = ~0U;
+			entries.push_back(entry);
+		}
+
+		std::vector<std::vector<CPUSet> > instances(caches_.size());
+		for (size_t c = 0; c < caches_.size(); ++ c)
+		{
+			if (!reader.Read(num))
+			{
+				return false;
+			}
+			for (unsigned int i = 0; i < num; ++ i)
+			{
+				CPUSet cpus;
+				if (!reader.ReadCPUSet(cpus))
+				{
+					return false;
+				}
+				instances[c].push_back(cpus);
+			}
+		}
+
+		std::vector<NumaNodeInfo> nodes;
+		if (!reader.Read(num))
+		{
+			return false;
+		}
+		for (unsigned int n = 0; n < num; ++ n)
+		{
+			NumaNodeInfo node;
+			unsigned int id;
+			unsigned int memory[4];
+			unsigned int num_distances;
+			if (!reader.Read(id) || !reader.ReadCPUSet(node.cpus) || !reader.Read(memory[0]) || !reader.Read(memory[1])
+				|| !reader.Read(memory[2]) || !reader.Read(memory[3]) || !reader.Read(num_distances))
+			{
+				return false;
+			}
+			node.id = static_cast<int>(id);
+			node.total_memory = (static_cast<uint64>(memory[1]) << 32) | memory[0];
+			node.free_memory = (static_cast<uint64>(memory[3]) << 32) | memory[2];
+			for (unsigned int d = 0; d < num_distances; ++ d)
+			{
+				unsigned int distance;
+				if (!reader.Read(distance))
+				{
+					return false;
+				}
+				node.distances.push_back(static_cast<int>(distance));
+			}
+			nodes.push_back(node);
+		}
+		if (!reader.AtEnd())
+		{
+			return false;
+		}
+
+		num_cores_ = BuildTopologyTree(entries, packages_, logical_processors_);
+		for (size_t c = 0; c < caches_.size(); ++ c)
+		{
+			caches_[c].instances.swap(instances[c]);
+		}
+		numa_nodes_.swap(nodes);
+		topology_probe_time_ = static_cast<unsigned int>(std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - probe_start).count());
+		topology_from_sysfs_ = true;
+		return true;
+	}
+#endif
+
+#if (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)) && !defined(CPUT_PLATFORM_ANDROID)
+	void CPUInfo::DetectApicTopology() const
+	{
+		TopologyExtractor extractor;
+		bool x2apic = false;
+
+		uint32_t topo_fn = 0;
+		if ((this->MaxStdFn() >= 0x1F) && (this->CPUIDResult(0x1F, 1) != 0))
+		{
+			topo_fn = 0x1F;
+		}
+		else if ((this->MaxStdFn() >= 0xB) && (this->CPUIDResult(0xB, 1) != 0))
+		{
+			topo_fn = 0xB;
+		}
+
+		if (topo_fn != 0)
+		{
+			// Each level reports how far the x2APIC ID has to be shifted to get the ID of the next level up.
+			// Module and tile levels are folded into the cores of their die.
+			uint32_t smt_shift = 0;
+			uint32_t die_shift = 0;
+			uint32_t pkg_shift = 0;
+			bool has_die = false;
+			for (uint32_t sub_fn = 0; sub_fn < 32; ++ sub_fn)
+			{
+				uint32_t const level_type = (this->CPUIDResult(topo_fn, sub_fn, 2) >> 8) & 0xFF;
+				if (TLT_Invalid == level_type)
+				{
+					break;
+				}
+
+				uint32_t const shift = this->CPUIDResult(topo_fn, sub_fn, 0) & 0x1F;
+				if (TLT_SMT == level_type)
+				{
+					smt_shift = shift;
+				}
+				else if (TLT_Die == level_type)
+				{
+					die_shift = pkg_shift;
+					has_die = true;
+				}
+				pkg_shift = shift;
+			}
+			if (!has_die)
+			{
+				die_shift = pkg_shift;
+			}
+
+			extractor.SetShifts(smt_shift, die_shift, pkg_shift);
+			x2apic = true;
+		}
+		else
+		{
+			// Pre-x2APIC parts. Only the 8-bit initial APIC ID is there, and the field widths have to be
+			// derived from the thread and core counts.
+			uint32_t log_procs_per_pkg = 1;
+			uint32_t smt_shift = 0;
+			uint32_t pkg_shift = 0;
+
+			// Determine if hyper-threading is enabled.
+			if (this->IsFeatureSupport(CF_HTT))
+			{
+				// Determine the total number of logical processors per package.
+				log_procs_per_pkg = (this->CPUIDResult(1, 1) & CFM_LogicalProcessorCount_Intel) >> 16;
+			}
+
+			// Determine the total number of cores per package.  This info
+			// is extracted differently dependending on the cpu vendor.
+			if (0 == strcmp(GenuineIntel, vendor_))
+			{
+				uint32_t cores_per_pkg = 1;
+				if (this->IsFeatureSupport(CF_HTT) && (this->MaxStdFn() >= 4))
+				{
+					cores_per_pkg = ((this->CPUIDResult(4, 0) & CFM_NC_Intel) >> 26) + 1;
+				}
+				smt_shift = GetMaskWidth(std::max(log_procs_per_pkg / cores_per_pkg, 1U));
+				pkg_shift = smt_shift + GetMaskWidth(cores_per_pkg);
+			}
+			else
+			{
+				assert(0 == strcmp(AuthenticAMD, vendor_));
+
+				if (this->MaxExtFn() >= 0x80000008)
+				{
+					// AMD reports the msb width of the CORE_ID bit field of the APIC ID
+					// in ApicIdCoreIdSize_Amd. If it is zero, the width comes from the
+					// actual number of cores instead.
+					uint32_t const msb_width = (this->CPUIDResult(0x80000008, 2) & CFM_ApicIdCoreIdSize_AMD) >> 12;
+					if (msb_width)
+					{
+						pkg_shift = msb_width;
+					}
+					else
+					{
+						pkg_shift = GetMaskWidth((this->CPUIDResult(0x80000008, 2) & CFM_NC_AMD) + 1);
+					}
+				}
+				else
+				{
+					pkg_shift = GetMaskWidth(log_procs_per_pkg);
+				}
+
+				if ((this->MaxExtFn() >= 0x8000001E) && (this->CPUIDResult(0x80000001, 2) & CFM_TopologyExtensions_AMD))
+				{
+					smt_shift = GetMaskWidth(((this->CPUIDResult(0x8000001E, 1) >> 8) & 0xFF) + 1);
+				}
+			}
+
+			extractor.SetShifts(smt_shift, pkg_shift, pkg_shift);
+		}
+
+		std::vector<CPUIDDump::PerCPULeaves> per_cpu;
+		if (replay_)
+		{
+			// A recorded machine. Take its CPUs as they are.
+			per_cpu = dump_.PerCPU();
+		}
+		else
+		{
+			CPUSet cpus;
+#if defined CPUT_PLATFORM_WINDOWS
+			cpus = ProcessAffinity();
+#elif defined CPUT_PLATFORM_LINUX
+			cpus = ProbeableCPUs(num_hw_threads_);
+#endif
+
+			// A probe cache may already hold the leaves of every CPU in the set.
+			std::vector<CPUIDDump::PerCPULeaves> const & cached = dump_.PerCPU();
+			for (size_t i = 0; i < cached.size(); ++ i)
+			{
+				if (cached[i].valid && cpus.Test(cached[i].cpu))
+				{
+					per_cpu.push_back(cached[i]);
+				}
+			}
+			if (per_cpu.size() != static_cast<size_t>(cpus.Count()))
+			{
+				std::chrono::steady_clock::time_point const probe_start = std::chrono::steady_clock::now();
+				dump_.CapturePerCPU(cpus, PER_CPU_PROBE_TIMEOUT_MS);
+				topology_probe_time_ = static_cast<unsigned int>(std::chrono::duration_cast<std::chrono::microseconds>(
+					std::chrono::steady_clock::now() - probe_start).count());
+				per_cpu = dump_.PerCPU();
+			}
+		}
+
+		std::vector<TopologyEntry> entries;
+		for (size_t i = 0; i < per_cpu.size(); ++ i)
+		{
+			if (per_cpu[i].valid)
+			{
+				TopologyEntry entry;
+				entry.apic_id = x2apic ? per_cpu[i].x2apic_id : ((per_cpu[i].leaf1_ebx & CFM_ApicId_Intel) >> 24);
+				entry.pkg_id = extractor.PackageId(entry.apic_id);
+				entry.die_id = extractor.DieId(entry.apic_id);
+				entry.core_id = extractor.CoreId(entry.apic_id);
+				entry.thread_id = extractor.ThreadId(entry.apic_id);
+				entry.os_index = per_cpu[i].cpu;
+				entries.push_back(entry);
+			}
+		}
+		num_cores_ = BuildTopologyTree(entries, packages_, logical_processors_);
+
+		// Logical CPUs whose APIC IDs only differ in the low bits reserved for the sharing count share one cache instance.
+		for (size_t c = 0; c < caches_.size(); ++ c)
+		{
+			CacheLevelInfo& cache = caches_[c];
+			cache.instances.clear();
+			if (cache.max_sharing <= 0)
+			{
+				continue;
+			}
+
+			uint32_t const shift = GetMaskWidth(cache.max_sharing);
+			std::vector<std::pair<uint32_t, int> > cache_ids(entries.size());
+			for (size_t i = 0; i < entries.size(); ++ i)
+			{
+				cache_ids[i].first = (shift >= 32) ? 0 : (entries[i].apic_id >> shift);
+				cache_ids[i].second = entries[i].os_index;
+			}
+			std::sort(cache_ids.begin(), cache_ids.end());
+
+			for (size_t i = 0; i < cache_ids.size(); ++ i)
+			{
+				if ((0 == i) || (cache_ids[i].first != cache_ids[i - 1].first))
+				{
+					cache.instances.push_back(CPUSet());
+				}
+				cache.instances.back().Set(cache_ids[i].second);
+			}
+		}
+	}
+#endif
+
+#if (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)) && !defined(CPUT_PLATFORM_ANDROID)
+	void CPUInfo::DecodeDeterministicCaches()
+	{
+		caches_.clear();
+
+		uint32_t cache_fn = 0;
+		if ((0 == strcmp(GenuineIntel, vendor_)) && (this->MaxStdFn() >= 4))
+		{
+			cache_fn = 4;
+		}
+		else if ((0 == strcmp(AuthenticAMD, vendor_)) && (this->MaxExtFn() >= 0x8000001D)
+			&& (this->CPUIDResult(0x80000001, 2) & CFM_TopologyExtensions_AMD))
+		{
+			// Same layout as leaf 4
+			cache_fn = 0x8000001D;
+		}
+
+		if (cache_fn != 0)
+		{
+			for (uint32_t sub_fn = 0; sub_fn < MAX_SUB_FNS; ++ sub_fn)
+			{
+				uint32_t const eax = this->CPUIDResult(cache_fn, sub_fn, 0);
+				uint32_t const ebx = this->CPUIDResult(cache_fn, sub_fn, 1);
+				uint32_t const ecx = this->CPUIDResult(cache_fn, sub_fn, 2);
+				uint32_t const edx = this->CPUIDResult(cache_fn, sub_fn, 3);
+
+				uint32_t const cache_type = eax & 0x1F;
+				if (0 == cache_type)
+				{
+					break;
+				}
+
+				CacheLevelInfo cache;
+				cache.level = (eax >> 5) & 0x7;
+				cache.type = static_cast<CacheType>(cache_type);
+				cache.way = ((ebx >> 22) & 0x03FF) + 1;
+				cache.partitions = ((ebx >> 12) & 0x03FF) + 1;
+				cache.line = (ebx & 0x0FFF) + 1;
+				cache.sets = ecx + 1;
+				cache.size = static_cast<int>(static_cast<uint64_t>(cache.way) * cache.partitions * cache.line * cache.sets / 1024);
+				if (eax & CFM_FullyAssociative)
+				{
+					cache.way = 0xFF;
+				}
+				cache.inclusive = (edx & CFM_CacheInclusive) ? true : false;
+				cache.max_sharing = ((eax >> 14) & 0x0FFF) + 1;
+				caches_.push_back(cache);
+			}
+		}
+		else if ((0 == strcmp(AuthenticAMD, vendor_)) && (this->MaxExtFn() >= 0x80000005))
+		{
+			// K7 to K10 only have the summary leaves, without sharing information.
+			CacheLevelInfo cache;
+			cache.sets = 0;
+			cache.partitions = 1;
+			cache.inclusive = false;
+			cache.max_sharing = 0;
+
+			uint32_t const l1_regs[] = { this->CPUIDResult(0x80000005, 2), this->CPUIDResult(0x80000005, 3) };
+			for (int i = 0; i < 2; ++ i)
+			{
+				cache.level = 1;
+				cache.type = (0 == i) ? CT_Data : CT_Code;
+				cache.size = (l1_regs[i] >> 24) & 0xFF;
+				cache.way = (l1_regs[i] >> 16) & 0xFF;
+				cache.line = l1_regs[i] & 0xFF;
+				if (cache.size != 0)
+				{
+					cache.sets = AMDSets(cache);
+					caches_.push_back(cache);
+				}
+			}
+
+			if (this->MaxExtFn() >= 0x80000006)
+			{
+				uint32_t const l2 = this->CPUIDResult(0x80000006, 2);
+				cache.level = 2;
+				cache.type = CT_Unified;
+				cache.size = (l2 >> 16) & 0xFFFF;
+				cache.way = AMDAssociativity((l2 >> 12) & 0xF);
+				cache.line = l2 & 0xFF;
+				if ((cache.size != 0) && (cache.way != 0))
+				{
+					cache.sets = AMDSets(cache);
+					caches_.push_back(cache);
+				}
+
+				uint32_t const l3 = this->CPUIDResult(0x80000006, 3);
+				cache.level = 3;
+				cache.size = ((l3 >> 18) & 0x3FFF) * 512;
+				cache.way = AMDAssociativity((l3 >> 12) & 0xF);
+				cache.line = l3 & 0xFF;
+				if ((cache.size != 0) && (cache.way != 0))
+				{
+					cache.sets = AMDSets(cache);
+					caches_.push_back(cache);
+				}
+			}
+		}
+
+		for (size_t i = 0; i < caches_.size(); ++ i)
+		{
+			CacheLevelInfo& cache = caches_[i];
+			if (0 == cache_fn)
+			{
+				cache.sets = (0xFF == cache.way) ? 1 : cache.size * 1024 / std::max(cache.way * cache.line, 1);
+			}
+
+			CacheInfo* legacy = nullptr;
+			switch (cache.level)
+			{
+			case 1:
+				if (CT_Data == cache.type)
+				{
+					legacy = &l1_data_cache_;
+				}
+				else if (CT_Code == cache.type)
+				{
+					legacy = &l1_code_cache_;
+				}
+				break;
+
+			case 2:
+				legacy = &l2_cache_;
+				break;
+
+			case 3:
+				legacy = &l3_cache_;
+				break;
+
+			default:
+				break;
+			}
+			if (legacy != nullptr)
+			{
+				legacy->size = cache.size;
+				legacy->way = cache.way;
+				legacy->line = cache.line;
+			}
+		}
+	}
+
+	void CPUInfo::DecodeTLBs()
+	{
+		std::vector<TLBLevelInfo> tlbs;
+		if ((0 == strcmp(GenuineIntel, vendor_)) && (this->MaxStdFn() >= 0x18))
+		{
+			uint32_t const last_sub_fn = std::min(this->CPUIDResult(0x18, 0, 0), MAX_SUB_FNS - 1);
+			for (uint32_t sub_fn = 0; sub_fn <= last_sub_fn; ++ sub_fn)
+			{
+				uint32_t const ebx = this->CPUIDResult(0x18, sub_fn, 1);
+				uint32_t const ecx = this->CPUIDResult(0x18, sub_fn, 2);
+				uint32_t const edx = this->CPUIDResult(0x18, sub_fn, 3);
+
+				// Unlike leaf 4, invalid subleaves can be followed by valid ones
+				uint32_t const tlb_type = edx & 0x1F;
+				if ((tlb_type < TT_Data) || (tlb_type > TT_StoreOnly))
+				{
+					continue;
+				}
+
+				TLBLevelInfo tlb;
+				tlb.level = (edx >> 5) & 0x7;
+				tlb.type = static_cast<TLBType>(tlb_type);
+				tlb.page_sizes = 0;
+				uint32_t const page_shifts[] = { 12, 21, 22, 30 };
+				for (uint32_t i = 0; i < sizeof(page_shifts) / sizeof(page_shifts[0]); ++ i)
+				{
+					if ((ebx >> i) & 1)
+					{
+						tlb.page_sizes |= 1ULL << page_shifts[i];
+					}
+				}
+				tlb.way = (ebx >> 16) & 0xFFFF;
+				tlb.entries = tlb.way * ecx;
+				if (edx & CFM_TLBFullyAssociative)
+				{
+					tlb.way = 0xFF;
+				}
+				tlb.max_sharing = ((edx >> 14) & 0x0FFF) + 1;
+				tlbs.push_back(tlb);
+			}
+		}
+		else if ((0 == strcmp(AuthenticAMD, vendor_)) && (this->MaxExtFn() >= 0x80000005))
+		{
+			// Each register holds a data TLB in the high 16 bits and a code TLB in the low 16 bits. The L1 fields are
+			// 8-bit associativity and 8-bit entries, the L2 ones 4-bit encoded associativity and 12-bit entries.
+			// The 2M/4M TLBs hold half as many 4M pages, the reach is the same. They're listed as a 2M TLB and
+			// a 4M one with half the entries, so TLBReach() gets both right.
+			struct AMDTLBReg
+			{
+				uint32_t fn;
+				uint32_t index;
+				int level;
+				uint64 page_sizes;
+			};
+			AMDTLBReg const regs[] =
+			{
+				{ 0x80000005, 1, 1, 1ULL << 12 },
+				{ 0x80000005, 0, 1, (1ULL << 21) | (1ULL << 22) },
+				{ 0x80000019, 0, 1, 1ULL << 30 },
+				{ 0x80000006, 1, 2, 1ULL << 12 },
+				{ 0x80000006, 0, 2, (1ULL << 21) | (1ULL << 22) },
+				{ 0x80000019, 1, 2, 1ULL << 30 }
+			};
+			for (size_t i = 0; i < sizeof(regs) / sizeof(regs[0]); ++ i)
+			{
+				if (regs[i].fn > this->MaxExtFn())
+				{
+					continue;
+				}
+
+				uint32_t const reg = this->CPUIDResult(regs[i].fn, regs[i].index);
+				for (int half = 0; half < 2; ++ half)
+				{
+					uint32_t const bits = (0 == half) ? (reg >> 16) : (reg & 0xFFFF);
+
+					TLBLevelInfo tlb;
+					tlb.level = regs[i].level;
+					tlb.type = (0 == half) ? TT_Data : TT_Code;
+					tlb.page_sizes = regs[i].page_sizes;
+					if ((1 == tlb.level) && (regs[i].fn != 0x80000019))
+					{
+						tlb.way = bits >> 8;
+						tlb.entries = bits & 0xFF;
+					}
+					else
+					{
+						tlb.way = AMDAssociativity(bits >> 12);
+						tlb.entries = bits & 0x0FFF;
+					}
+					tlb.max_sharing = 1;
+					if ((tlb.way != 0) && (tlb.entries != 0))
+					{
+						if (tlb.page_sizes == ((1ULL << 21) | (1ULL << 22)))
+						{
+							tlb.page_sizes = 1ULL << 21;
+							tlbs.push_back(tlb);
+							tlb.page_sizes = 1ULL << 22;
+							tlb.entries /= 2;
+						}
+						tlbs.push_back(tlb);
+					}
+				}
+			}
+		}
+
+		if (!tlbs.empty())
+		{
+			// Replaces the leaf 2 ones
+			tlbs_.swap(tlbs);
+		}
+
+		// Leaf 2 describes no TLB on recent CPUs. Fills the legacy fields with the 4K TLBs instead.
+		for (size_t i = 0; i < tlbs_.size(); ++ i)
+		{
+			TLBLevelInfo const & tlb = tlbs_[i];
+			if (0 == (tlb.page_sizes & (1ULL << 12)))
+			{
+				continue;
+			}
+
+			TLBInfo* legacy = nullptr;
+			if (1 == tlb.level)
+			{
+				if (TT_Code == tlb.type)
+				{
+					legacy = &code_tlb_;
+				}
+				else if (tlb.type != TT_StoreOnly)
+				{
+					legacy = &data_tlb_;
+				}
+			}
+			else if ((2 == tlb.level) && (tlb.type != TT_Code))
+			{
+				legacy = &l2_data_tlb_;
+			}
+			if ((legacy != nullptr) && (0 == legacy->entries))
+			{
+				legacy->page_sizes = tlb.page_sizes;
+				legacy->way = tlb.way;
+				legacy->entries = tlb.entries;
+			}
+		}
+	}
+#endif
+
+	void CPUInfo::UpdateFrequency() const
+	{
+		if (!replay_)
+		{
+			this->PublishFrequency(this->MeasureFrequency());
+		}
+	}
+
+	unsigned int CPUInfo::MeasureFrequency() const
+	{
+		double const start_time = MonotonicSeconds();
+		uint64 const start_cycle = __rdtsc();
+
+		SleepMilliseconds(calibration_window_);
+
+		uint64 const cycles = __rdtsc() - start_cycle;
+		double const duration = MonotonicSeconds() - start_time;
+
+		return static_cast<unsigned int>(cycles / duration / 1000000);
+	}
+
+	void CPUInfo::DecodeFeatures()
+	{
+		bool const is_amd = (0 == strcmp(AuthenticAMD, vendor_));
+		for (size_t i = 0; i < sizeof(FEATURE_BITS) / sizeof(FEATURE_BITS[0]); ++ i)
+		{
+			FeatureBit const & fb = FEATURE_BITS[i];
+			if ((FV_AMD == fb.vendor) && !is_amd)
+			{
+				continue;
+			}
+			if ((fb.fn < 0x80000000) ? (fb.fn > this->MaxStdFn()) : (fb.fn > this->MaxExtFn()))
+			{
+				continue;
+			}
+
+			if ((this->CPUIDResult(fb.fn, fb.sub_fn, fb.reg) >> fb.bit) & 1)
+			{
+				hw_feature_mask_.set(fb.feature);
+				if ((dump_.XCR0() & fb.os_state) == fb.os_state)
+				{
+					feature_mask_.set(fb.feature);
+				}
+			}
+		}
+	}
+
+	unsigned int CPUInfo::CPUIDResult(unsigned int fn, unsigned int index) const
+	{
+		return dump_.Result(fn, 0, index);
+	}
+
+	unsigned int CPUInfo::CPUIDResult(unsigned int fn, unsigned int sub_fn, unsigned int index) const
+	{
+		return dump_.Result(fn, sub_fn, index);
 	}
 
 	unsigned int CPUInfo::MaxStdFn() const
 	{
-		return static_cast<unsigned int>(cpuid_std_fn_results_.size() / 4);
+		return dump_.MaxStdFn();
 	}
 
 	unsigned int CPUInfo::MaxExtFn() const
 	{
-		return static_cast<unsigned int>(cpuid_ext_fn_results_.size() / 4 + 0x80000000);
+		return dump_.MaxExtFn();
 	}
 }
@@ -0,0 +1,659 @@
+/**
+ * @file CPUIDDump.cpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of CPUTSDK, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#include <CPU-T/CPUIDDump.hpp>
+
+#include <cctype>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+#if defined(CPUT_COMPILER_MSVC)
+#include <intrin.h>
+#elif defined(CPUT_COMPILER_GCC) && (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64))
+#include <cpuid.h>
+#endif
+
+namespace
+{
+	using std::uint32_t;
+	using std::uint64_t;
+
+#if (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)) && !defined(CPUT_PLATFORM_ANDROID)
+	void get_cpuid(uint32_t* peax, uint32_t* pebx, uint32_t* pecx, uint32_t* pedx)
+	{
+#if defined CPUT_COMPILER_MSVC
+		int CPUInfo[4];
+		__cpuidex(CPUInfo, *peax, *pecx);
+		*peax = CPUInfo[0];
+		*pebx = CPUInfo[1];
+		*pecx = CPUInfo[2];
+		*pedx = CPUInfo[3];
+#elif defined CPUT_COMPILER_GCC
+		// <cpuid.h> takes care of EBX being the PIC register on x86
+		uint32_t const fn = *peax;
+		uint32_t const sub_fn = *pecx;
+		__cpuid_count(fn, sub_fn, *peax, *pebx, *pecx, *pedx);
+#else
+		#error Unsupported compiler. CPUID needs MSVC, GCC or Clang.
+#endif
+	}
+
+	// XGETBV with ECX = 0. Only valid when CPUID.1:ECX.OSXSAVE is set, otherwise it raises #UD.
+	uint64_t get_xcr0()
+	{
+#if defined CPUT_COMPILER_MSVC
+		return _xgetbv(0);
+#elif defined CPUT_COMPILER_GCC
+		// The opcode rather than the mnemonic, so assemblers older than XSAVE and -mno-xsave builds take it
+		uint32_t xcr0_lo, xcr0_hi;
+		__asm__
+		(
+			".byte 0x0F, 0x01, 0xD0"
+			: "=a" (xcr0_lo), "=d" (xcr0_hi)
+			: "c" (0)
+		);
+		return (static_cast<uint64_t>(xcr0_hi) << 32) | xcr0_lo;
+#else
+		// A silent 0 would mask off every AVX and AVX-512 feature
+		#error Unsupported compiler. XGETBV needs MSVC, GCC or Clang.
+#endif
+	}
+
+	class Cpuid
+	{
+	public:
+		Cpuid()
+			: eax_(0), ebx_(0), ecx_(0), edx_(0)
+		{
+		}
+
+		uint32_t Eax() const
+		{
+			return eax_;
+		}
+		uint32_t Ebx() const
+		{
+			return ebx_;
+		}
+		uint32_t Ecx() const
+		{
+			return ecx_;
+		}
+		uint32_t Edx() const
+		{
+			return edx_;
+		}
+
+		void Call(uint32_t fn, uint32_t sub_fn = 0)
+		{
+			eax_ = fn;
+			ecx_ = sub_fn;
+			get_cpuid(&eax_, &ebx_, &ecx_, &edx_);
+		}
+
+	private:
+		uint32_t eax_;
+		uint32_t ebx_;
+		uint32_t ecx_;
+		uint32_t edx_;
+	};
+
+	typedef CPUT::CPUIDDump::PerCPULeaves PerCPULeaves;
+
+	uint32_t const CPUID1_ECX_OSXSAVE = 1UL << 27;		// OS has set CR4.OSXSAVE, XGETBV is usable
+
+	void ReadPerCPULeaves(PerCPULeaves& leaves, uint32_t max_std_fn)
+	{
+		Cpuid cpuid;
+		cpuid.Call(1);
+		leaves.leaf1_ebx = cpuid.Ebx();
+		if (max_std_fn >= 0xB)
+		{
+			cpuid.Call(0xB);
+			leaves.x2apic_id = cpuid.Edx();
+		}
+		if (max_std_fn >= 0x1A)
+		{
+			cpuid.Call(0x1A);
+			leaves.hybrid_info = cpuid.Eax();
+		}
+		leaves.valid = true;
+	}
+
+	// Runs CPUID on every CPU of the set from short-lived threads, each pinned to its own CPU, so all of them
+	// are probed concurrently and the caller's affinity is never touched. The wait is bounded by timeout_ms.
+	// CPUs that can't be bound to, or don't answer in time, come back with valid == false.
+	std::vector<PerCPULeaves> CollectPerCPULeaves(CPUT::CPUSet const & cpus, uint32_t max_std_fn, unsigned int timeout_ms)
+	{
+		std::vector<PerCPULeaves> ret;
+		for (int cpu = cpus.First(); cpu >= 0; cpu = cpus.Next(cpu))
+		{
+			PerCPULeaves leaves;
+			memset(&leaves, 0, sizeof(leaves));
+			leaves.cpu = cpu;
+			ret.push_back(leaves);
+		}
+
+		if (ret.size() <= 1)
+		{
+			// Nothing to migrate to. Read it on the calling thread.
+			if (1 == ret.size())
+			{
+				ReadPerCPULeaves(ret[0], max_std_fn);
+			}
+			return ret;
+		}
+
+		// The probe threads are detached, so everything they touch is owned by them and the caller together.
+		struct CollectState
+		{
+			std::mutex mutex;
+			std::condition_variable done;
+			std::vector<PerCPULeaves> results;
+			size_t pending;
+		};
+		std::shared_ptr<CollectState> state = std::make_shared<CollectState>();
+		state->results = ret;
+		state->pending = ret.size();
+
+		for (size_t i = 0; i < ret.size(); ++ i)
+		{
+			try
+			{
+				std::thread([state, i, max_std_fn]
+					{
+						PerCPULeaves leaves;
+						memset(&leaves, 0, sizeof(leaves));
+						leaves.cpu = state->results[i].cpu;
+						if (CPUT::BindThread(CPUT::CPUSet(leaves.cpu)))
+						{
+							ReadPerCPULeaves(leaves, max_std_fn);
+						}
+
+						std::lock_guard<std::mutex> lock(state->mutex);
+						state->results[i] = leaves;
+						-- state->pending;
+						state->done.notify_one();
+					}).detach();
+			}
+			catch (std::system_error const &)
+			{
+				std::lock_guard<std::mutex> lock(state->mutex);
+				-- state->pending;
+			}
+		}
+
+		std::unique_lock<std::mutex> lock(state->mutex);
+		state->done.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+			[&state] { return 0 == state->pending; });
+		return state->results;
+	}
+
+	uint32_t const MAX_SUB_FNS = 64;
+
+	// Leaves a dump holds. Hypervisor (0x40000000) and other vendor ranges are dropped, so a leaf number read
+	// from a file can't size the tables
+	uint32_t const MAX_STD_FN = 0xFF;
+	uint32_t const MAX_EXT_FN = 0x800000FF;
+	// Linux tops out at 8192
+	long const MAX_DUMP_CPUS = 65536;
+
+	bool IsDumpedFn(uint32_t fn)
+	{
+		return (fn <= MAX_STD_FN) || ((fn >= 0x80000000) && (fn <= MAX_EXT_FN));
+	}
+
+	// Whether a subleaf returned by Cpuid exists, according to the enumeration rule of its leaf.
+	bool IsValidSubFn(uint32_t fn, uint32_t /*sub_fn*/, Cpuid const & cpuid)
+	{
+		switch (fn)
+		{
+		case 4:
+		case 0x8000001D:
+			return (cpuid.Eax() & 0x1F) != 0;
+
+		case 0xB:
+		case 0x1F:
+			return ((cpuid.Ecx() >> 8) & 0xFF) != 0;		// Level type 0 is invalid
+
+		case 7:
+		case 0xD:
+		case 0x18:
+			// The caller only probes the subleaves these leaves enumerate.
+			return true;
+
+		default:
+			return false;
+		}
+	}
+#endif
+
+	// Parses a number in the given base and moves p past it. False if there's none before eol. Blanks are
+	// skipped by hand, strtoull would skip a newline too and take the number from the next line.
+	bool ParseNumber(char const *& p, char const * eol, int base, uint64_t& value)
+	{
+		p += strspn(p, " \t");
+		if ((p >= eol) || !isxdigit(static_cast<unsigned char>(*p)))
+		{
+			return false;
+		}
+		char* end;
+		value = strtoull(p, &end, base);
+		if ((end == p) || (end > eol))
+		{
+			return false;
+		}
+		p = end;
+		return true;
+	}
+
+	bool ParseHex(char const *& p, char const * eol, uint64_t& value)
+	{
+		return ParseNumber(p, eol, 16, value);
+	}
+
+	// True if only blanks are left before eol.
+	bool AtEol(char const * p, char const * eol)
+	{
+		return p + strspn(p, " \t\r") >= eol;
+	}
+}
+
+namespace CPUT
+{
+	CPUIDDump::CPUIDDump()
+		: xcr0_(0), frequency_(0)
+	{
+	}
+
+	CPUIDDump CPUIDDump::Capture()
+	{
+		CPUIDDump ret;
+
+#if (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)) && !defined(CPUT_PLATFORM_ANDROID)
+		Cpuid cpuid;
+
+		cpuid.Call(0);
+		uint32_t const max_std_fn = std::min(cpuid.Eax(), MAX_STD_FN);
+
+		ret.std_fn_results_.resize((max_std_fn + 1) * 4);
+		for (uint32_t i = 0; i <= max_std_fn; ++ i)
+		{
+			cpuid.Call(i);
+			ret.std_fn_results_[i * 4 + 0] = cpuid.Eax();
+			ret.std_fn_results_[i * 4 + 1] = cpuid.Ebx();
+			ret.std_fn_results_[i * 4 + 2] = cpuid.Ecx();
+			ret.std_fn_results_[i * 4 + 3] = cpuid.Edx();
+		}
+
+		cpuid.Call(0x80000000);
+		uint32_t const max_ext_fn = (cpuid.Eax() & 0x80000000) ? std::min(cpuid.Eax(), MAX_EXT_FN) : 0;
+		if (max_ext_fn != 0)
+		{
+			uint32_t const num_ext_fns = max_ext_fn - 0x80000000 + 1;
+			ret.ext_fn_results_.resize(num_ext_fns * 4);
+			for (uint32_t i = 0; i < num_ext_fns; ++ i)
+			{
+				cpuid.Call(i + 0x80000000);
+				ret.ext_fn_results_[i * 4 + 0] = cpuid.Eax();
+				ret.ext_fn_results_[i * 4 + 1] = cpuid.Ebx();
+				ret.ext_fn_results_[i * 4 + 2] = cpuid.Ecx();
+				ret.ext_fn_results_[i * 4 + 3] = cpuid.Edx();
+			}
+		}
+
+		// Leaves where ECX selects a subleaf. Subleaf 0 is stored with the other leaves above.
+		uint32_t const sub_fns[] = { 4, 7, 0xB, 0xD, 0x18, 0x1F, 0x8000001D };
+		for (size_t i = 0; i < sizeof(sub_fns) / sizeof(sub_fns[0]); ++ i)
+		{
+			uint32_t const fn = sub_fns[i];
+			if ((fn < 0x80000000) ? (fn <= max_std_fn) : (fn <= max_ext_fn))
+			{
+				// Leaf 7 and 0x18 report their last subleaf in EAX. Leaf 0xD has a subleaf per state component
+				// the processor supports, XCR0 ones in EDX:EAX of subleaf 0, IA32_XSS ones in EDX:ECX of subleaf 1.
+				uint64_t probe_mask = ~0ULL;
+				if ((7 == fn) || (0x18 == fn))
+				{
+					uint32_t const last_sub_fn = ret.std_fn_results_[fn * 4 + 0];
+					probe_mask = (last_sub_fn >= MAX_SUB_FNS - 1) ? ~0ULL : ((2ULL << last_sub_fn) - 1);
+				}
+				else if (0xD == fn)
+				{
+					probe_mask = (static_cast<uint64_t>(ret.std_fn_results_[0xD * 4 + 3]) << 32)
+						| ret.std_fn_results_[0xD * 4 + 0] | 2;
+				}
+
+				for (uint32_t sub_fn = 1; sub_fn < MAX_SUB_FNS; ++ sub_fn)
+				{
+					if (0 == ((probe_mask >> sub_fn) & 1))
+					{
+						continue;
+					}
+
+					cpuid.Call(fn, sub_fn);
+					if (!IsValidSubFn(fn, sub_fn, cpuid))
+					{
+						break;
+					}
+					if ((0xD == fn) && (1 == sub_fn))
+					{
+						probe_mask |= (static_cast<uint64_t>(cpuid.Edx()) << 32) | cpuid.Ecx();
+					}
+
+					ret.sub_fn_results_.push_back(fn);
+					ret.sub_fn_results_.push_back(sub_fn);
+					ret.sub_fn_results_.push_back(cpuid.Eax());
+					ret.sub_fn_results_.push_back(cpuid.Ebx());
+					ret.sub_fn_results_.push_back(cpuid.Ecx());
+					ret.sub_fn_results_.push_back(cpuid.Edx());
+				}
+			}
+		}
+
+		if ((max_std_fn >= 1) && (ret.std_fn_results_[1 * 4 + 2] & CPUID1_ECX_OSXSAVE))
+		{
+			ret.xcr0_ = get_xcr0();
+		}
+#endif
+
+		return ret;
+	}
+
+
+	void CPUIDDump::CapturePerCPU(CPUSet const & cpus, unsigned int timeout_ms)
+	{
+#if (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)) && !defined(CPUT_PLATFORM_ANDROID)
+		per_cpu_ = CollectPerCPULeaves(cpus, this->MaxStdFn(), timeout_ms);
+#else
+		(void)cpus;
+		(void)timeout_ms;
+		per_cpu_.clear();
+#endif
+	}
+
+	void CPUIDDump::Execute(unsigned int fn, unsigned int sub_fn, unsigned int regs[4])
+	{
+#if (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)) && !defined(CPUT_PLATFORM_ANDROID)
+		Cpuid cpuid;
+		cpuid.Call(fn, sub_fn);
+		regs[0] = cpuid.Eax();
+		regs[1] = cpuid.Ebx();
+		regs[2] = cpuid.Ecx();
+		regs[3] = cpuid.Edx();
+#else
+		(void)fn;
+		(void)sub_fn;
+		memset(regs, 0, sizeof(regs[0]) * 4);
+#endif
+	}
+
+	unsigned int CPUIDDump::MaxStdFn() const
+	{
+		return std_fn_results_.empty() ? 0 : static_cast<unsigned int>(std_fn_results_.size() / 4 - 1);
+	}
+
+	unsigned int CPUIDDump::MaxExtFn() const
+	{
+		return ext_fn_results_.empty() ? 0 : static_cast<unsigned int>(ext_fn_results_.size() / 4 + 0x80000000 - 1);
+	}
+
+	unsigned int CPUIDDump::Result(unsigned int fn, unsigned int sub_fn, unsigned int index) const
+	{
+		if (!IsDumpedFn(fn))
+		{
+			return 0;
+		}
+
+		if (0 == sub_fn)
+		{
+			std::vector<unsigned int> const & results = (fn < 0x80000000) ? std_fn_results_ : ext_fn_results_;
+			size_t const offset = static_cast<size_t>(fn & 0x7FFFFFFF) * 4 + index;
+			return (offset < results.size()) ? results[offset] : 0;
+		}
+
+		for (size_t i = 0; i < sub_fn_results_.size(); i += 6)
+		{
+			if ((sub_fn_results_[i + 0] == fn) && (sub_fn_results_[i + 1] == sub_fn))
+			{
+				return sub_fn_results_[i + 2 + index];
+			}
+		}
+		return 0;
+	}
+
+	void CPUIDDump::SetResult(unsigned int fn, unsigned int sub_fn, unsigned int const regs[4])
+	{
+		if (!IsDumpedFn(fn))
+		{
+			return;
+		}
+
+		if (0 == sub_fn)
+		{
+			std::vector<unsigned int>& results = (fn < 0x80000000) ? std_fn_results_ : ext_fn_results_;
+			size_t const offset = static_cast<size_t>(fn & 0x7FFFFFFF) * 4;
+			if (results.size() < offset + 4)
+			{
+				results.resize(offset + 4, 0);
+			}
+			memcpy(&results[offset], regs, sizeof(regs[0]) * 4);
+		}
+		else
+		{
+			for (size_t i = 0; i < sub_fn_results_.size(); i += 6)
+			{
+				if ((sub_fn_results_[i + 0] == fn) && (sub_fn_results_[i + 1] == sub_fn))
+				{
+					memcpy(&sub_fn_results_[i + 2], regs, sizeof(regs[0]) * 4);
+					return;
+				}
+			}
+			sub_fn_results_.push_back(fn);
+			sub_fn_results_.push_back(sub_fn);
+			sub_fn_results_.insert(sub_fn_results_.end(), regs, regs + 4);
+		}
+	}
+
+	std::string CPUIDDump::ToString() const
+	{
+		std::string ret = "# CPU-T CPUID dump\n# fn sub_fn eax ebx ecx edx\n";
+		char line[128];
+
+		for (int range = 0; range < 2; ++ range)
+		{
+			std::vector<unsigned int> const & results = (0 == range) ? std_fn_results_ : ext_fn_results_;
+			for (size_t i = 0; i < results.size(); i += 4)
+			{
+				uint32_t const fn = static_cast<uint32_t>(i / 4) | ((0 == range) ? 0 : 0x80000000);
+				sprintf(line, "%08x %08x %08x %08x %08x %08x\n", fn, 0U,
+					results[i + 0], results[i + 1], results[i + 2], results[i + 3]);
+				ret += line;
+
+				for (size_t j = 0; j < sub_fn_results_.size(); j += 6)
+				{
+					if (sub_fn_results_[j + 0] == fn)
+					{
+						sprintf(line, "%08x %08x %08x %08x %08x %08x\n", fn, sub_fn_results_[j + 1],
+							sub_fn_results_[j + 2], sub_fn_results_[j + 3], sub_fn_results_[j + 4], sub_fn_results_[j + 5]);
+						ret += line;
+					}
+				}
+			}
+		}
+
+		sprintf(line, "xcr0 %016llx\n", static_cast<unsigned long long>(xcr0_));
+		ret += line;
+		sprintf(line, "frequency %u\n", frequency_);
+		ret += line;
+		for (size_t i = 0; i < per_cpu_.size(); ++ i)
+		{
+			if (per_cpu_[i].valid)
+			{
+				if (per_cpu_[i].hybrid_info != 0)
+				{
+					sprintf(line, "cpu %d %08x %08x %08x\n", per_cpu_[i].cpu, per_cpu_[i].leaf1_ebx, per_cpu_[i].x2apic_id,
+						per_cpu_[i].hybrid_info);
+				}
+				else
+				{
+					sprintf(line, "cpu %d %08x %08x\n", per_cpu_[i].cpu, per_cpu_[i].leaf1_ebx, per_cpu_[i].x2apic_id);
+				}
+				ret += line;
+			}
+		}
+
+		return ret;
+	}
+
+	bool CPUIDDump::FromString(char const * text)
+	{
+		CPUIDDump dump;
+
+		char const * p = text;
+		while (*p != '\0')
+		{
+			char const * const eol = p + strcspn(p, "\n");
+			p += strspn(p, " \t\r");
+			if ((p < eol) && (*p != '#'))
+			{
+				uint64_t values[6];
+				if (0 == strncmp(p, "xcr0 ", 5))
+				{
+					p += 4;
+					if (!ParseHex(p, eol, values[0]) || !AtEol(p, eol))
+					{
+						return false;
+					}
+					dump.xcr0_ = values[0];
+				}
+				else if (0 == strncmp(p, "frequency ", 10))
+				{
+					p += 9;
+					if (!ParseNumber(p, eol, 10, values[0]) || (values[0] > UINT_MAX) || !AtEol(p, eol))
+					{
+						return false;
+					}
+					dump.frequency_ = static_cast<unsigned int>(values[0]);
+				}
+				else if (0 == strncmp(p, "cpu ", 4))
+				{
+					p += 3;
+					if (!ParseNumber(p, eol, 10, values[0]) || (values[0] >= static_cast<uint64_t>(MAX_DUMP_CPUS))
+						|| !ParseHex(p, eol, values[1]) || !ParseHex(p, eol, values[2]))
+					{
+						return false;
+					}
+
+					// Dumps of CPUs that aren't hybrid, and older dumps, have no leaf 0x1A
+					values[3] = 0;
+					if (!AtEol(p, eol) && (!ParseHex(p, eol, values[3]) || !AtEol(p, eol)))
+					{
+						return false;
+					}
+
+					PerCPULeaves leaves;
+					leaves.cpu = static_cast<int>(values[0]);
+					leaves.valid = true;
+					leaves.leaf1_ebx = static_cast<unsigned int>(values[1]);
+					leaves.x2apic_id = static_cast<unsigned int>(values[2]);
+					leaves.hybrid_info = static_cast<unsigned int>(values[3]);
+					dump.per_cpu_.push_back(leaves);
+				}
+				else
+				{
+					for (int i = 0; i < 6; ++ i)
+					{
+						if (!ParseHex(p, eol, values[i]))
+						{
+							return false;
+						}
+					}
+					if (!AtEol(p, eol))
+					{
+						return false;
+					}
+					unsigned int const regs[] = { static_cast<unsigned int>(values[2]), static_cast<unsigned int>(values[3]),
+						static_cast<unsigned int>(values[4]), static_cast<unsigned int>(values[5]) };
+					dump.SetResult(static_cast<unsigned int>(values[0]), static_cast<unsigned int>(values[1]), regs);
+				}
+			}
+
+			p = ('\0' == *eol) ? eol : eol + 1;
+		}
+
+		if (dump.Empty())
+		{
+			return false;
+		}
+		*this = dump;
+		return true;
+	}
+
+	bool CPUIDDump::Save(char const * path) const
+	{
+		FILE* fp = fopen(path, "w");
+		if (nullptr == fp)
+		{
+			return false;
+		}
+		std::string const text = this->ToString();
+		bool const ok = (text.size() == fwrite(text.c_str(), 1, text.size(), fp));
+		return (0 == fclose(fp)) && ok;
+	}
+
+	bool CPUIDDump::Load(char const * path)
+	{
+		FILE* fp = fopen(path, "rb");
+		if (nullptr == fp)
+		{
+			return false;
+		}
+		std::string text;
+		char buf[4096];
+		size_t n;
+		while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+		{
+			text.append(buf, n);
+		}
+		fclose(fp);
+
+		return this->FromString(text.c_str());
+	}
+}
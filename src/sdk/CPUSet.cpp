@@ -0,0 +1,721 @@
+/**
+ * @file CPUSet.cpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of CPUTSDK, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#include <CPU-T/CPUSet.hpp>
+#include "SDKUtil.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <string>
+
+#if defined CPUT_PLATFORM_WINDOWS
+#include <windows.h>
+#elif defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace
+{
+	int const BITS_PER_WORD = 64;
+
+	int LowestBit(std::uint64_t v)
+	{
+		int ret = 0;
+		while (!(v & 1))
+		{
+			v >>= 1;
+			++ ret;
+		}
+		return ret;
+	}
+
+	int PopCount(std::uint64_t v)
+	{
+		int ret = 0;
+		while (v)
+		{
+			v &= v - 1;
+			++ ret;
+		}
+		return ret;
+	}
+
+#if defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+	// The kernel rejects masks smaller than its own, so grow until it stops complaining.
+	template <typename Getter>
+	CPUT::CPUSet GetAffinity(Getter getter)
+	{
+		CPUT::CPUSet ret;
+		for (int num_cpus = 1024; num_cpus <= (1 << 20); num_cpus *= 2)
+		{
+			cpu_set_t* mask = CPU_ALLOC(num_cpus);
+			size_t const size = CPU_ALLOC_SIZE(num_cpus);
+			CPU_ZERO_S(size, mask);
+			int const err = getter(size, mask);
+			if (0 == err)
+			{
+				for (int i = 0; i < num_cpus; ++ i)
+				{
+					if (CPU_ISSET_S(i, size, mask))
+					{
+						ret.Set(i);
+					}
+				}
+			}
+			CPU_FREE(mask);
+			if (err != EINVAL)
+			{
+				break;
+			}
+		}
+		return ret;
+	}
+
+	template <typename Setter>
+	bool SetAffinity(CPUT::CPUSet const & cpus, Setter setter)
+	{
+		int last = -1;
+		for (int cpu = cpus.First(); cpu >= 0; cpu = cpus.Next(cpu))
+		{
+			last = cpu;
+		}
+		if (last < 0)
+		{
+			return false;
+		}
+
+		cpu_set_t* mask = CPU_ALLOC(last + 1);
+		size_t const size = CPU_ALLOC_SIZE(last + 1);
+		CPU_ZERO_S(size, mask);
+		for (int cpu = cpus.First(); cpu >= 0; cpu = cpus.Next(cpu))
+		{
+			CPU_SET_S(cpu, size, mask);
+		}
+		bool const ret = (0 == setter(size, mask));
+		CPU_FREE(mask);
+		return ret;
+	}
+#endif
+
+#if defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+	char const PROC_SELF_CGROUP[] = "/proc/self/cgroup";
+	char const PROC_SELF_MOUNTINFO[] = "/proc/self/mountinfo";
+
+	using CPUT::ReadFirstLine;
+
+	// Whether a comma-separated list, such as "rw,cpu,cpuacct", has the option.
+	bool HasOption(char const * list, char const * option)
+	{
+		size_t const len = strlen(option);
+		char const * p = list;
+		while (p != nullptr)
+		{
+			char const * end = strchr(p, ',');
+			size_t const n = end ? static_cast<size_t>(end - p) : strlen(p);
+			if ((n == len) && (0 == strncmp(p, option, len)))
+			{
+				return true;
+			}
+			p = end ? end + 1 : nullptr;
+		}
+		return false;
+	}
+
+	// Finds the directory of the process's cgroup in the hierarchy that has the controller, and where that
+	// hierarchy is mounted. A v1 hierarchy wins over the v2 one, since on hybrid systems a controller
+	// attached to v1 isn't available in v2.
+	bool FindCgroup(char const * controller, std::string& dir, std::string& mount_point, bool& v2)
+	{
+		FILE* fp = fopen(PROC_SELF_CGROUP, "r");
+		if (nullptr == fp)
+		{
+			return false;
+		}
+
+		// Lines like "4:cpu,cpuacct:/docker/1234" for v1, and "0::/user.slice" for v2
+		std::string v1_path;
+		std::string v2_path;
+		bool has_v1 = false;
+		bool has_v2 = false;
+		char line[4096];
+		while (fgets(line, sizeof(line), fp) != nullptr)
+		{
+			line[strcspn(line, "\r\n")] = '\0';
+			char* controllers = strchr(line, ':');
+			char* path = controllers ? strchr(controllers + 1, ':') : nullptr;
+			if (nullptr == path)
+			{
+				continue;
+			}
+			*controllers = '\0';
+			++ controllers;
+			*path = '\0';
+			++ path;
+
+			if ((0 == strcmp(line, "0")) && ('\0' == *controllers))
+			{
+				v2_path = path;
+				has_v2 = true;
+			}
+			else if (HasOption(controllers, controller))
+			{
+				v1_path = path;
+				has_v1 = true;
+			}
+		}
+		fclose(fp);
+		if (!has_v1 && !has_v2)
+		{
+			return false;
+		}
+
+		fp = fopen(PROC_SELF_MOUNTINFO, "r");
+		if (nullptr == fp)
+		{
+			return false;
+		}
+
+		// Lines like "35 32 0:31 / /sys/fs/cgroup/cpuset rw,relatime - cgroup cgroup rw,cpuset". A v1 hierarchy
+		// can be listed in /proc/self/cgroup without being mounted in a container, the cgroup2 mount is used then
+		std::string v1_root;
+		std::string v1_mount;
+		std::string v2_root;
+		std::string v2_mount;
+		while (v1_mount.empty() && (fgets(line, sizeof(line), fp) != nullptr))
+		{
+			char* sep = strstr(line, " - ");
+			if (nullptr == sep)
+			{
+				continue;
+			}
+			*sep = '\0';
+
+			char root[1024];
+			char mount[1024];
+			char fs_type[64];
+			char super_options[1024];
+			if ((sscanf(line, "%*s %*s %*s %1023s %1023s", root, mount) != 2)
+				|| (sscanf(sep + 3, "%63s %*s %1023s", fs_type, super_options) != 2))
+			{
+				continue;
+			}
+
+			if (has_v1 && (0 == strcmp(fs_type, "cgroup")) && HasOption(super_options, controller))
+			{
+				v1_root = root;
+				v1_mount = mount;
+			}
+			else if (has_v2 && v2_mount.empty() && (0 == strcmp(fs_type, "cgroup2")))
+			{
+				v2_root = root;
+				v2_mount = mount;
+			}
+		}
+		fclose(fp);
+
+		v2 = v1_mount.empty();
+		std::string const & root = v2 ? v2_root : v1_root;
+		std::string const & path = v2 ? v2_path : v1_path;
+		mount_point = v2 ? v2_mount : v1_mount;
+		if (mount_point.empty())
+		{
+			return false;
+		}
+
+		// The cgroup path is relative to the root of the hierarchy, while the mount may only show a subtree
+		// of it. Outside that subtree the mount itself is the closest place to look.
+		size_t const root_len = ("/" == root) ? 0 : root.size();
+		dir = mount_point;
+		if ((0 == path.compare(0, root_len, root, 0, root_len))
+			&& ((path.size() == root_len) || ('/' == path[root_len])))
+		{
+			dir += path.substr(root_len);
+		}
+		while ((dir.size() > mount_point.size()) && ('/' == dir[dir.size() - 1]))
+		{
+			dir.erase(dir.size() - 1);
+		}
+		return true;
+	}
+
+	// The CPUs the cgroup's cpuset allows. A cgroup without the controller enabled inherits its parent's.
+	bool CgroupCPUs(CPUT::CPUSet& cpus)
+	{
+		std::string dir;
+		std::string mount_point;
+		bool v2;
+		if (!FindCgroup("cpuset", dir, mount_point, v2))
+		{
+			return false;
+		}
+
+		char buf[4096];
+		for (;;)
+		{
+			if ((v2 && ReadFirstLine((dir + "/cpuset.cpus.effective").c_str(), buf, sizeof(buf)))
+				|| (!v2 && (ReadFirstLine((dir + "/cpuset.effective_cpus").c_str(), buf, sizeof(buf))
+					|| ReadFirstLine((dir + "/cpuset.cpus").c_str(), buf, sizeof(buf)))))
+			{
+				if ((buf[0] != '\0') && cpus.FromString(buf))
+				{
+					return true;
+				}
+			}
+
+			size_t const slash = dir.rfind('/');
+			if ((dir.size() <= mount_point.size()) || (std::string::npos == slash))
+			{
+				return false;
+			}
+			dir.erase(slash);
+		}
+	}
+
+	// CPUs worth of run time per period, the tightest of the quotas on the way up to the root. 0 if unlimited.
+	double CgroupQuota()
+	{
+		std::string dir;
+		std::string mount_point;
+		bool v2;
+		if (!FindCgroup("cpu", dir, mount_point, v2))
+		{
+			return 0;
+		}
+
+		double quota = 0;
+		char buf[128];
+		for (;;)
+		{
+			double level_quota = 0;
+			if (v2)
+			{
+				// "max 100000" when unlimited, otherwise "400000 100000"
+				if (ReadFirstLine((dir + "/cpu.max").c_str(), buf, sizeof(buf)) && (strncmp(buf, "max", 3) != 0))
+				{
+					char* end;
+					double const run_time = strtod(buf, &end);
+					double const period = strtod(end, nullptr);
+					if ((run_time > 0) && (period > 0))
+					{
+						level_quota = run_time / period;
+					}
+				}
+			}
+			else
+			{
+				// cpu.cfs_quota_us is -1 when unlimited
+				if (ReadFirstLine((dir + "/cpu.cfs_quota_us").c_str(), buf, sizeof(buf)))
+				{
+					double const run_time = strtod(buf, nullptr);
+					if ((run_time > 0) && ReadFirstLine((dir + "/cpu.cfs_period_us").c_str(), buf, sizeof(buf)))
+					{
+						double const period = strtod(buf, nullptr);
+						if (period > 0)
+						{
+							level_quota = run_time / period;
+						}
+					}
+				}
+			}
+			if ((level_quota > 0) && ((0 == quota) || (level_quota < quota)))
+			{
+				quota = level_quota;
+			}
+
+			size_t const slash = dir.rfind('/');
+			if ((dir.size() <= mount_point.size()) || (std::string::npos == slash))
+			{
+				break;
+			}
+			dir.erase(slash);
+		}
+		return quota;
+	}
+#endif
+
+#if defined CPUT_PLATFORM_WINDOWS
+	// Without processor group support only the first group is reachable, which covers 64 CPUs.
+	DWORD_PTR ToMask(CPUT::CPUSet const & cpus)
+	{
+		DWORD_PTR mask = 0;
+		for (int cpu = cpus.First(); (cpu >= 0) && (cpu < static_cast<int>(sizeof(DWORD_PTR) * 8)); cpu = cpus.Next(cpu))
+		{
+			mask |= static_cast<DWORD_PTR>(1) << cpu;
+		}
+		return mask;
+	}
+
+	CPUT::CPUSet FromMask(DWORD_PTR mask)
+	{
+		CPUT::CPUSet ret;
+		for (int cpu = 0; mask; ++ cpu, mask >>= 1)
+		{
+			if (mask & 1)
+			{
+				ret.Set(cpu);
+			}
+		}
+		return ret;
+	}
+#endif
+}
+
+namespace CPUT
+{
+	void CPUSet::Set(int cpu)
+	{
+		size_t const word = cpu / BITS_PER_WORD;
+		if (word >= bits_.size())
+		{
+			bits_.resize(word + 1, 0);
+		}
+		bits_[word] |= static_cast<std::uint64_t>(1) << (cpu % BITS_PER_WORD);
+	}
+
+	void CPUSet::Reset(int cpu)
+	{
+		size_t const word = cpu / BITS_PER_WORD;
+		if (word < bits_.size())
+		{
+			bits_[word] &= ~(static_cast<std::uint64_t>(1) << (cpu % BITS_PER_WORD));
+		}
+	}
+
+	bool CPUSet::Test(int cpu) const
+	{
+		size_t const word = cpu / BITS_PER_WORD;
+		return (cpu >= 0) && (word < bits_.size())
+			&& ((bits_[word] >> (cpu % BITS_PER_WORD)) & 1);
+	}
+
+	int CPUSet::Count() const
+	{
+		int ret = 0;
+		for (size_t i = 0; i < bits_.size(); ++ i)
+		{
+			ret += PopCount(bits_[i]);
+		}
+		return ret;
+	}
+
+	int CPUSet::Next(int cpu) const
+	{
+		++ cpu;
+		size_t word = cpu / BITS_PER_WORD;
+		if (word >= bits_.size())
+		{
+			return -1;
+		}
+
+		std::uint64_t bits = bits_[word] & (~static_cast<std::uint64_t>(0) << (cpu % BITS_PER_WORD));
+		while (0 == bits)
+		{
+			++ word;
+			if (word >= bits_.size())
+			{
+				return -1;
+			}
+			bits = bits_[word];
+		}
+		return static_cast<int>(word * BITS_PER_WORD) + LowestBit(bits);
+	}
+
+	int CPUSet::Nth(int n) const
+	{
+		int cpu = this->First();
+		for (; (cpu >= 0) && (n > 0); -- n)
+		{
+			cpu = this->Next(cpu);
+		}
+		return cpu;
+	}
+
+	CPUSet& CPUSet::operator|=(CPUSet const & rhs)
+	{
+		if (bits_.size() < rhs.bits_.size())
+		{
+			bits_.resize(rhs.bits_.size(), 0);
+		}
+		for (size_t i = 0; i < rhs.bits_.size(); ++ i)
+		{
+			bits_[i] |= rhs.bits_[i];
+		}
+		return *this;
+	}
+
+	CPUSet& CPUSet::operator&=(CPUSet const & rhs)
+	{
+		if (bits_.size() > rhs.bits_.size())
+		{
+			bits_.resize(rhs.bits_.size());
+		}
+		for (size_t i = 0; i < bits_.size(); ++ i)
+		{
+			bits_[i] &= rhs.bits_[i];
+		}
+		return *this;
+	}
+
+	CPUSet& CPUSet::operator-=(CPUSet const & rhs)
+	{
+		size_t const n = std::min(bits_.size(), rhs.bits_.size());
+		for (size_t i = 0; i < n; ++ i)
+		{
+			bits_[i] &= ~rhs.bits_[i];
+		}
+		return *this;
+	}
+
+	bool CPUSet::operator==(CPUSet const & rhs) const
+	{
+		size_t const n = std::max(bits_.size(), rhs.bits_.size());
+		for (size_t i = 0; i < n; ++ i)
+		{
+			std::uint64_t const l = (i < bits_.size()) ? bits_[i] : 0;
+			std::uint64_t const r = (i < rhs.bits_.size()) ? rhs.bits_[i] : 0;
+			if (l != r)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	std::string CPUSet::ToString() const
+	{
+		std::string ret;
+		char buf[32];
+		int cpu = this->First();
+		while (cpu >= 0)
+		{
+			int last = cpu;
+			int next = this->Next(cpu);
+			while (next == last + 1)
+			{
+				last = next;
+				next = this->Next(next);
+			}
+
+			if (!ret.empty())
+			{
+				ret += ',';
+			}
+			if (last == cpu)
+			{
+				sprintf(buf, "%d", cpu);
+			}
+			else
+			{
+				sprintf(buf, "%d-%d", cpu, last);
+			}
+			ret += buf;
+
+			cpu = next;
+		}
+		return ret;
+	}
+
+	bool CPUSet::FromString(char const * str)
+	{
+		this->Clear();
+
+		char const * p = str;
+		while (*p && (*p != '\n'))
+		{
+			char* end;
+			long const first = strtol(p, &end, 10);
+			if ((end == p) || (first < 0))
+			{
+				return false;
+			}
+			long last = first;
+			p = end;
+			if ('-' == *p)
+			{
+				++ p;
+				last = strtol(p, &end, 10);
+				if ((end == p) || (last < first))
+				{
+					return false;
+				}
+				p = end;
+			}
+
+			for (long cpu = first; cpu <= last; ++ cpu)
+			{
+				this->Set(static_cast<int>(cpu));
+			}
+
+			if (',' == *p)
+			{
+				++ p;
+			}
+			else if (*p && (*p != '\n'))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+
+	CPUSet ProcessAffinity()
+	{
+#if defined CPUT_PLATFORM_WINDOWS
+		DWORD_PTR process_affinity, system_affinity;
+		if (::GetProcessAffinityMask(::GetCurrentProcess(), &process_affinity, &system_affinity))
+		{
+			return FromMask(process_affinity);
+		}
+		return CPUSet();
+#elif defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+		pid_t const pid = getpid();
+		return GetAffinity([pid](size_t size, cpu_set_t* mask)
+			{
+				return (0 == sched_getaffinity(pid, size, mask)) ? 0 : errno;
+			});
+#else
+		return CPUSet();
+#endif
+	}
+
+	CPUSet ThreadAffinity()
+	{
+#if defined CPUT_PLATFORM_WINDOWS
+		// Windows has no getter. Setting the mask returns the old one, so set and restore.
+		HANDLE thread = ::GetCurrentThread();
+		DWORD_PTR process_affinity, system_affinity;
+		if (::GetProcessAffinityMask(::GetCurrentProcess(), &process_affinity, &system_affinity))
+		{
+			DWORD_PTR const old_affinity = ::SetThreadAffinityMask(thread, process_affinity);
+			if (old_affinity)
+			{
+				::SetThreadAffinityMask(thread, old_affinity);
+				return FromMask(old_affinity);
+			}
+		}
+		return CPUSet();
+#elif defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+		return GetAffinity([](size_t size, cpu_set_t* mask)
+			{
+				return (0 == sched_getaffinity(0, size, mask)) ? 0 : errno;
+			});
+#else
+		return CPUSet();
+#endif
+	}
+
+	int EffectiveCPUs::Parallelism() const
+	{
+		// The epsilon keeps a quota of exactly 4.0 from turning into 5 after rounding errors
+		return std::max(static_cast<int>(std::ceil(budget - 1e-6)), 1);
+	}
+
+	EffectiveCPUs QueryEffectiveCPUs()
+	{
+		EffectiveCPUs ret;
+		ret.cpus = ProcessAffinity();
+		ret.quota = 0;
+
+#if defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+		CPUSet cgroup_cpus;
+		if (CgroupCPUs(cgroup_cpus))
+		{
+			CPUSet const cpus = ret.cpus.Empty() ? cgroup_cpus : (ret.cpus & cgroup_cpus);
+			if (!cpus.Empty())
+			{
+				ret.cpus = cpus;
+			}
+		}
+		ret.quota = CgroupQuota();
+#elif defined(CPUT_PLATFORM_WINDOWS_DESKTOP) && (_WIN32_WINNT >= 0x0602 /*_WIN32_WINNT_WIN8*/)
+		// Only a hard cap limits the process. CpuRate is in 1/100 of a percent of the whole machine.
+		JOBOBJECT_CPU_RATE_CONTROL_INFORMATION rate;
+		if (::QueryInformationJobObject(nullptr, JobObjectCpuRateControlInformation, &rate, sizeof(rate), nullptr)
+			&& (rate.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_ENABLE) && (rate.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_HARD_CAP))
+		{
+			SYSTEM_INFO si;
+			::GetSystemInfo(&si);
+			ret.quota = rate.CpuRate / 10000.0 * si.dwNumberOfProcessors;
+		}
+#endif
+
+		if (ret.cpus.Empty())
+		{
+			// The OS wouldn't say. Assume every CPU.
+			unsigned int const num_cpus = std::max(std::thread::hardware_concurrency(), 1U);
+			for (unsigned int i = 0; i < num_cpus; ++ i)
+			{
+				ret.cpus.Set(static_cast<int>(i));
+			}
+		}
+
+		double const count = ret.cpus.Count();
+		ret.budget = (ret.quota > 0) ? std::min(count, ret.quota) : count;
+		return ret;
+	}
+
+	bool BindThread(CPUSet const & cpus)
+	{
+#if defined CPUT_PLATFORM_WINDOWS
+		DWORD_PTR const mask = ToMask(cpus);
+		return mask && (::SetThreadAffinityMask(::GetCurrentThread(), mask) != 0);
+#elif defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+		return SetAffinity(cpus, [](size_t size, cpu_set_t const * mask)
+			{
+				return sched_setaffinity(0, size, mask);
+			});
+#else
+		return false;
+#endif
+	}
+
+	bool BindThread(std::thread& thread, CPUSet const & cpus)
+	{
+#if defined CPUT_PLATFORM_WINDOWS
+		DWORD_PTR const mask = ToMask(cpus);
+		return mask && (::SetThreadAffinityMask(thread.native_handle(), mask) != 0);
+#elif defined(CPUT_PLATFORM_LINUX) && !defined(CPUT_PLATFORM_ANDROID)
+		pthread_t const handle = thread.native_handle();
+		return SetAffinity(cpus, [handle](size_t size, cpu_set_t const * mask)
+			{
+				return pthread_setaffinity_np(handle, size, mask);
+			});
+#else
+		return false;
+#endif
+	}
+}
@@ -0,0 +1,192 @@
+/**
+ * @file Clock.cpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of CPUTSDK, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#include <CPU-T/Clock.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <cstdint>
+
+namespace
+{
+	using std::uint32_t;
+	using std::uint64_t;
+
+	// Each block is a dependency chain of this many cycles on any x86 core since the P6,
+	// given a one-cycle add. The loop counter runs on another port and stays off the chain.
+#if (defined(CPUT_COMPILER_GCC) || (defined(CPUT_COMPILER_MSVC) && defined(CPUT_CPU_X86))) \
+	&& (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64))
+	uint32_t const CYCLES_PER_BLOCK = 64;
+#else
+	// The C fallback does an xor and an add per step.
+	uint32_t const CYCLES_PER_BLOCK = 64 * 2;
+#endif
+	uint32_t const BLOCKS_PER_CHECK = 4096;
+
+#if defined(CPUT_COMPILER_GCC)
+	#define CPUT_ADD_X4 "addl $1, %0\n\t" "addl $1, %0\n\t" "addl $1, %0\n\t" "addl $1, %0\n\t"
+	#define CPUT_ADD_X16 CPUT_ADD_X4 CPUT_ADD_X4 CPUT_ADD_X4 CPUT_ADD_X4
+#elif defined(CPUT_COMPILER_MSVC) && defined(CPUT_CPU_X86)
+	#define CPUT_ADD_X4 __asm add eax, 1 __asm add eax, 1 __asm add eax, 1 __asm add eax, 1
+	#define CPUT_ADD_X16 CPUT_ADD_X4 CPUT_ADD_X4 CPUT_ADD_X4 CPUT_ADD_X4
+#endif
+
+	uint32_t DependentChain(uint32_t x, uint32_t key, uint32_t blocks)
+	{
+		for (uint32_t i = 0; i < blocks; ++ i)
+		{
+#if defined(CPUT_COMPILER_GCC) && (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64))
+			__asm__ __volatile__
+			(
+				CPUT_ADD_X16 CPUT_ADD_X16 CPUT_ADD_X16 CPUT_ADD_X16
+				: "+r" (x)
+			);
+#elif defined(CPUT_COMPILER_MSVC) && defined(CPUT_CPU_X86)
+			__asm mov eax, x
+			CPUT_ADD_X16 CPUT_ADD_X16 CPUT_ADD_X16 CPUT_ADD_X16
+			__asm mov x, eax
+#else
+			// The compiler can't fold x + (x ^ key) since the key is only known at run time.
+			for (uint32_t j = 0; j < 64; ++ j)
+			{
+				x += x ^ key;
+			}
+#endif
+		}
+		return x ^ key;
+	}
+
+	// Runs the chain for warm_up_ms, then for duration_ms, and converts the work done in the second part to MHz.
+	unsigned int RunChain(unsigned int warm_up_ms, unsigned int duration_ms)
+	{
+		typedef std::chrono::steady_clock clock;
+
+		static std::atomic<uint32_t> key(0x9E3779B9);
+		uint32_t const k = key.load(std::memory_order_relaxed);
+		uint32_t x = k;
+
+		clock::time_point const warm_up_end = clock::now() + std::chrono::milliseconds(warm_up_ms);
+		while (clock::now() < warm_up_end)
+		{
+			x = DependentChain(x, k, BLOCKS_PER_CHECK);
+		}
+
+		uint64_t blocks = 0;
+		clock::time_point const start = clock::now();
+		clock::time_point const end = start + std::chrono::milliseconds(duration_ms);
+		clock::time_point now;
+		do
+		{
+			x = DependentChain(x, k, BLOCKS_PER_CHECK);
+			blocks += BLOCKS_PER_CHECK;
+			now = clock::now();
+		} while (now < end);
+
+		// Consumes the result so the chain isn't optimized away.
+		key.fetch_xor((0 == x) ? 1 : 0, std::memory_order_relaxed);
+
+		double const seconds = std::chrono::duration<double>(now - start).count();
+		return static_cast<unsigned int>(blocks * CYCLES_PER_BLOCK / seconds / 1000000 + 0.5);
+	}
+}
+
+namespace CPUT
+{
+	std::vector<CoreClock> MeasureCoreClocks(CPUSet const & cpus, bool simultaneous, unsigned int duration_ms)
+	{
+		std::vector<CoreClock> ret;
+		for (int cpu = cpus.First(); cpu >= 0; cpu = cpus.Next(cpu))
+		{
+			CoreClock clk;
+			clk.cpu = cpu;
+			clk.frequency = 0;
+			ret.push_back(clk);
+		}
+		if (ret.empty())
+		{
+			return ret;
+		}
+
+		unsigned int const warm_up_ms = duration_ms / 5;
+		if (simultaneous)
+		{
+			// All threads pin themselves, then wait for the others so the load is applied at the same time.
+			std::atomic<int> ready(0);
+			int const num_threads = static_cast<int>(ret.size());
+
+			std::vector<std::thread> threads;
+			threads.reserve(ret.size());
+			for (size_t i = 0; i < ret.size(); ++ i)
+			{
+				CoreClock* clk = &ret[i];
+				threads.push_back(std::thread([clk, &ready, num_threads, warm_up_ms, duration_ms]
+					{
+						bool const bound = BindThread(CPUSet(clk->cpu));
+						ready.fetch_add(1);
+						while (ready.load() < num_threads)
+						{
+							std::this_thread::yield();
+						}
+						if (bound)
+						{
+							clk->frequency = RunChain(warm_up_ms, duration_ms);
+						}
+					}));
+			}
+			for (size_t i = 0; i < threads.size(); ++ i)
+			{
+				threads[i].join();
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i < ret.size(); ++ i)
+			{
+				CoreClock* clk = &ret[i];
+				std::thread([clk, warm_up_ms, duration_ms]
+					{
+						if (BindThread(CPUSet(clk->cpu)))
+						{
+							clk->frequency = RunChain(warm_up_ms, duration_ms);
+						}
+					}).join();
+			}
+		}
+
+		return ret;
+	}
+
+	unsigned int MeasureCoreClock(int cpu, unsigned int duration_ms)
+	{
+		return MeasureCoreClocks(CPUSet(cpu), false, duration_ms)[0].frequency;
+	}
+}
@@ -0,0 +1,294 @@
+/**
+ * @file Collective.cpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of CPUTSDK, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#include <CPU-T/Collective.hpp>
+
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <new>
+#include <thread>
+
+#if defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+	// Spins before each wait starts yielding, in case the participants outnumber the CPUs
+	int const SPIN_LIMIT = 1024;
+	size_t const ARENA_CHUNK_SIZE = 64 * 1024;
+
+	// Keys of the levels a participant is grouped by, -1 if unknown
+	enum
+	{
+		KL_Core,
+		KL_Domain,
+		KL_Package,
+		KL_Root,
+
+		KL_NumLevels
+	};
+
+	struct TreeItem
+	{
+		long long keys[KL_NumLevels];
+		int index;				// Into the participants, or into the groups
+		bool group;
+	};
+
+	void Pause()
+	{
+#if defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)
+		_mm_pause();
+#endif
+	}
+}
+
+namespace CPUT
+{
+	Collective::Collective(CPUInfo const & cpu, PlacementAdvisor::Plan const & plan, size_t max_value_size)
+		: value_size_((std::max<size_t>(max_value_size, 1) + 15) / 16 * 16), levels_(0)
+	{
+		assert(!plan.workers.empty());
+
+		std::vector<CPUInfo::CacheLevelInfo> const & caches = cpu.Caches();
+		CPUInfo::CacheLevelInfo const * llc = nullptr;
+		for (size_t i = 0; i < caches.size(); ++ i)
+		{
+			if ((caches[i].type != CPUInfo::CT_Code) && !caches[i].instances.empty()
+				&& ((nullptr == llc) || (caches[i].level > llc->level)))
+			{
+				llc = &caches[i];
+			}
+		}
+
+		std::vector<TreeItem> items(plan.workers.size());
+		for (size_t i = 0; i < plan.workers.size(); ++ i)
+		{
+			TreeItem& item = items[i];
+			item.index = static_cast<int>(i);
+			item.group = false;
+			for (int l = 0; l < KL_NumLevels; ++ l)
+			{
+				item.keys[l] = -1;
+			}
+			item.keys[KL_Root] = 0;
+
+			int const os_index = plan.workers[i].cpu;
+			CPUInfo::LogicalProcessorInfo const * lp = (os_index >= 0) ? cpu.FindLogicalProcessor(os_index) : nullptr;
+			if (lp != nullptr)
+			{
+				item.keys[KL_Core] = (static_cast<long long>(lp->package) << 40) | (static_cast<long long>(lp->die) << 20) | lp->core;
+				item.keys[KL_Package] = lp->package;
+			}
+			if ((llc != nullptr) && (os_index >= 0))
+			{
+				for (size_t j = 0; j < llc->instances.size(); ++ j)
+				{
+					if (llc->instances[j].Test(os_index))
+					{
+						item.keys[KL_Domain] = static_cast<long long>(j);
+						break;
+					}
+				}
+			}
+		}
+
+		// Bottom up. Members of a level sharing a known key become a group, a lone member moves up as it is.
+		// The group's NUMA node is the node of its first participant
+		participants_.resize(plan.workers.size());
+		std::vector<int> group_nodes;
+		for (int level = 0; level < KL_NumLevels; ++ level)
+		{
+			std::map<long long, std::vector<TreeItem> > partitions;
+			std::vector<TreeItem> next;
+			for (size_t i = 0; i < items.size(); ++ i)
+			{
+				if ((items[i].keys[level] < 0) && (level != KL_Root))
+				{
+					next.push_back(items[i]);
+				}
+				else
+				{
+					partitions[items[i].keys[level]].push_back(items[i]);
+				}
+			}
+
+			bool formed = false;
+			for (auto iter = partitions.begin(); iter != partitions.end(); ++ iter)
+			{
+				std::vector<TreeItem> const & members = iter->second;
+				if ((1 == members.size()) && ((level != KL_Root) || members[0].group))
+				{
+					next.push_back(members[0]);
+					continue;
+				}
+
+				Group group;
+				group.arrive = nullptr;
+				group.release = nullptr;
+				group.children = static_cast<int>(members.size());
+				group.parent = -1;
+				group.parent_slot = -1;
+				int const index = static_cast<int>(groups_.size());
+				for (int slot = 0; slot < group.children; ++ slot)
+				{
+					if (members[slot].group)
+					{
+						groups_[members[slot].index].parent = index;
+						groups_[members[slot].index].parent_slot = slot;
+					}
+					else
+					{
+						participants_[members[slot].index].group = index;
+						participants_[members[slot].index].slot = slot;
+					}
+				}
+				groups_.push_back(group);
+				group_nodes.push_back(members[0].group ? group_nodes[members[0].index] : plan.workers[members[0].index].node);
+
+				TreeItem item = members[0];
+				item.index = index;
+				item.group = true;
+				next.push_back(item);
+				formed = true;
+			}
+			if (formed)
+			{
+				++ levels_;
+			}
+			items.swap(next);
+		}
+
+		// Each block on its own lines, on its node
+		std::vector<CPUInfo::NumaNodeInfo> const & nodes = cpu.NumaNodes();
+		arenas_.resize(nodes.size() + 1);
+		auto arena_of = [this, &cpu, &nodes](int node) -> NumaArena&
+		{
+			size_t const slot = ((node >= 0) && (node < static_cast<int>(nodes.size()))) ? node : nodes.size();
+			if (!arenas_[slot])
+			{
+				arenas_[slot].reset(new NumaArena(cpu, (slot < nodes.size()) ? static_cast<int>(slot) : -1, ARENA_CHUNK_SIZE));
+			}
+			return *arenas_[slot];
+		};
+		for (size_t i = 0; i < groups_.size(); ++ i)
+		{
+			NumaArena& arena = arena_of(group_nodes[i]);
+			Group& group = groups_[i];
+			group.arrive = static_cast<char*>(arena.Allocate(VALUE_OFFSET + group.children * value_size_));
+			group.release = static_cast<char*>(arena.Allocate(VALUE_OFFSET + value_size_));
+			new (group.arrive) std::atomic<std::uint32_t>(0);
+			new (group.release) std::atomic<std::uint32_t>(0);
+		}
+		for (size_t i = 0; i < participants_.size(); ++ i)
+		{
+			participants_[i].generation = arena_of(plan.workers[i].node).Allocate<std::uint32_t>();
+			*participants_[i].generation = 0;
+		}
+	}
+
+	void Collective::Combine(int participant, void const * value, void* result, size_t size, CombineFunc func, void* context)
+	{
+		Participant const & self = participants_[participant];
+		std::uint32_t const generation = ++ *self.generation;
+
+		int index = self.group;
+		if (size != 0)
+		{
+			memcpy(this->Slot(groups_[index], self.slot), value, size);
+		}
+
+		// Up, for as long as this participant is the last to arrive
+		int climbed[KL_NumLevels];
+		int num_climbed = 0;
+		char const * total;
+		for (;;)
+		{
+			Group const & group = groups_[index];
+			if (this->Arrivals(group).fetch_add(1, std::memory_order_acq_rel) + 1 < static_cast<std::uint32_t>(group.children))
+			{
+				std::atomic<std::uint32_t> const & released = this->Generation(group);
+				for (int spins = 0; released.load(std::memory_order_acquire) != generation; ++ spins)
+				{
+					if (spins < SPIN_LIMIT)
+					{
+						Pause();
+					}
+					else
+					{
+						std::this_thread::yield();
+					}
+				}
+				total = this->Result(group);
+				break;
+			}
+
+			// Nobody arrives here again before the release below
+			this->Arrivals(group).store(0, std::memory_order_relaxed);
+
+			char* acc = (group.parent >= 0) ? this->Slot(groups_[group.parent], group.parent_slot) : this->Result(group);
+			if (size != 0)
+			{
+				memcpy(acc, this->Slot(group, 0), size);
+				for (int slot = 1; slot < group.children; ++ slot)
+				{
+					func(acc, this->Slot(group, slot), context);
+				}
+			}
+
+			climbed[num_climbed] = index;
+			++ num_climbed;
+			if (group.parent < 0)
+			{
+				total = acc;
+				break;
+			}
+			index = group.parent;
+		}
+
+		// Down, releasing the groups carried up, top first
+		for (int i = num_climbed - 1; i >= 0; -- i)
+		{
+			Group const & group = groups_[climbed[i]];
+			if ((size != 0) && (this->Result(group) != total))
+			{
+				memcpy(this->Result(group), total, size);
+			}
+			this->Generation(group).store(generation, std::memory_order_release);
+		}
+
+		if (size != 0)
+		{
+			memcpy(result, total, size);
+		}
+	}
+}
@@ -0,0 +1,392 @@
+/**
+ * @file HugePage.cpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of CPUTSDK, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#include <CPU-T/HugePage.hpp>
+#include "SDKUtil.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <string>
+
+#if defined CPUT_PLATFORM_WINDOWS
+#include <windows.h>
+#elif defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+#include <dirent.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	using CPUT::uint64;
+
+	uint64 const TWO_MB = 2ULL << 20;
+
+#if defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+	using CPUT::ReadFirstLine;
+
+	uint64 ReadNumber(char const * path)
+	{
+		char buf[64];
+		return ReadFirstLine(path, buf, sizeof(buf)) ? strtoull(buf, nullptr, 10) : 0;
+	}
+#endif
+
+	// By page size. At the same size hugetlb comes before THP, Advise() takes the first pool that can back the
+	// working set, and reserved pages are guaranteed where THP is best effort.
+	bool PoolLess(CPUT::HugePageAdvisor::PoolInfo const & lhs, CPUT::HugePageAdvisor::PoolInfo const & rhs)
+	{
+		return (lhs.page_size < rhs.page_size) || ((lhs.page_size == rhs.page_size) && (lhs.source > rhs.source));
+	}
+}
+
+namespace CPUT
+{
+	HugePageAdvisor::HugePageAdvisor(CPUInfo const & cpu)
+		: cpu_(cpu), base_page_size_(4096)
+	{
+#if defined CPUT_PLATFORM_WINDOWS
+		SYSTEM_INFO si;
+		::GetSystemInfo(&si);
+		base_page_size_ = si.dwPageSize;
+#elif defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+		long const page_size = sysconf(_SC_PAGESIZE);
+		if (page_size > 0)
+		{
+			base_page_size_ = page_size;
+		}
+#endif
+
+		this->Refresh();
+	}
+
+	void HugePageAdvisor::Refresh()
+	{
+		pools_.clear();
+
+#if defined CPUT_PLATFORM_WINDOWS_DESKTOP
+		// The OS doesn't tell how many large pages are left, Allocate() finds out.
+		SIZE_T const large_page_size = ::GetLargePageMinimum();
+		if (large_page_size != 0)
+		{
+			PoolInfo pool = { large_page_size, PS_HugeTLB, ~0ULL, ~0ULL };
+			pools_.push_back(pool);
+		}
+#elif defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+		// One directory per size, hugepages-<size>kB
+		DIR* dir = opendir("/sys/kernel/mm/hugepages");
+		if (dir != nullptr)
+		{
+			while (dirent* entry = readdir(dir))
+			{
+				unsigned long long size_kb;
+				if (1 == sscanf(entry->d_name, "hugepages-%llukB", &size_kb))
+				{
+					std::string const path = std::string("/sys/kernel/mm/hugepages/") + entry->d_name;
+					PoolInfo pool;
+					pool.page_size = size_kb * 1024;
+					pool.source = PS_HugeTLB;
+					pool.total_pages = ReadNumber((path + "/nr_hugepages").c_str());
+					pool.free_pages = ReadNumber((path + "/free_hugepages").c_str());
+					pools_.push_back(pool);
+				}
+			}
+			closedir(dir);
+		}
+
+		// "always [madvise] never", the selected mode in brackets. Both always and madvise honor MADV_HUGEPAGE.
+		char buf[256];
+		if (ReadFirstLine("/sys/kernel/mm/transparent_hugepage/enabled", buf, sizeof(buf))
+			&& (nullptr == strstr(buf, "[never]")))
+		{
+			PoolInfo pool;
+			pool.page_size = ReadNumber("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size");
+			if (0 == pool.page_size)
+			{
+				pool.page_size = TWO_MB;
+			}
+			pool.source = PS_Transparent;
+			pool.total_pages = 0;
+			pool.free_pages = 0;
+			pools_.push_back(pool);
+		}
+#endif
+
+		std::sort(pools_.begin(), pools_.end(), PoolLess);
+	}
+
+	uint64 HugePageAdvisor::TLBReach(uint64 page_size) const
+	{
+		if (cpu_.TLBs().empty())
+		{
+			// Hypervisors often hide the TLB leaves. Assumes a 1536-entry STLB shared by 4K and 2M pages
+			// and 16 1G entries, as on most x86 server cores of the last decade.
+			if ((4096 == page_size) || (TWO_MB == page_size))
+			{
+				return page_size * 1536;
+			}
+			else if ((1ULL << 30) == page_size)
+			{
+				return page_size * 16;
+			}
+			else
+			{
+				return 0;
+			}
+		}
+		else
+		{
+			return cpu_.TLBReach(page_size);
+		}
+	}
+
+	HugePageAdvisor::Advice HugePageAdvisor::Advise(uint64 working_set, AccessPattern pattern) const
+	{
+		Advice advice;
+
+		std::vector<uint64> page_sizes(1, base_page_size_);
+		for (size_t i = 0; i < pools_.size(); ++ i)
+		{
+			page_sizes.push_back(pools_[i].page_size);
+		}
+		for (size_t i = 0; i < cpu_.TLBs().size(); ++ i)
+		{
+			for (int shift = 0; shift < 64; ++ shift)
+			{
+				if ((cpu_.TLBs()[i].page_sizes >> shift) & 1)
+				{
+					page_sizes.push_back(1ULL << shift);
+				}
+			}
+		}
+		std::sort(page_sizes.begin(), page_sizes.end());
+		page_sizes.erase(std::unique(page_sizes.begin(), page_sizes.end()), page_sizes.end());
+		page_sizes.erase(std::remove_if(page_sizes.begin(), page_sizes.end(),
+			[this](uint64 page_size) { return page_size < base_page_size_; }), page_sizes.end());
+
+		uint64 thp_size = 0;
+		for (size_t i = 0; i < pools_.size(); ++ i)
+		{
+			if (PS_Transparent == pools_[i].source)
+			{
+				thp_size = pools_[i].page_size;
+			}
+		}
+		uint64 const max_sequential_size = std::max(thp_size, TWO_MB);
+
+		advice.page_size = base_page_size_;
+		advice.source = PS_Base;
+		advice.coverage = -1;
+		for (size_t i = 0; i < page_sizes.size(); ++ i)
+		{
+			Coverage cov;
+			cov.page_size = page_sizes[i];
+			cov.tlb_reach = this->TLBReach(cov.page_size);
+			cov.coverage = (0 == working_set) ? 1.0f
+				: static_cast<float>(std::min(static_cast<double>(cov.tlb_reach) / working_set, 1.0));
+
+			PageSource source = PS_Base;
+			cov.offered = (cov.page_size == base_page_size_);
+			for (size_t j = 0; (j < pools_.size()) && !cov.offered; ++ j)
+			{
+				PoolInfo const & pool = pools_[j];
+				if (pool.page_size == cov.page_size)
+				{
+					if (PS_HugeTLB == pool.source)
+					{
+						if ((~0ULL == pool.free_pages)
+							|| (pool.free_pages >= RoundUp<uint64>(working_set, pool.page_size) / pool.page_size))
+						{
+							cov.offered = true;
+							source = PS_HugeTLB;
+						}
+					}
+					else
+					{
+						cov.offered = true;
+						source = PS_Transparent;
+					}
+				}
+			}
+			advice.coverages.push_back(cov);
+
+			bool candidate = cov.offered;
+			if (AP_Sequential == pattern)
+			{
+				candidate &= (cov.page_size <= max_sequential_size);
+			}
+			// Smallest page size with the most coverage. Coverage saturates at 1, so a larger page size
+			// only wins if the smaller ones don't cover the working set.
+			if (candidate && (cov.coverage > advice.coverage))
+			{
+				advice.page_size = cov.page_size;
+				advice.source = source;
+				advice.coverage = cov.coverage;
+			}
+		}
+
+		return advice;
+	}
+
+	bool HugePageAdvisor::Allocate(Block& block, size_t size, Advice const & advice) const
+	{
+		block.ptr = nullptr;
+		block.size = 0;
+		block.page_size = 0;
+		block.source = PS_Base;
+
+#if defined CPUT_PLATFORM_WINDOWS_DESKTOP
+		if (PS_HugeTLB == advice.source)
+		{
+			// Needs SeLockMemoryPrivilege
+			size_t const rounded = static_cast<size_t>(RoundUp<uint64>(size, advice.page_size));
+			block.ptr = ::VirtualAlloc(nullptr, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (block.ptr != nullptr)
+			{
+				block.size = rounded;
+				block.page_size = advice.page_size;
+				block.source = PS_HugeTLB;
+				return true;
+			}
+		}
+
+		size_t const rounded = static_cast<size_t>(RoundUp<uint64>(size, base_page_size_));
+		block.ptr = ::VirtualAlloc(nullptr, rounded, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		if (block.ptr != nullptr)
+		{
+			block.size = rounded;
+			block.page_size = base_page_size_;
+			return true;
+		}
+		return false;
+#elif defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+		if (PS_HugeTLB == advice.source)
+		{
+			int shift = 0;
+			while ((1ULL << shift) < advice.page_size)
+			{
+				++ shift;
+			}
+
+			size_t const rounded = static_cast<size_t>(RoundUp<uint64>(size, advice.page_size));
+			void* p = mmap(nullptr, rounded, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (shift << MAP_HUGE_SHIFT), -1, 0);
+			if (p != MAP_FAILED)
+			{
+				block.ptr = p;
+				block.size = rounded;
+				block.page_size = advice.page_size;
+				block.source = PS_HugeTLB;
+				return true;
+			}
+		}
+#endif
+
+#ifdef MADV_HUGEPAGE
+		if (advice.page_size > base_page_size_)
+		{
+			for (size_t i = 0; i < pools_.size(); ++ i)
+			{
+				if (PS_Transparent == pools_[i].source)
+				{
+					// Only ranges aligned to the huge page size can be backed by huge pages, so maps one
+					// page more and trims both ends.
+					size_t const thp_size = static_cast<size_t>(pools_[i].page_size);
+					size_t const rounded = static_cast<size_t>(RoundUp<uint64>(size, thp_size));
+					void* p = mmap(nullptr, rounded + thp_size, PROT_READ | PROT_WRITE,
+						MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+					if (p != MAP_FAILED)
+					{
+						char* const start = static_cast<char*>(p);
+						char* const aligned = reinterpret_cast<char*>(RoundUp<size_t>(reinterpret_cast<size_t>(start), thp_size));
+						if (aligned != start)
+						{
+							munmap(start, aligned - start);
+						}
+						if (start + thp_size != aligned)
+						{
+							munmap(aligned + rounded, start + thp_size - aligned);
+						}
+						madvise(aligned, rounded, MADV_HUGEPAGE);
+
+						block.ptr = aligned;
+						block.size = rounded;
+						block.page_size = thp_size;
+						block.source = PS_Transparent;
+						return true;
+					}
+					break;
+				}
+			}
+		}
+#endif
+
+		size_t const rounded = static_cast<size_t>(RoundUp<uint64>(size, base_page_size_));
+		void* p = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p != MAP_FAILED)
+		{
+			block.ptr = p;
+			block.size = rounded;
+			block.page_size = base_page_size_;
+			return true;
+		}
+		return false;
+#else
+		size_t const rounded = static_cast<size_t>(RoundUp<uint64>(size, base_page_size_));
+		block.ptr = malloc(rounded);
+		if (block.ptr != nullptr)
+		{
+			block.size = rounded;
+			block.page_size = base_page_size_;
+			return true;
+		}
+		return false;
+#endif
+	}
+
+	void HugePageAdvisor::Free(Block& block) const
+	{
+		if (block.ptr != nullptr)
+		{
+#if defined CPUT_PLATFORM_WINDOWS_DESKTOP
+			::VirtualFree(block.ptr, 0, MEM_RELEASE);
+#elif defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+			munmap(block.ptr, block.size);
+#else
+			free(block.ptr);
+#endif
+			block.ptr = nullptr;
+			block.size = 0;
+		}
+	}
+}
@@ -0,0 +1,316 @@
+/**
+ * @file NumaArena.cpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of CPUTSDK, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#include <CPU-T/NumaArena.hpp>
+#include "SDKUtil.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <system_error>
+#include <thread>
+
+#if defined CPUT_PLATFORM_WINDOWS
+#include <windows.h>
+#elif defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// Faults every page in, so first touch places it on the node of the CPU running this.
+	void TouchPages(char* ptr, size_t size, size_t page_size)
+	{
+		volatile char* p = ptr;
+		for (size_t i = 0; i < size; i += page_size)
+		{
+			p[i] = 0;
+		}
+	}
+
+#if defined(CPUT_PLATFORM_LINUX) && defined(__NR_mbind)
+	// From linux/mempolicy.h. The node is preferred, allocations fall back to other nodes when it's full
+	int const LINUX_MPOL_PREFERRED = 1;
+
+	// glibc has no wrapper, and libnuma isn't worth a dependency for one call.
+	bool BindToNode(void* ptr, size_t size, int node_id)
+	{
+		size_t const bits = sizeof(unsigned long) * 8;
+		std::vector<unsigned long> mask(node_id / bits + 1, 0);
+		mask[node_id / bits] |= 1UL << (node_id % bits);
+		// The kernel reads maxnode - 1 bits
+		return 0 == syscall(__NR_mbind, ptr, size, LINUX_MPOL_PREFERRED, &mask[0], mask.size() * bits + 1, 0);
+	}
+#endif
+}
+
+namespace CPUT
+{
+	NumaArena::NumaArena(CPUInfo const & cpu, int node, size_t chunk_size)
+		: node_(node), node_id_(-1), line_size_(64), page_size_(4096), bound_(false),
+			offset_(0), used_(0)
+	{
+		std::vector<CPUInfo::NumaNodeInfo> const & nodes = cpu.NumaNodes();
+		if ((node >= 0) && (node < static_cast<int>(nodes.size())) && (nodes.size() > 1))
+		{
+			node_id_ = nodes[node].id;
+			node_cpus_ = nodes[node].cpus;
+			bound_ = true;
+		}
+
+		if (cpu.L1DataCache().line > 0)
+		{
+			line_size_ = cpu.L1DataCache().line;
+		}
+
+#if defined CPUT_PLATFORM_WINDOWS
+		SYSTEM_INFO si;
+		::GetSystemInfo(&si);
+		page_size_ = si.dwPageSize;
+#elif defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+		long const page_size = sysconf(_SC_PAGESIZE);
+		if (page_size > 0)
+		{
+			page_size_ = page_size;
+		}
+#endif
+
+		chunk_size_ = RoundUp(std::max(chunk_size, page_size_), page_size_);
+	}
+
+	NumaArena::~NumaArena()
+	{
+		for (size_t i = 0; i < chunks_.size(); ++ i)
+		{
+			this->UnmapChunk(chunks_[i]);
+		}
+	}
+
+	void* NumaArena::Allocate(size_t size, size_t alignment)
+	{
+		assert((0 == (alignment & (alignment - 1))) && "The alignment must be a power of 2");
+
+		alignment = std::max(alignment, line_size_);
+		size_t const padding = (alignment > page_size_) ? alignment : 0;
+
+		// Rounding a size near SIZE_MAX up would wrap it to a tiny block
+		if ((size > SIZE_MAX - line_size_) || (padding > SIZE_MAX - page_size_))
+		{
+			return nullptr;
+		}
+		size = RoundUp(std::max<size_t>(size, 1), line_size_);
+		if (size > SIZE_MAX - page_size_ - padding)
+		{
+			return nullptr;
+		}
+
+		if (!chunks_.empty() && (alignment <= chunks_.back().size))
+		{
+			Chunk const & chunk = chunks_.back();
+			size_t const base = reinterpret_cast<size_t>(chunk.ptr);
+			size_t const start = RoundUp(base + offset_, alignment) - base;
+			if ((start <= chunk.size) && (size <= chunk.size - start))
+			{
+				used_ += start + size - offset_;
+				offset_ = start + size;
+				return chunk.ptr + start;
+			}
+		}
+
+		Chunk chunk;
+		if (size + padding > chunk_size_ / 4)
+		{
+			// A chunk of its own, slipped in before the one being carved
+			if (!this->MapChunk(chunk, size + padding))
+			{
+				return nullptr;
+			}
+			used_ += chunk.size;
+			chunks_.insert(chunks_.empty() ? chunks_.end() : chunks_.end() - 1, chunk);
+			if (1 == chunks_.size())
+			{
+				offset_ = chunk.size;
+			}
+			return reinterpret_cast<char*>(RoundUp(reinterpret_cast<size_t>(chunk.ptr), alignment));
+		}
+
+		if (!this->MapChunk(chunk, chunk_size_))
+		{
+			return nullptr;
+		}
+		chunks_.push_back(chunk);
+		offset_ = 0;
+		return this->Allocate(size, alignment);
+	}
+
+	void NumaArena::Reset()
+	{
+		std::vector<Chunk> kept;
+		for (size_t i = 0; i < chunks_.size(); ++ i)
+		{
+			if (kept.empty() && (chunks_[i].size == chunk_size_))
+			{
+				kept.push_back(chunks_[i]);
+			}
+			else
+			{
+				this->UnmapChunk(chunks_[i]);
+			}
+		}
+		chunks_.swap(kept);
+		offset_ = 0;
+		used_ = 0;
+	}
+
+	size_t NumaArena::Reserved() const
+	{
+		size_t ret = 0;
+		for (size_t i = 0; i < chunks_.size(); ++ i)
+		{
+			ret += chunks_[i].size;
+		}
+		return ret;
+	}
+
+	bool NumaArena::MapChunk(Chunk& chunk, size_t size)
+	{
+		size = RoundUp(size, page_size_);
+		chunk.ptr = nullptr;
+		chunk.size = size;
+
+		bool bound = false;
+#if defined CPUT_PLATFORM_WINDOWS_DESKTOP
+		if (node_id_ >= 0)
+		{
+			chunk.ptr = static_cast<char*>(::VirtualAllocExNuma(::GetCurrentProcess(), nullptr, size,
+				MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, static_cast<DWORD>(node_id_)));
+			bound = (chunk.ptr != nullptr);
+		}
+		if (nullptr == chunk.ptr)
+		{
+			chunk.ptr = static_cast<char*>(::VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+		}
+#elif defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+		void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p != MAP_FAILED)
+		{
+			chunk.ptr = static_cast<char*>(p);
+#if defined(CPUT_PLATFORM_LINUX) && defined(__NR_mbind)
+			if (node_id_ >= 0)
+			{
+				// Seccomp profiles of containers often refuse mbind
+				bound = BindToNode(p, size, node_id_);
+			}
+#endif
+		}
+#else
+		chunk.ptr = static_cast<char*>(malloc(size));
+#endif
+		if (nullptr == chunk.ptr)
+		{
+			return false;
+		}
+
+		if ((node_id_ >= 0) && !bound)
+		{
+			bound_ = false;
+
+			CPUSet const affinity = ThreadAffinity();
+			if (affinity.Empty() || !(affinity - node_cpus_).Empty())
+			{
+				bool touched = false;
+				try
+				{
+					std::thread([this, &chunk, &touched]
+						{
+							if (BindThread(node_cpus_))
+							{
+								TouchPages(chunk.ptr, chunk.size, page_size_);
+								touched = true;
+							}
+						}).join();
+				}
+				catch (std::system_error const &)
+				{
+				}
+				if (!touched)
+				{
+					TouchPages(chunk.ptr, chunk.size, page_size_);
+				}
+			}
+			else
+			{
+				TouchPages(chunk.ptr, chunk.size, page_size_);
+			}
+		}
+		return true;
+	}
+
+	void NumaArena::UnmapChunk(Chunk& chunk)
+	{
+#if defined CPUT_PLATFORM_WINDOWS_DESKTOP
+		::VirtualFree(chunk.ptr, 0, MEM_RELEASE);
+#elif defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+		munmap(chunk.ptr, chunk.size);
+#else
+		free(chunk.ptr);
+#endif
+		chunk.ptr = nullptr;
+		chunk.size = 0;
+	}
+
+
+	WorkerArenas::WorkerArenas(ThreadPool const & pool, CPUInfo const & cpu, size_t chunk_size)
+		: pool_(pool)
+	{
+		PlacementAdvisor::Plan const & plan = pool.Placement();
+		for (size_t i = 0; i < plan.workers.size(); ++ i)
+		{
+			arenas_.push_back(std::unique_ptr<NumaArena>(new NumaArena(cpu, plan.workers[i].node, chunk_size)));
+		}
+	}
+
+	NumaArena* WorkerArenas::Local()
+	{
+		int const worker = pool_.CurrentWorker();
+		return (worker >= 0) ? arenas_[worker].get() : nullptr;
+	}
+
+	void WorkerArenas::Reset()
+	{
+		for (size_t i = 0; i < arenas_.size(); ++ i)
+		{
+			arenas_[i]->Reset();
+		}
+	}
+}
@@ -0,0 +1,392 @@
+/**
+ * @file Placement.cpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of CPUTSDK, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#include <CPU-T/Placement.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+namespace
+{
+	// Takes one element of each list in turn, skipping the lists that ran out.
+	std::vector<std::pair<int, int> > Interleave(std::vector<std::vector<std::pair<int, int> > > const & lists)
+	{
+		std::vector<std::pair<int, int> > ret;
+		for (size_t i = 0; ; ++ i)
+		{
+			bool taken = false;
+			for (size_t j = 0; j < lists.size(); ++ j)
+			{
+				if (i < lists[j].size())
+				{
+					ret.push_back(lists[j][i]);
+					taken = true;
+				}
+			}
+			if (!taken)
+			{
+				break;
+			}
+		}
+		return ret;
+	}
+}
+
+namespace CPUT
+{
+	PlacementAdvisor::PlacementAdvisor(CPUInfo const & cpu)
+		: cpu_(cpu), core0_(-1)
+	{
+		this->Build(QueryEffectiveCPUs().cpus);
+	}
+
+	PlacementAdvisor::PlacementAdvisor(CPUInfo const & cpu, CPUSet const & allowed)
+		: cpu_(cpu), core0_(-1)
+	{
+		this->Build(allowed);
+	}
+
+	void PlacementAdvisor::Build(CPUSet const & allowed)
+	{
+		std::vector<CPUInfo::LogicalProcessorInfo> const & lps = cpu_.LogicalProcessors();
+		std::vector<CPUInfo::PackageInfo> const & packages = cpu_.Packages();
+		std::vector<CPUInfo::NumaNodeInfo> const & nodes = cpu_.NumaNodes();
+
+		CPUSet known;
+		for (size_t i = 0; i < lps.size(); ++ i)
+		{
+			known.Set(lps[i].os_index);
+		}
+		if (known.Empty())
+		{
+			for (int i = 0; i < cpu_.NumHWThreads(); ++ i)
+			{
+				known.Set(i);
+			}
+		}
+		usable_ = allowed.Empty() ? known : (allowed & known);
+
+		// The last level cache that isn't code only. Its instances bound the domains
+		CPUInfo::CacheLevelInfo const * llc = nullptr;
+		std::vector<CPUInfo::CacheLevelInfo> const & caches = cpu_.Caches();
+		for (size_t i = 0; i < caches.size(); ++ i)
+		{
+			if ((caches[i].type != CPUInfo::CT_Code) && !caches[i].instances.empty()
+				&& ((nullptr == llc) || (caches[i].level > llc->level)))
+			{
+				llc = &caches[i];
+			}
+		}
+
+		// Domain of every usable core, before sorting the domains
+		std::vector<CPUSet> domain_sets;
+		std::vector<int> domain_nodes;
+		std::vector<CoreSlot> cores;
+		std::vector<CPUSet> core_sets;
+		for (size_t p = 0; p < packages.size(); ++ p)
+		{
+			for (size_t d = 0; d < packages[p].dies.size(); ++ d)
+			{
+				CPUInfo::DieInfo const & die = packages[p].dies[d];
+				for (size_t c = 0; c < die.cores.size(); ++ c)
+				{
+					CPUSet const threads = die.cores[c].cpus & usable_;
+					int const first = threads.First();
+					if (first < 0)
+					{
+						continue;
+					}
+
+					// A cache spanning several nodes, as with sub-NUMA clustering, is split along them
+					CPUSet domain = packages[p].cpus;
+					if (llc != nullptr)
+					{
+						for (size_t i = 0; i < llc->instances.size(); ++ i)
+						{
+							if (llc->instances[i].Test(first))
+							{
+								domain = llc->instances[i];
+								break;
+							}
+						}
+					}
+					int node = -1;
+					CPUInfo::LogicalProcessorInfo const * lp = cpu_.FindLogicalProcessor(first);
+					if ((lp != nullptr) && (lp->node >= 0))
+					{
+						node = lp->node;
+						domain &= nodes[node].cpus;
+					}
+
+					CoreSlot slot;
+					for (int cpu = threads.First(); cpu >= 0; cpu = threads.Next(cpu))
+					{
+						slot.threads.push_back(cpu);
+					}
+					slot.type = (lp != nullptr) ? lp->core_type : CPUInfo::HCT_Unknown;
+					slot.domain = static_cast<int>(std::find(domain_sets.begin(), domain_sets.end(), domain) - domain_sets.begin());
+					if (slot.domain == static_cast<int>(domain_sets.size()))
+					{
+						domain_sets.push_back(domain);
+						domain_nodes.push_back(node);
+					}
+					cores.push_back(slot);
+					core_sets.push_back(die.cores[c].cpus);
+				}
+			}
+		}
+		if (cores.empty())
+		{
+			// No topology, every CPU is a core of its own
+			for (int cpu = usable_.First(); cpu >= 0; cpu = usable_.Next(cpu))
+			{
+				CoreSlot slot;
+				slot.threads.push_back(cpu);
+				slot.type = CPUInfo::HCT_Unknown;
+				slot.domain = 0;
+				cores.push_back(slot);
+				core_sets.push_back(CPUSet(cpu));
+			}
+			domain_sets.push_back(usable_);
+			domain_nodes.push_back((1 == nodes.size()) ? 0 : -1);
+		}
+
+		// Domains by node, then by their first CPU
+		std::vector<int> sorted(domain_sets.size());
+		for (size_t i = 0; i < sorted.size(); ++ i)
+		{
+			sorted[i] = static_cast<int>(i);
+		}
+		std::sort(sorted.begin(), sorted.end(),
+			[&domain_sets, &domain_nodes](int lhs, int rhs)
+			{
+				if (domain_nodes[lhs] != domain_nodes[rhs])
+				{
+					return domain_nodes[lhs] < domain_nodes[rhs];
+				}
+				return domain_sets[lhs].First() < domain_sets[rhs].First();
+			});
+		std::vector<int> remap(sorted.size());
+		domains_.resize(sorted.size());
+		for (size_t i = 0; i < sorted.size(); ++ i)
+		{
+			remap[sorted[i]] = static_cast<int>(i);
+			domains_[i].cpus = domain_sets[sorted[i]] & usable_;
+			domains_[i].node = domain_nodes[sorted[i]];
+			domains_[i].cores = 0;
+		}
+
+		cores_.clear();
+		core0_ = -1;
+		for (size_t d = 0; d < domains_.size(); ++ d)
+		{
+			for (size_t c = 0; c < cores.size(); ++ c)
+			{
+				if (remap[cores[c].domain] == static_cast<int>(d))
+				{
+					if (core_sets[c].Test(0))
+					{
+						core0_ = static_cast<int>(cores_.size());
+					}
+					cores_.push_back(cores[c]);
+					cores_.back().domain = static_cast<int>(d);
+					++ domains_[d].cores;
+				}
+			}
+		}
+	}
+
+	std::vector<std::pair<int, int> > PlacementAdvisor::Order(PlacementPolicy policy, std::uint32_t flags) const
+	{
+		std::vector<bool> eligible(cores_.size(), true);
+		if ((flags & PF_ReserveCore0) && (core0_ >= 0) && (cores_.size() > 1))
+		{
+			eligible[core0_] = false;
+		}
+
+		// Core types to hand out in turn, most capable first
+		std::vector<int> types;
+		if (flags & PF_PerformanceFirst)
+		{
+			for (size_t c = 0; c < cores_.size(); ++ c)
+			{
+				if (eligible[c])
+				{
+					types.push_back(cores_[c].type);
+				}
+			}
+			std::sort(types.begin(), types.end(), std::greater<int>());
+			types.erase(std::unique(types.begin(), types.end()), types.end());
+		}
+		else
+		{
+			types.push_back(-1);
+		}
+
+		size_t ranks = 1;
+		if (!(flags & PF_AvoidSMT))
+		{
+			for (size_t c = 0; c < cores_.size(); ++ c)
+			{
+				ranks = std::max(ranks, cores_[c].threads.size());
+			}
+		}
+
+		std::vector<std::pair<int, int> > order;
+		for (size_t t = 0; t < types.size(); ++ t)
+		{
+			// The rank-th thread of the eligible cores of this type in a domain
+			auto domain_threads = [this, &eligible, &types, t](size_t domain, size_t rank)
+			{
+				std::vector<std::pair<int, int> > ret;
+				for (size_t c = 0; c < cores_.size(); ++ c)
+				{
+					if (eligible[c] && (cores_[c].domain == static_cast<int>(domain))
+						&& ((types[t] < 0) || (cores_[c].type == types[t])) && (rank < cores_[c].threads.size()))
+					{
+						ret.push_back(std::make_pair(static_cast<int>(c), cores_[c].threads[rank]));
+					}
+				}
+				return ret;
+			};
+
+			if (PP_Compact == policy)
+			{
+				for (size_t d = 0; d < domains_.size(); ++ d)
+				{
+					for (size_t r = 0; r < ranks; ++ r)
+					{
+						std::vector<std::pair<int, int> > const threads = domain_threads(d, r);
+						order.insert(order.end(), threads.begin(), threads.end());
+					}
+				}
+			}
+			else
+			{
+				for (size_t r = 0; r < ranks; ++ r)
+				{
+					std::vector<std::vector<std::pair<int, int> > > node_lists;
+					for (size_t d = 0; d < domains_.size(); )
+					{
+						std::vector<std::vector<std::pair<int, int> > > domain_lists;
+						size_t e = d;
+						for (; (e < domains_.size()) && (domains_[e].node == domains_[d].node); ++ e)
+						{
+							domain_lists.push_back(domain_threads(e, r));
+						}
+						node_lists.push_back(Interleave(domain_lists));
+						d = e;
+					}
+					std::vector<std::pair<int, int> > const threads = Interleave(node_lists);
+					order.insert(order.end(), threads.begin(), threads.end());
+				}
+			}
+		}
+
+		return order;
+	}
+
+	PlacementAdvisor::Plan PlacementAdvisor::Place(int workers, PlacementPolicy policy, std::uint32_t flags, PlacementScope scope) const
+	{
+		Plan plan;
+		plan.oversubscribed = false;
+
+		std::vector<std::pair<int, int> > const order = this->Order(policy, flags);
+		int const slots = static_cast<int>(order.size());
+		if (0 == slots)
+		{
+			return plan;
+		}
+		if (workers <= 0)
+		{
+			workers = slots;
+		}
+		plan.oversubscribed = (workers > slots);
+
+		plan.workers.resize(workers);
+		for (int i = 0; i < workers; ++ i)
+		{
+			CoreSlot const & core = cores_[order[i % slots].first];
+			WorkerPlacement& worker = plan.workers[i];
+			worker.cpu = order[i % slots].second;
+			worker.domain = core.domain;
+			worker.node = domains_[core.domain].node;
+
+			switch (scope)
+			{
+			case PS_Core:
+				for (size_t j = 0; j < core.threads.size(); ++ j)
+				{
+					worker.cpus.Set(core.threads[j]);
+				}
+				break;
+
+			case PS_Domain:
+				worker.cpus = domains_[core.domain].cpus;
+				break;
+
+			case PS_Node:
+				for (size_t d = 0; d < domains_.size(); ++ d)
+				{
+					if ((domains_[d].node == worker.node) && ((worker.node >= 0) || (static_cast<int>(d) == core.domain)))
+					{
+						worker.cpus |= domains_[d].cpus;
+					}
+				}
+				break;
+
+			default:
+				worker.cpus.Set(worker.cpu);
+				break;
+			}
+		}
+
+		return plan;
+	}
+
+	bool ApplyPlacement(std::vector<std::thread>& threads, PlacementAdvisor::Plan const & plan)
+	{
+		if (plan.workers.empty())
+		{
+			return threads.empty();
+		}
+
+		bool ret = true;
+		for (size_t i = 0; i < threads.size(); ++ i)
+		{
+			if (!BindThread(threads[i], plan.workers[i % plan.workers.size()].cpus))
+			{
+				ret = false;
+			}
+		}
+		return ret;
+	}
+}
@@ -0,0 +1,454 @@
+/**
+ * @file ProbeCache.cpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of CPUTSDK, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#include <CPU-T/CPU.hpp>
+#include "SDKUtil.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+
+#if defined CPUT_PLATFORM_WINDOWS
+#include <windows.h>
+#elif defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if (defined(CPUT_CPU_X86) || defined(CPUT_CPU_X64)) && !defined(CPUT_PLATFORM_ANDROID)
+namespace
+{
+	using std::uint8_t;
+	using std::uint32_t;
+	using std::uint64_t;
+
+	char const PROBE_CACHE_MAGIC[8] = { 'C', 'P', 'U', 'T', 'P', 'R', 'B', 'C' };
+	// Bumped whenever CPUIDDump::Capture() or the per-CPU probe records more leaves, or the sysfs topology
+	// changes its layout, so older caches are probed again
+	uint32_t const PROBE_CACHE_VERSION = 4;
+	// cpu, valid, leaf 1 EBX, leaf 0xB EDX, leaf 0x1A EAX
+	uint32_t const PER_CPU_WORDS = 5;
+
+	// Followed by the std, ext, sub_fn, per-CPU and sysfs topology uint32_t arrays, in that order.
+	// The file is only read back on the machine that wrote it, so it's in native byte order.
+	struct ProbeCacheHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t signature;				// EAX of leaf 1
+		char brand_string[48];
+		uint64_t microcode;
+		char boot_id[40];
+		uint64_t xcr0;
+		uint32_t frequency;				// MHz
+		uint32_t num_std_fn_results;
+		uint32_t num_ext_fn_results;
+		uint32_t num_sub_fn_results;
+		uint32_t num_per_cpu_results;
+		uint32_t num_topology_words;	// 0 if the topology didn't come from sysfs
+		uint32_t checksum;				// FNV-1a of the arrays
+		uint32_t reserved;				// 0
+	};
+	static_assert(sizeof(ProbeCacheHeader) == 152, "ProbeCacheHeader must have no padding");
+
+	uint32_t Fnv1a(uint32_t hash, void const * data, size_t size)
+	{
+		uint8_t const * p = static_cast<uint8_t const *>(data);
+		for (size_t i = 0; i < size; ++ i)
+		{
+			hash = (hash ^ p[i]) * 16777619U;
+		}
+		return hash;
+	}
+
+	uint32_t const FNV1A_SEED = 2166136261U;
+
+#if defined(CPUT_PLATFORM_LINUX)
+	using CPUT::ReadFirstLine;
+#endif
+
+	// Changes on every boot, so a cache never outlives the kernel that saw the topology.
+	bool ReadBootId(char* boot_id, size_t size)
+	{
+		memset(boot_id, 0, size);
+#if defined(CPUT_PLATFORM_LINUX)
+		return ReadFirstLine("/proc/sys/kernel/random/boot_id", boot_id, size) && (boot_id[0] != '\0');
+#elif defined(CPUT_PLATFORM_WINDOWS_DESKTOP)
+		HKEY key;
+		if (::RegOpenKeyExA(HKEY_LOCAL_MACHINE,
+			"SYSTEM\\CurrentControlSet\\Control\\Session Manager\\Memory Management\\PrefetchParameters",
+			0, KEY_READ, &key) != ERROR_SUCCESS)
+		{
+			return false;
+		}
+		DWORD id = 0;
+		DWORD id_size = sizeof(id);
+		bool const ret = (ERROR_SUCCESS == ::RegQueryValueExA(key, "BootId", nullptr, nullptr,
+			reinterpret_cast<BYTE*>(&id), &id_size));
+		::RegCloseKey(key);
+		if (ret)
+		{
+			sprintf(boot_id, "%u", static_cast<unsigned int>(id));
+		}
+		return ret;
+#else
+		return false;
+#endif
+	}
+
+	// Microcode revision of the first CPU, 0 if the OS doesn't tell.
+	uint64_t ReadMicrocode()
+	{
+		uint64_t ret = 0;
+#if defined(CPUT_PLATFORM_LINUX)
+		char buf[256];
+		if (ReadFirstLine("/sys/devices/system/cpu/cpu0/microcode/version", buf, sizeof(buf)))
+		{
+			ret = strtoull(buf, nullptr, 16);
+		}
+		else
+		{
+			FILE* fp = fopen("/proc/cpuinfo", "r");
+			if (fp != nullptr)
+			{
+				while (fgets(buf, sizeof(buf), fp) != nullptr)
+				{
+					if (0 == strncmp(buf, "microcode", 9))
+					{
+						char const * colon = strchr(buf, ':');
+						if (colon != nullptr)
+						{
+							ret = strtoull(colon + 1, nullptr, 16);
+						}
+						break;
+					}
+				}
+				fclose(fp);
+			}
+		}
+#elif defined(CPUT_PLATFORM_WINDOWS_DESKTOP)
+		HKEY key;
+		if (ERROR_SUCCESS == ::RegOpenKeyExA(HKEY_LOCAL_MACHINE, "HARDWARE\\DESCRIPTION\\System\\CentralProcessor\\0",
+			0, KEY_READ, &key))
+		{
+			BYTE revision[8] = { 0 };
+			DWORD revision_size = sizeof(revision);
+			if (ERROR_SUCCESS == ::RegQueryValueExA(key, "Update Revision", nullptr, nullptr, revision, &revision_size))
+			{
+				memcpy(&ret, revision, sizeof(ret));
+			}
+			::RegCloseKey(key);
+		}
+#endif
+		return ret;
+	}
+
+	// A read-only view of a whole file.
+	class MappedFile
+	{
+	public:
+		explicit MappedFile(char const * path)
+			: data_(nullptr), size_(0)
+		{
+#if defined(CPUT_PLATFORM_WINDOWS_DESKTOP)
+			HANDLE file = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+				OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file != INVALID_HANDLE_VALUE)
+			{
+				LARGE_INTEGER file_size;
+				if (::GetFileSizeEx(file, &file_size) && (file_size.QuadPart > 0))
+				{
+					HANDLE mapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+					if (mapping != nullptr)
+					{
+						data_ = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+						if (data_ != nullptr)
+						{
+							size_ = static_cast<size_t>(file_size.QuadPart);
+						}
+						::CloseHandle(mapping);
+					}
+				}
+				::CloseHandle(file);
+			}
+#elif defined(CPUT_PLATFORM_LINUX)
+			int fd = open(path, O_RDONLY | O_CLOEXEC);
+			if (fd >= 0)
+			{
+				struct stat st;
+				if ((0 == fstat(fd, &st)) && (st.st_size > 0))
+				{
+					void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+					if (p != MAP_FAILED)
+					{
+						data_ = p;
+						size_ = static_cast<size_t>(st.st_size);
+					}
+				}
+				close(fd);
+			}
+#else
+			(void)path;
+#endif
+		}
+
+		~MappedFile()
+		{
+			if (data_ != nullptr)
+			{
+#if defined(CPUT_PLATFORM_WINDOWS_DESKTOP)
+				::UnmapViewOfFile(data_);
+#elif defined(CPUT_PLATFORM_LINUX)
+				munmap(data_, size_);
+#endif
+			}
+		}
+
+		void const * Data() const
+		{
+			return data_;
+		}
+		size_t Size() const
+		{
+			return size_;
+		}
+
+	private:
+		MappedFile(MappedFile const & rhs);
+		MappedFile& operator=(MappedFile const & rhs);
+
+	private:
+		void* data_;
+		size_t size_;
+	};
+
+	void ReadArray(std::vector<unsigned int>& results, uint32_t const *& p, uint32_t num)
+	{
+		results.assign(p, p + num);
+		p += num;
+	}
+
+	// Leaf 1 EAX and the brand string, straight from CPUID.
+	void ReadSignature(unsigned int& signature, char* brand_string)
+	{
+		unsigned int regs[4];
+
+		signature = 0;
+		CPUT::CPUIDDump::Execute(0, 0, regs);
+		if (regs[0] >= 1)
+		{
+			CPUT::CPUIDDump::Execute(1, 0, regs);
+			signature = regs[0];
+		}
+
+		memset(brand_string, 0, 48);
+		CPUT::CPUIDDump::Execute(0x80000000, 0, regs);
+		if (regs[0] >= 0x80000004)
+		{
+			for (unsigned int i = 0; i < 3; ++ i)
+			{
+				CPUT::CPUIDDump::Execute(0x80000002 + i, 0, regs);
+				memcpy(&brand_string[i * 16], regs, sizeof(regs));
+			}
+		}
+	}
+}
+
+namespace CPUT
+{
+	bool CPUInfo::LoadProbeCache(char const * path)
+	{
+		MappedFile file(path);
+		if (file.Size() < sizeof(ProbeCacheHeader))
+		{
+			return false;
+		}
+
+		ProbeCacheHeader header;
+		memcpy(&header, file.Data(), sizeof(header));
+		if ((memcmp(header.magic, PROBE_CACHE_MAGIC, sizeof(header.magic)) != 0)
+			|| (header.version != PROBE_CACHE_VERSION))
+		{
+			return false;
+		}
+
+		uint64_t const num_results = static_cast<uint64_t>(header.num_std_fn_results) + header.num_ext_fn_results
+			+ header.num_sub_fn_results + header.num_per_cpu_results + header.num_topology_words;
+		if ((file.Size() != sizeof(header) + num_results * sizeof(uint32_t))
+			|| (0 == header.num_std_fn_results) || (header.num_std_fn_results % 4 != 0)
+			|| (header.num_ext_fn_results % 4 != 0) || (header.num_sub_fn_results % 6 != 0)
+			|| (header.num_per_cpu_results % PER_CPU_WORDS != 0))
+		{
+			return false;
+		}
+
+		// The key. Anything that can change what CPUID returns, or which CPUs exist, must match.
+		unsigned int signature;
+		char brand_string[48];
+		ReadSignature(signature, brand_string);
+		char boot_id[sizeof(header.boot_id)];
+		if ((header.signature != signature)
+			|| (memcmp(header.brand_string, brand_string, sizeof(brand_string)) != 0)
+			|| (header.microcode != ReadMicrocode())
+			|| !ReadBootId(boot_id, sizeof(boot_id))
+			|| (memcmp(header.boot_id, boot_id, sizeof(boot_id)) != 0))
+		{
+			return false;
+		}
+
+		uint8_t const * payload = static_cast<uint8_t const *>(file.Data()) + sizeof(header);
+		if (Fnv1a(FNV1A_SEED, payload, static_cast<size_t>(num_results * sizeof(uint32_t))) != header.checksum)
+		{
+			return false;
+		}
+
+		// The mapping is page aligned and the header is a multiple of 4 bytes.
+		uint32_t const * p = reinterpret_cast<uint32_t const *>(payload);
+		ReadArray(dump_.std_fn_results_, p, header.num_std_fn_results);
+		ReadArray(dump_.ext_fn_results_, p, header.num_ext_fn_results);
+		ReadArray(dump_.sub_fn_results_, p, header.num_sub_fn_results);
+		dump_.per_cpu_.resize(header.num_per_cpu_results / PER_CPU_WORDS);
+		for (size_t i = 0; i < dump_.per_cpu_.size(); ++ i, p += PER_CPU_WORDS)
+		{
+			dump_.per_cpu_[i].cpu = static_cast<int>(p[0]);
+			dump_.per_cpu_[i].valid = (p[1] != 0);
+			dump_.per_cpu_[i].leaf1_ebx = p[2];
+			dump_.per_cpu_[i].x2apic_id = p[3];
+			dump_.per_cpu_[i].hybrid_info = p[4];
+		}
+		ReadArray(sysfs_topology_, p, header.num_topology_words);
+		dump_.XCR0(header.xcr0);
+		dump_.Frequency(header.frequency);
+
+		return true;
+	}
+
+	bool CPUInfo::SaveProbeCache(char const * path) const
+	{
+		if (replay_)
+		{
+			// Not this machine's CPUID
+			return false;
+		}
+
+		CPUIDDump const & dump = this->Dump();
+
+		std::vector<unsigned int> per_cpu_results;
+		for (size_t i = 0; i < dump.per_cpu_.size(); ++ i)
+		{
+			per_cpu_results.push_back(dump.per_cpu_[i].cpu);
+			per_cpu_results.push_back(dump.per_cpu_[i].valid ? 1 : 0);
+			per_cpu_results.push_back(dump.per_cpu_[i].leaf1_ebx);
+			per_cpu_results.push_back(dump.per_cpu_[i].x2apic_id);
+			per_cpu_results.push_back(dump.per_cpu_[i].hybrid_info);
+		}
+
+		std::vector<unsigned int> topology;
+#if defined(CPUT_PLATFORM_LINUX)
+		this->SaveSysfsTopology(topology);
+#endif
+
+		ProbeCacheHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, PROBE_CACHE_MAGIC, sizeof(header.magic));
+		header.version = PROBE_CACHE_VERSION;
+		if (!ReadBootId(header.boot_id, sizeof(header.boot_id)))
+		{
+			return false;
+		}
+		header.signature = this->CPUIDResult(1, 0);
+		memcpy(header.brand_string, brand_string_, sizeof(header.brand_string));
+		header.microcode = ReadMicrocode();
+		header.xcr0 = dump.XCR0();
+		header.frequency = dump.Frequency();
+		header.num_std_fn_results = static_cast<uint32_t>(dump.std_fn_results_.size());
+		header.num_ext_fn_results = static_cast<uint32_t>(dump.ext_fn_results_.size());
+		header.num_sub_fn_results = static_cast<uint32_t>(dump.sub_fn_results_.size());
+		header.num_per_cpu_results = static_cast<uint32_t>(per_cpu_results.size());
+		header.num_topology_words = static_cast<uint32_t>(topology.size());
+
+		std::vector<unsigned int> const * arrays[] = { &dump.std_fn_results_, &dump.ext_fn_results_,
+			&dump.sub_fn_results_, &per_cpu_results, &topology };
+		header.checksum = FNV1A_SEED;
+		for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); ++ i)
+		{
+			if (!arrays[i]->empty())
+			{
+				header.checksum = Fnv1a(header.checksum, &(*arrays[i])[0], arrays[i]->size() * sizeof(uint32_t));
+			}
+		}
+
+		// Written aside and renamed over, so readers never map a half-written file.
+		char tmp_path[1024];
+#if defined CPUT_PLATFORM_WINDOWS
+		sprintf(tmp_path, "%.1000s.%u", path, static_cast<unsigned int>(::GetCurrentProcessId()));
+#else
+		sprintf(tmp_path, "%.1000s.%u", path, static_cast<unsigned int>(getpid()));
+#endif
+		FILE* fp = fopen(tmp_path, "wb");
+		if (nullptr == fp)
+		{
+			return false;
+		}
+		bool ok = (1 == fwrite(&header, sizeof(header), 1, fp));
+		for (size_t i = 0; ok && (i < sizeof(arrays) / sizeof(arrays[0])); ++ i)
+		{
+			if (!arrays[i]->empty())
+			{
+				ok = (arrays[i]->size() == fwrite(&(*arrays[i])[0], sizeof(uint32_t), arrays[i]->size(), fp));
+			}
+		}
+		ok = (0 == fclose(fp)) && ok;
+
+#if defined CPUT_PLATFORM_WINDOWS
+		ok = ok && (::MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING) != 0);
+#else
+		ok = ok && (0 == rename(tmp_path, path));
+#endif
+		if (!ok)
+		{
+			remove(tmp_path);
+		}
+		return ok;
+	}
+}
+#else
+namespace CPUT
+{
+	bool CPUInfo::SaveProbeCache(char const * /*path*/) const
+	{
+		return false;
+	}
+}
+#endif
@@ -0,0 +1,53 @@
+/**
+ * @file SDKUtil.hpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of CPUTSDK, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#ifndef _CPUTSDK_SDKUTIL_HPP
+#define _CPUTSDK_SDKUTIL_HPP
+
+#include <CPU-T/Config.hpp>
+#include <cstddef>
+
+// Helpers shared by the SDK sources. Not part of the public interface.
+namespace CPUT
+{
+	// Rounds value up to a multiple of alignment.
+	template <typename T>
+	inline T RoundUp(T value, T alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+#if defined(CPUT_PLATFORM_LINUX) || defined(CPUT_PLATFORM_ANDROID)
+	// Reads the first line of a small text file, without the line break.
+	bool ReadFirstLine(char const * path, char* buf, size_t size);
+#endif
+}
+
+#endif		// _CPUTSDK_SDKUTIL_HPP
@@ -0,0 +1,541 @@
+/**
+ * @file ThreadPool.cpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of CPUTSDK, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#include <CPU-T/ThreadPool.hpp>
+
+#include <cassert>
+#include <algorithm>
+#include <thread>
+
+namespace
+{
+	// Rounds of stealing, with a yield between them, before a worker parks
+	int const SPIN_ROUNDS = 64;
+	std::int64_t const INITIAL_DEQUE_CAPACITY = 256;
+
+	thread_local CPUT::ThreadPool const * current_pool = nullptr;
+	thread_local int current_worker = -1;
+}
+
+namespace CPUT
+{
+	struct ThreadPool::TaskNode
+	{
+		Task task;
+		TaskGroup* group;
+	};
+
+	// Chase-Lev deque, with the memory orders of "Correct and Efficient Work-Stealing for Weak Memory Models"
+	// (Le et al., 2013). Only the owner pushes and pops, at the bottom. Anyone steals, at the top. Outgrown
+	// rings are kept until the deque dies, a thief may still be reading them.
+	class ThreadPool::WorkDeque
+	{
+	public:
+		WorkDeque()
+			: top_(0), bottom_(0)
+		{
+			rings_.push_back(std::unique_ptr<Ring>(new Ring(INITIAL_DEQUE_CAPACITY)));
+			ring_.store(rings_.back().get(), std::memory_order_relaxed);
+		}
+
+		void Push(TaskNode* node)
+		{
+			std::int64_t const b = bottom_.load(std::memory_order_relaxed);
+			std::int64_t const t = top_.load(std::memory_order_acquire);
+			Ring* ring = ring_.load(std::memory_order_relaxed);
+			if (b - t > ring->capacity - 1)
+			{
+				ring = this->Grow(ring, t, b);
+			}
+			ring->Put(b, node);
+			bottom_.store(b + 1, std::memory_order_release);
+		}
+
+		TaskNode* Pop()
+		{
+			std::int64_t const b = bottom_.load(std::memory_order_relaxed) - 1;
+			Ring* ring = ring_.load(std::memory_order_relaxed);
+			bottom_.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			std::int64_t t = top_.load(std::memory_order_relaxed);
+
+			TaskNode* node = nullptr;
+			if (t <= b)
+			{
+				node = ring->Get(b);
+				if (t == b)
+				{
+					// The last one, race the thieves for it
+					if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+					{
+						node = nullptr;
+					}
+					bottom_.store(b + 1, std::memory_order_relaxed);
+				}
+			}
+			else
+			{
+				bottom_.store(b + 1, std::memory_order_relaxed);
+			}
+			return node;
+		}
+
+		// nullptr if empty, or if another thief got there first.
+		TaskNode* Steal()
+		{
+			std::int64_t t = top_.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			std::int64_t const b = bottom_.load(std::memory_order_acquire);
+
+			TaskNode* node = nullptr;
+			if (t < b)
+			{
+				Ring* ring = ring_.load(std::memory_order_acquire);
+				node = ring->Get(t);
+				if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				{
+					node = nullptr;
+				}
+			}
+			return node;
+		}
+
+	private:
+		struct Ring
+		{
+			explicit Ring(std::int64_t cap)
+				: capacity(cap), slots(new std::atomic<TaskNode*>[static_cast<size_t>(cap)])
+			{
+			}
+
+			TaskNode* Get(std::int64_t i) const
+			{
+				return slots[static_cast<size_t>(i & (capacity - 1))].load(std::memory_order_relaxed);
+			}
+			void Put(std::int64_t i, TaskNode* node)
+			{
+				slots[static_cast<size_t>(i & (capacity - 1))].store(node, std::memory_order_relaxed);
+			}
+
+			std::int64_t capacity;
+			std::unique_ptr<std::atomic<TaskNode*>[]> slots;
+		};
+
+		Ring* Grow(Ring* ring, std::int64_t t, std::int64_t b)
+		{
+			rings_.push_back(std::unique_ptr<Ring>(new Ring(ring->capacity * 2)));
+			Ring* bigger = rings_.back().get();
+			for (std::int64_t i = t; i < b; ++ i)
+			{
+				bigger->Put(i, ring->Get(i));
+			}
+			ring_.store(bigger, std::memory_order_release);
+			return bigger;
+		}
+
+	private:
+		std::atomic<std::int64_t> top_;
+		std::atomic<std::int64_t> bottom_;
+		std::atomic<Ring*> ring_;
+		std::vector<std::unique_ptr<Ring> > rings_;
+	};
+
+	struct ThreadPool::Worker
+	{
+		WorkDeque deque;
+		std::thread thread;
+		std::vector<int> victims;
+		std::atomic<std::uint64_t> steals[SD_NumDistances];
+	};
+
+
+	ThreadPool::ThreadPool(CPUInfo const & cpu, int workers, PlacementAdvisor::PlacementPolicy policy, std::uint32_t flags)
+		: inject_size_(0), pending_(0), epoch_(0), sleepers_(0), stop_(false)
+	{
+		PlacementAdvisor const advisor(cpu);
+		if (workers <= 0)
+		{
+			workers = std::min(static_cast<int>(advisor.Place(0, policy, flags).workers.size()),
+				QueryEffectiveCPUs().Parallelism());
+			workers = std::max(workers, 1);
+		}
+		plan_ = advisor.Place(workers, policy, flags);
+		if (plan_.workers.empty())
+		{
+			// Nothing to pin to, the workers float
+			plan_.workers.resize(workers);
+			for (int i = 0; i < workers; ++ i)
+			{
+				plan_.workers[i].cpu = -1;
+				plan_.workers[i].domain = -1;
+				plan_.workers[i].node = -1;
+			}
+		}
+
+		// Where each worker sits: package, die, core, and its L2 instance
+		std::vector<CPUInfo::CacheLevelInfo> const & caches = cpu.Caches();
+		CPUInfo::CacheLevelInfo const * l2 = nullptr;
+		for (size_t i = 0; i < caches.size(); ++ i)
+		{
+			if ((2 == caches[i].level) && (caches[i].type != CPUInfo::CT_Code))
+			{
+				l2 = &caches[i];
+				break;
+			}
+		}
+		std::vector<CPUInfo::LogicalProcessorInfo const *> lps(workers);
+		std::vector<int> l2s(workers, -1);
+		for (int i = 0; i < workers; ++ i)
+		{
+			int const os_index = plan_.workers[i].cpu;
+			lps[i] = (os_index >= 0) ? cpu.FindLogicalProcessor(os_index) : nullptr;
+			if ((l2 != nullptr) && (os_index >= 0))
+			{
+				for (size_t j = 0; j < l2->instances.size(); ++ j)
+				{
+					if (l2->instances[j].Test(os_index))
+					{
+						l2s[i] = static_cast<int>(j);
+						break;
+					}
+				}
+			}
+		}
+
+		distances_.assign(workers, std::vector<StealDistance>(workers, SD_Remote));
+		for (int a = 0; a < workers; ++ a)
+		{
+			PlacementAdvisor::WorkerPlacement const & pa = plan_.workers[a];
+			for (int b = 0; b < workers; ++ b)
+			{
+				PlacementAdvisor::WorkerPlacement const & pb = plan_.workers[b];
+				StealDistance& distance = distances_[a][b];
+				if ((pa.cpu >= 0) && (pa.cpu == pb.cpu))
+				{
+					distance = SD_SMT;
+				}
+				else if ((lps[a] != nullptr) && (lps[b] != nullptr) && (lps[a]->package == lps[b]->package)
+					&& (lps[a]->die == lps[b]->die) && (lps[a]->core == lps[b]->core))
+				{
+					distance = SD_SMT;
+				}
+				else if ((l2s[a] >= 0) && (l2s[a] == l2s[b]))
+				{
+					distance = SD_L2;
+				}
+				else if ((pa.domain >= 0) && (pa.domain == pb.domain))
+				{
+					distance = SD_L3;
+				}
+				else if ((pa.node >= 0) && (pa.node == pb.node))
+				{
+					distance = SD_Node;
+				}
+				else if ((lps[a] != nullptr) && (lps[b] != nullptr) && (lps[a]->package == lps[b]->package))
+				{
+					distance = SD_Package;
+				}
+			}
+		}
+
+		workers_.resize(workers);
+		for (int i = 0; i < workers; ++ i)
+		{
+			workers_[i].reset(new Worker);
+			for (int d = 0; d < SD_NumDistances; ++ d)
+			{
+				workers_[i]->steals[d].store(0, std::memory_order_relaxed);
+			}
+
+			// Nearest first. Among equals, start from the next worker so thieves don't all pick the same victim
+			for (int j = 1; j < workers; ++ j)
+			{
+				workers_[i]->victims.push_back((i + j) % workers);
+			}
+			std::vector<StealDistance> const & distances = distances_[i];
+			std::stable_sort(workers_[i]->victims.begin(), workers_[i]->victims.end(),
+				[&distances](int lhs, int rhs)
+				{
+					return distances[lhs] < distances[rhs];
+				});
+		}
+		for (int i = 0; i < workers; ++ i)
+		{
+			workers_[i]->thread = std::thread(&ThreadPool::WorkerMain, this, i);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		this->Wait();
+
+		{
+			std::lock_guard<std::mutex> lock(park_mutex_);
+			stop_.store(true, std::memory_order_seq_cst);
+			epoch_.fetch_add(1, std::memory_order_seq_cst);
+		}
+		park_cv_.notify_all();
+
+		for (size_t i = 0; i < workers_.size(); ++ i)
+		{
+			workers_[i]->thread.join();
+		}
+	}
+
+	std::vector<int> const & ThreadPool::Victims(int worker) const
+	{
+		return workers_[worker]->victims;
+	}
+
+	ThreadPool::StealDistance ThreadPool::Distance(int thief, int victim) const
+	{
+		return distances_[thief][victim];
+	}
+
+	void ThreadPool::Submit(Task task)
+	{
+		TaskNode* node = new TaskNode;
+		node->task = std::move(task);
+		node->group = nullptr;
+		this->Push(node);
+	}
+
+	void ThreadPool::Submit(TaskGroup& group, Task task)
+	{
+		group.pending_.fetch_add(1, std::memory_order_relaxed);
+
+		TaskNode* node = new TaskNode;
+		node->task = std::move(task);
+		node->group = &group;
+		this->Push(node);
+	}
+
+	void ThreadPool::Wait()
+	{
+		assert((this->CurrentWorker() < 0) && "Waiting for the whole pool from one of its tasks never returns");
+
+		std::unique_lock<std::mutex> lock(done_mutex_);
+		done_cv_.wait(lock,
+			[this]
+			{
+				return 0 == pending_.load(std::memory_order_acquire);
+			});
+	}
+
+	void ThreadPool::Wait(TaskGroup& group)
+	{
+		int const worker = this->CurrentWorker();
+		if (worker < 0)
+		{
+			std::unique_lock<std::mutex> lock(done_mutex_);
+			done_cv_.wait(lock,
+				[&group]
+				{
+					return group.Done();
+				});
+		}
+		else
+		{
+			while (!group.Done())
+			{
+				TaskNode* node = this->FindTask(worker);
+				if (node != nullptr)
+				{
+					this->Run(node);
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+	}
+
+	int ThreadPool::CurrentWorker() const
+	{
+		return (this == current_pool) ? current_worker : -1;
+	}
+
+	std::vector<std::uint64_t> ThreadPool::StealCounts() const
+	{
+		std::vector<std::uint64_t> ret(SD_NumDistances, 0);
+		for (size_t i = 0; i < workers_.size(); ++ i)
+		{
+			for (int d = 0; d < SD_NumDistances; ++ d)
+			{
+				ret[d] += workers_[i]->steals[d].load(std::memory_order_relaxed);
+			}
+		}
+		return ret;
+	}
+
+	void ThreadPool::Push(TaskNode* node)
+	{
+		pending_.fetch_add(1, std::memory_order_relaxed);
+
+		int const worker = this->CurrentWorker();
+		if (worker >= 0)
+		{
+			workers_[worker]->deque.Push(node);
+		}
+		else
+		{
+			std::lock_guard<std::mutex> lock(inject_mutex_);
+			inject_.push_back(node);
+			inject_size_.fetch_add(1, std::memory_order_release);
+		}
+
+		this->WakeOne();
+	}
+
+	ThreadPool::TaskNode* ThreadPool::FindTask(int worker)
+	{
+		TaskNode* node = workers_[worker]->deque.Pop();
+		if (node != nullptr)
+		{
+			return node;
+		}
+
+		if (inject_size_.load(std::memory_order_acquire) > 0)
+		{
+			std::lock_guard<std::mutex> lock(inject_mutex_);
+			if (!inject_.empty())
+			{
+				node = inject_.front();
+				inject_.pop_front();
+				inject_size_.fetch_sub(1, std::memory_order_relaxed);
+				return node;
+			}
+		}
+
+		std::vector<int> const & victims = workers_[worker]->victims;
+		for (size_t i = 0; i < victims.size(); ++ i)
+		{
+			node = workers_[victims[i]]->deque.Steal();
+			if (node != nullptr)
+			{
+				workers_[worker]->steals[distances_[worker][victims[i]]].fetch_add(1, std::memory_order_relaxed);
+				return node;
+			}
+		}
+		return nullptr;
+	}
+
+	void ThreadPool::Run(TaskNode* node)
+	{
+		node->task();
+
+		TaskGroup* group = node->group;
+		delete node;
+
+		bool done = false;
+		if ((group != nullptr) && (1 == group->pending_.fetch_sub(1, std::memory_order_acq_rel)))
+		{
+			done = true;
+		}
+		if (1 == pending_.fetch_sub(1, std::memory_order_acq_rel))
+		{
+			done = true;
+		}
+		if (done)
+		{
+			// Taking the lock orders this with a waiter that just found the count nonzero
+			{
+				std::lock_guard<std::mutex> lock(done_mutex_);
+			}
+			done_cv_.notify_all();
+		}
+	}
+
+	void ThreadPool::WorkerMain(int worker)
+	{
+		current_pool = this;
+		current_worker = worker;
+		if (plan_.workers[worker].cpu >= 0)
+		{
+			BindThread(plan_.workers[worker].cpus);
+		}
+
+		for (;;)
+		{
+			TaskNode* node = nullptr;
+			for (int i = 0; (nullptr == node) && (i < SPIN_ROUNDS); ++ i)
+			{
+				node = this->FindTask(worker);
+				if (nullptr == node)
+				{
+					std::this_thread::yield();
+				}
+			}
+			if (node != nullptr)
+			{
+				this->Run(node);
+				continue;
+			}
+
+			// Announce the park before the last look, so a submitter either sees a sleeper or its task is found
+			std::uint64_t const epoch = epoch_.load(std::memory_order_seq_cst);
+			sleepers_.fetch_add(1, std::memory_order_seq_cst);
+			node = this->FindTask(worker);
+			if (node != nullptr)
+			{
+				sleepers_.fetch_sub(1, std::memory_order_relaxed);
+				this->Run(node);
+				continue;
+			}
+			{
+				std::unique_lock<std::mutex> lock(park_mutex_);
+				while ((epoch_.load(std::memory_order_relaxed) == epoch) && !stop_.load(std::memory_order_relaxed))
+				{
+					park_cv_.wait(lock);
+				}
+			}
+			sleepers_.fetch_sub(1, std::memory_order_relaxed);
+
+			if (stop_.load(std::memory_order_acquire))
+			{
+				break;
+			}
+		}
+	}
+
+	void ThreadPool::WakeOne()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleepers_.load(std::memory_order_relaxed) > 0)
+		{
+			{
+				std::lock_guard<std::mutex> lock(park_mutex_);
+				epoch_.fetch_add(1, std::memory_order_relaxed);
+			}
+			park_cv_.notify_one();
+		}
+	}
+}
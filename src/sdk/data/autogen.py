@@ -7,6 +7,59 @@ try:
 except:
 	from io import StringIO
 
+class StringPool:
+	def __init__(self, name):
+		self.name = name;
+		self.strings = [];
+		self.offsets = {};
+		self.size = 0;
+		self.Intern("");
+
+	def Intern(self, s):
+		if s not in self.offsets:
+			self.offsets[s] = self.size;
+			self.strings.append(s);
+			self.size += len(s) + 1;
+		return self.offsets[s];
+
+	def GenSource(self, source_str):
+		assert self.size <= 0x10000;
+		source_str.write("\tCPUT_CONSTEXPR char const %s[] =\n" % self.name);
+		source_str.write("\t{\n");
+		for s in self.strings:
+			source_str.write("\t\t\"%s\\0\"\n" % s.replace("\\", "\\\\").replace("\"", "\\\""));
+		source_str.write("\t};\n");
+
+def AttrOr(value, default):
+	if len(value) > 0:
+		return value;
+	else:
+		return default;
+
+def TechOr(value, default):
+	if len(value) > 0:
+		return value + " nm";
+	else:
+		return default;
+
+# The most specific key of a model. Family entries use 0xFFF as the model.
+ANY_MODEL = 0xFFF;
+
+class CpuModelDesc:
+	def __init__(self, family, model, first_stepping, last_stepping, name, tech, transistors, codename, package):
+		self.key = (family << 16) | (model << 4) | last_stepping;
+		self.first_stepping = first_stepping;
+		self.name = name;
+		self.tech = tech;
+		self.transistors = transistors;
+		self.codename = codename;
+		self.package = package;
+
+	def GenSource(self, source_str, pool):
+		source_str.write("\t\t{ 0x%08X, 0x%X, %d, %d, %d, %d, %d },\n" % (self.key, self.first_stepping,
+			pool.Intern(self.name), pool.Intern(self.tech), pool.Intern(self.transistors),
+			pool.Intern(self.codename), pool.Intern(self.package)));
+
 class CpuVendorFamilyModelStepping:
 	def __init__(self, value, begin, end, name, tech, transistors, core, codename, package):
 		if (value):
@@ -17,6 +70,7 @@ class CpuVendorFamilyModelStepping:
 			
 			self.begin = int(begin, 16);
 			self.end = int(end, 16);
+		assert (self.begin <= self.end) and (self.end <= 0xF);
 
 		self.name = name;
 		self.tech = tech;
@@ -44,27 +98,35 @@ class CpuVendorFamilyModel:
 					stepping.getAttribute("transistors"), stepping.getAttribute("core"),
 					stepping.getAttribute("codename"), stepping.getAttribute("package")));
 
-	def GenSource(self, source_str):
-		if len(self.steppings) > 0:
-			source_str.write("\t\t\t\tswitch (stepping)\n");
-			source_str.write("\t\t\t\t{\n");
-			for stepping in self.steppings:
-				for i in range(stepping.begin, stepping.end + 1):
-					source_str.write("\t\t\t\tcase %s:\n" % i);
-				if len(stepping.name) > 0:
-					source_str.write("\t\t\t\t\tname = \"%s\";\n" % stepping.name);
-				if len(stepping.tech) > 0:
-					source_str.write("\t\t\t\t\ttech = \"%s nm\";\n" % stepping.tech);
-				if len(stepping.transistors) > 0:
-					source_str.write("\t\t\t\t\ttransistors = \"%s\";\n" % stepping.transistors);
-				if len(stepping.codename) > 0:
-					source_str.write("\t\t\t\t\tcodename = \"%s\";\n" % stepping.codename);
-				if len(stepping.package) > 0:
-					source_str.write("\t\t\t\t\tpackage = \"%s\";\n" % stepping.package);
-				source_str.write("\t\t\t\t\tbreak;\n\n");
-			source_str.write("\t\t\t\tdefault:\n");
-			source_str.write("\t\t\t\t\tbreak;\n");
-			source_str.write("\t\t\t\t}\n");
+	def GenDescs(self, descs, vendor, family, family_name):
+		model = int(self.value, 16);
+		assert model < ANY_MODEL;
+		name = AttrOr(self.name, family_name);
+		tech = TechOr(self.tech, "Unknown");
+		transistors = AttrOr(self.transistors, "Unknown");
+		codename = AttrOr(self.codename, "Unknown");
+		package = AttrOr(self.package, "Unknown");
+
+		# Every stepping maps to exactly one desc. The steppings without their own entry get the model's.
+		covered = [False] * 16;
+		for stepping in self.steppings:
+			descs.append(CpuModelDesc(family, model, stepping.begin, stepping.end,
+				vendor + " " + AttrOr(stepping.name, name), TechOr(stepping.tech, tech),
+				AttrOr(stepping.transistors, transistors), AttrOr(stepping.codename, codename),
+				AttrOr(stepping.package, package)));
+			for i in range(stepping.begin, stepping.end + 1):
+				assert not covered[i];
+				covered[i] = True;
+		i = 0;
+		while i < 16:
+			if covered[i]:
+				i += 1;
+			else:
+				begin = i;
+				while (i < 16) and not covered[i]:
+					i += 1;
+				descs.append(CpuModelDesc(family, model, begin, i - 1, vendor + " " + name,
+					tech, transistors, codename, package));
 		
 class CpuVendorFamily:
 	def __init__(self, value, name, models_tag):
@@ -79,28 +141,15 @@ class CpuVendorFamily:
 					model.getAttribute("transistors"), model.getAttribute("core"),
 					model.getAttribute("codename"), model.getAttribute("package"),
 					model.getElementsByTagName("stepping")));
-					
-	def GenSource(self, source_str):
-		if len(self.models) > 0:
-			source_str.write("\t\t\tswitch (model)\n");
-			source_str.write("\t\t\t{\n");
-			for model in self.models:
-				source_str.write("\t\t\tcase 0x%s:\n" % model.value);
-				if len(model.name) > 0:
-					source_str.write("\t\t\t\tname = \"%s\";\n" % model.name);
-				if len(model.tech) > 0:
-					source_str.write("\t\t\t\ttech = \"%s nm\";\n" % model.tech);
-				if len(model.transistors) > 0:
-					source_str.write("\t\t\t\ttransistors = \"%s\";\n" % model.transistors);
-				if len(model.codename) > 0:
-					source_str.write("\t\t\t\tcodename = \"%s\";\n" % model.codename);
-				if len(model.package) > 0:
-					source_str.write("\t\t\t\tpackage = \"%s\";\n" % model.package);
-				model.GenSource(source_str);
-				source_str.write("\t\t\t\tbreak;\n\n");
-			source_str.write("\t\t\tdefault:\n");
-			source_str.write("\t\t\t\tbreak;\n");
-			source_str.write("\t\t\t}\n");
+
+	def GenDescs(self, descs, vendor, vendor_name):
+		family = int(self.value, 16);
+		assert family <= 0xFFFF;
+		name = AttrOr(self.name, vendor_name);
+		descs.append(CpuModelDesc(family, ANY_MODEL, 0, 0xF, vendor + " " + name,
+			"Unknown", "Unknown", "Unknown", "Unknown"));
+		for model in self.models:
+			model.GenDescs(descs, vendor, family, name);
 
 class CpuVendor:
 	def __init__(self, vendor, vendor_id, name, families_tag):
@@ -118,19 +167,29 @@ class CpuVendor:
 				self.families.append(CpuVendorFamily(family.getAttribute("value"),
 					family.getAttribute("name"), family.getElementsByTagName("model")));
 
-	def GenSource(self, source_str):
-		if len(self.families) > 0:
-			source_str.write("\t\tswitch (family)\n");
-			source_str.write("\t\t{\n");
-			for family in self.families:
-				source_str.write("\t\tcase 0x%s:\n" % family.value);
-				if len(family.name) > 0:
-					source_str.write("\t\t\tname = \"%s\";\n" % family.name);
-				family.GenSource(source_str);
-				source_str.write("\t\t\tbreak;\n\n");
-			source_str.write("\t\tdefault:\n");
-			source_str.write("\t\t\tbreak;\n");
-			source_str.write("\t\t}\n");
+	def IdWords(self):
+		# The vendor ID as CPUID leaf 0 returns it in EBX, EDX, ECX, padded with zeros
+		assert len(self.vendor_id) <= 12;
+		id = self.vendor_id.encode("ascii") + b"\0" * (12 - len(self.vendor_id));
+		words = [];
+		for i in range(0, 3):
+			word = 0;
+			for j in range(0, 4):
+				word |= bytearray(id)[i * 4 + j] << (j * 8);
+			words.append(word);
+		return words;
+
+	def GenDescs(self, descs):
+		descs.append(CpuModelDesc(0, 0, 0, 0, self.vendor + " " + self.name,
+			"Unknown", "Unknown", "Unknown", "Unknown"));
+		models = [];
+		for family in self.families:
+			family.GenDescs(models, self.vendor, self.name);
+		models.sort(key = lambda desc: desc.key);
+		for i in range(1, len(models)):
+			assert models[i - 1].key != models[i].key;
+		descs.extend(models);
+		return len(models);
 
 
 class CpuIdentifier:
@@ -145,20 +204,75 @@ class CpuIdentifier:
 						cpu.getElementsByTagName("family")));
 						
 	def GenSource(self, source_str):
-		for i in range(0, len(self.cpus)):
-			cpu = self.cpus[i];
-			if (0 == i):
-				source_str.write("\t");
-			else:
-				source_str.write("\telse ");
-			source_str.write("if (\"%s\" == vendor_id)\n" % cpu.vendor_id);
-			source_str.write("\t{\n");
-			if len(cpu.name) > 0:
-				source_str.write("\t\tname = \"%s\";\n" % cpu.name);
-			cpu.GenSource(source_str);
-			source_str.write("\t\tname = \"%s \" + name;\n" % cpu.vendor);
-			source_str.write("\t}\n");
+		pool = StringPool("CPU_STRINGS");
+
+		# CPU_MODELS[0] is the unknown vendor. Each vendor is followed by its models, sorted by key.
+		descs = [CpuModelDesc(0, 0, 0, 0, self.name, "Unknown", "Unknown", "Unknown", "Unknown")];
+		vendors = [];
+		for cpu in self.cpus:
+			fallback = len(descs);
+			num_models = cpu.GenDescs(descs);
+			vendors.append((cpu, fallback, fallback + 1, fallback + 1 + num_models));
+		assert len(descs) <= 0x10000;
+
+		models_str = StringIO();
+		models_str.write("\tCPUT_CONSTEXPR CPUModelDesc const CPU_MODELS[] =\n");
+		models_str.write("\t{\n");
+		for desc in descs:
+			desc.GenSource(models_str, pool);
+		models_str.write("\t};\n\n");
+
+		models_str.write("\tCPUT_CONSTEXPR CPUVendorDesc const CPU_VENDORS[] =\n");
+		models_str.write("\t{\n");
+		for vendor in vendors:
+			words = vendor[0].IdWords();
+			models_str.write("\t\t{ { 0x%08X, 0x%08X, 0x%08X }, %d, %d, %d },\t// %s\n" % (words[0], words[1], words[2],
+				vendor[1], vendor[2], vendor[3], vendor[0].vendor_id));
+		models_str.write("\t};\n");
+
+		pool.GenSource(source_str);
+		source_str.write("\n");
+		source_str.write(models_str.getvalue());
+
+
+# The type attribute of caches.xml to CacheDescKind
+CACHE_KINDS = {
+	"" : "CDK_None",
+	"L0 data TLB" : "CDK_L0DataTLB",
+	"L1 data TLB" : "CDK_L1DataTLB",
+	"L2 data TLB" : "CDK_L2DataTLB",
+	"Code TLB" : "CDK_CodeTLB",
+	"Data TLB" : "CDK_DataTLB",
+	"L2 TLB" : "CDK_L2TLB",
+	"L1 code cache" : "CDK_L1CodeCache",
+	"L1 data cache" : "CDK_L1DataCache",
+	"L1 trace cache" : "CDK_L1TraceCache",
+	"L2 cache" : "CDK_L2Cache",
+	"L3 cache" : "CDK_L3Cache",
+};
+CACHE_KIND_ORDER = ["CDK_None", "CDK_L0DataTLB", "CDK_L1DataTLB", "CDK_L2DataTLB", "CDK_CodeTLB", "CDK_DataTLB",
+	"CDK_L2TLB", "CDK_L1CodeCache", "CDK_L1DataCache", "CDK_L1TraceCache", "CDK_L2Cache", "CDK_L3Cache"];
 
+def PageSizeShift(page):
+	units = { "K" : 10, "M" : 20, "G" : 30 };
+	value = int(page[:-1]);
+	assert (value & (value - 1)) == 0;
+	shift = units[page[-1]];
+	while value > 1:
+		value >>= 1;
+		shift += 1;
+	return shift;
+
+# "4K/2M" is a list of page sizes, "4K-256M" is every power of 2 in between. Bit n set means 2^n byte pages.
+def PageSizes(page):
+	mask = 0;
+	if len(page) > 0:
+		for sizes in page.split("/"):
+			bounds = sizes.split("-");
+			for shift in range(PageSizeShift(bounds[0]), PageSizeShift(bounds[-1]) + 1):
+				mask |= 1 << shift;
+	assert mask <= 0xFFFFFFFF;
+	return mask;
 
 class CacheCodeFamily:
 	def __init__(self, value, type, page, size, way, entry, line):
@@ -186,29 +300,32 @@ class CacheCode:
 				self.families.append(CacheCodeFamily(family.getAttribute("value"),
 						family.getAttribute("type"), family.getAttribute("page"), family.getAttribute("size"),
 						family.getAttribute("way"), family.getAttribute("entry"), family.getAttribute("line")));
+
+	def GenDesc(self, source_str, family, over):
+		code = int(self.value, 16);
+		kind = CACHE_KINDS[AttrOr(over.type, self.type)];
+		page_sizes = PageSizes(AttrOr(over.page, self.page));
+		size = int(AttrOr(over.size, AttrOr(self.size, "0")));
+		# Decimal, except FF for fully associative
+		way = AttrOr(over.way, AttrOr(self.way, "0"));
+		if "FF" == way:
+			way = 0xFF;
+		else:
+			way = int(way);
+		# "4/8" gives a count per page size. Keep the largest, the one of the smallest pages. The reach is the same.
+		entries = max([int(entry) for entry in AttrOr(over.entry, AttrOr(self.entry, "0")).split("/")]);
+		line = int(AttrOr(over.line, AttrOr(self.line, "0")));
+		assert (code <= 0xFF) and (family <= 0xFF) and (size <= 0xFFFF) and (way <= 0xFF) and (entries <= 0xFFFF) and (line <= 0xFF);
+		source_str.write("\t\t{ 0x%02X, 0x%X, %s, %d, %d, 0x%08X, %d, %d },\n" % (code, family,
+			kind, way, line, page_sizes, size, entries));
 					
 	def GenSource(self, source_str):
-		if len(self.families) > 0:
-			source_str.write("\t\tswitch (family)\n");
-			source_str.write("\t\t{\n");
-			for family in self.families:
-				source_str.write("\t\tcase 0x%s:\n" % family.value);
-				if len(family.type) > 0:
-					source_str.write("\t\t\ttype = \"%s\";\n" % family.type);
-				if len(family.page) > 0:
-					source_str.write("\t\t\tpage = \"%s\";\n" % family.page);
-				if len(family.size) > 0:
-					source_str.write("\t\t\tsize = %s;\n" % family.size);
-				if len(family.way) > 0:
-					source_str.write("\t\t\tway = 0x%s;\n" % family.way);
-				if len(family.entry) > 0:
-					source_str.write("\t\t\tentry = %s;\n" % family.entry);
-				if len(family.line) > 0:
-					source_str.write("\t\t\tline = %s;\n" % family.line);
-				source_str.write("\t\t\tbreak;\n\n");
-			source_str.write("\t\tdefault:\n");
-			source_str.write("\t\t\tbreak;\n");
-			source_str.write("\t\t}\n");
+		none = CacheCodeFamily("", "", "", "", "", "", "");
+		self.GenDesc(source_str, 0, none);
+		families = sorted(self.families, key = lambda family: int(family.value, 16));
+		for family in families:
+			assert int(family.value, 16) != 0;
+			self.GenDesc(source_str, int(family.value, 16), family);
 			
 class CacheIdentifier:
 	def __init__(self, dom):
@@ -222,53 +339,63 @@ class CacheIdentifier:
 						code.getElementsByTagName("family")));
 						
 	def GenSource(self, source_str):
-		source_str.write("\tswitch (code)\n");
+		# Sorted by code, then by family. Family 0 is the entry for the families without their own.
+		codes = sorted(self.codes, key = lambda code: int(code.value, 16));
+		for i in range(1, len(codes)):
+			assert int(codes[i - 1].value, 16) != int(codes[i].value, 16);
+
+		source_str.write("\tCPUT_CONSTEXPR CacheDesc const CACHE_DESCS[] =\n");
 		source_str.write("\t{\n");
-		for code in self.codes:
-			source_str.write("\tcase 0x%s:\n" % code.value)
-			if len(code.type) > 0:
-				source_str.write("\t\ttype = \"%s\";\n" % code.type);
-			if len(code.page) > 0:
-				source_str.write("\t\tpage = \"%s\";\n" % code.page);
-			if len(code.size) > 0:
-				source_str.write("\t\tsize = %s;\n" % code.size);
-			if len(code.way) > 0:
-				source_str.write("\t\tway = 0x%s;\n" % code.way);
-			if len(code.entry) > 0:
-				source_str.write("\t\tentry = \"%s\";\n" % code.entry);
-			if len(code.line) > 0:
-				source_str.write("\t\tline = %s;\n" % code.line);
+		for code in codes:
 			code.GenSource(source_str);
-			source_str.write("\t\tbreak;\n\n");
-		source_str.write("\t\tdefault:\n");
-		source_str.write("\t\t\tbreak;\n");
-		source_str.write("\t}\n");
-
+		source_str.write("\t};\n");
 
-def CreateCpuIdentifierSource(cpu_identifier, base_dir):
-	source_str = StringIO()
-
-	source_str.write("//AUTO-GENERATED BY autogen.py. DON'T EDIT THIS FILE.\n\n");
-
-	source_str.write("void CPUIdentify(std::string const & vendor_id, int family, int model, int stepping,\n");
-	source_str.write("\t\tstd::string& name, std::string& tech, std::string& transistors, std::string& codename, std::string& package)\n");
-	source_str.write("{\n");
-	if len(cpu_identifier.name) > 0:
-		source_str.write("\tname = \"%s\";\n" % cpu_identifier.name);
-	cpu_identifier.GenSource(source_str);
-	source_str.write("}\n");
 
+def WriteIfChanged(new_source_str, file_name):
 	try:
-		cur_source_file = open(base_dir + "/../CPUIdentifier.cpp", "r")
+		cur_source_file = open(file_name, "r")
 		cur_source_str = cur_source_file.read()
 		cur_source_file.close()
 	except:
 		cur_source_str = ""
-	new_source_str = source_str.getvalue()
 	if new_source_str != cur_source_str:
-		source_file = open(base_dir + "/../CPUIdentifier.cpp", "w")
+		source_file = open(file_name, "w")
 		source_file.write(new_source_str)
 		source_file.close()
+		return True
+	else:
+		return False
+
+def CreateCpuIdentifierSource(cpu_identifier, base_dir):
+	source_str = StringIO()
+
+	source_str.write("//AUTO-GENERATED BY autogen.py. DON'T EDIT THIS FILE.\n\n");
+
+	source_str.write("\t// Strings are offsets into CPU_STRINGS\n");
+	source_str.write("\tstruct CPUModelDesc\n");
+	source_str.write("\t{\n");
+	source_str.write("\t\tuint32_t key;\t\t\t\t// family << 16 | model << 4 | last stepping, model 0x%X matches any model\n" % ANY_MODEL);
+	source_str.write("\t\tuint8_t first_stepping;\n");
+	source_str.write("\t\tuint16_t name;\n");
+	source_str.write("\t\tuint16_t tech;\n");
+	source_str.write("\t\tuint16_t transistors;\n");
+	source_str.write("\t\tuint16_t codename;\n");
+	source_str.write("\t\tuint16_t package;\n");
+	source_str.write("\t};\n\n");
+
+	source_str.write("\tstruct CPUVendorDesc\n");
+	source_str.write("\t{\n");
+	source_str.write("\t\tuint32_t id[3];\t\t\t\t// CPUID leaf 0 EBX, EDX, ECX\n");
+	source_str.write("\t\tuint16_t fallback;\t\t\t// Index into CPU_MODELS for the unknown families\n");
+	source_str.write("\t\tuint16_t first_model;\t\t// [first_model, last_model) in CPU_MODELS\n");
+	source_str.write("\t\tuint16_t last_model;\n");
+	source_str.write("\t};\n\n");
+
+	source_str.write("\tuint32_t const CPU_ANY_MODEL = 0x%X;\n\n" % ANY_MODEL);
+
+	cpu_identifier.GenSource(source_str);
+
+	if WriteIfChanged(source_str.getvalue(), base_dir + "/../CPUIdentifier.cpp"):
 		print("CPUIdentifier.cpp has been updated")
 	else:
 		print("No change detected. Skip CPUIdentifier.cpp")
@@ -278,23 +405,27 @@ def CreateCacheIdentifierSource(cache_identifier, base_dir):
 
 	source_str.write("//AUTO-GENERATED BY autogen.py. DON'T EDIT THIS FILE.\n\n");
 
-	source_str.write("void CacheIdentify(int code, int family,\n");
-	source_str.write("\t\tstd::string& type, std::string& page, int& size, int& way, std::string& entry, int& line)\n");
-	source_str.write("{\n");
+	source_str.write("\tenum CacheDescKind\n");
+	source_str.write("\t{\n");
+	for kind in CACHE_KIND_ORDER:
+		source_str.write("\t\t%s,\n" % kind);
+	source_str.write("\t};\n\n");
+
+	source_str.write("\tstruct CacheDesc\n");
+	source_str.write("\t{\n");
+	source_str.write("\t\tuint8_t code;\n");
+	source_str.write("\t\tuint8_t family;\t\t\t\t// 0 matches the families without their own entry\n");
+	source_str.write("\t\tuint8_t kind;\t\t\t\t// CacheDescKind\n");
+	source_str.write("\t\tuint8_t way;\t\t\t\t// 0xFF if fully associative\n");
+	source_str.write("\t\tuint8_t line;\t\t\t\t// Bytes\n");
+	source_str.write("\t\tuint32_t page_sizes;\t\t// TLBs. Bit n set means 2^n byte pages\n");
+	source_str.write("\t\tuint16_t size;\t\t\t\t// Caches. KB, K-uops for trace caches\n");
+	source_str.write("\t\tuint16_t entries;\t\t\t// TLBs\n");
+	source_str.write("\t};\n\n");
+
 	cache_identifier.GenSource(source_str);
-	source_str.write("}\n");
 
-	try:
-		cur_source_file = open(base_dir + "/../CacheIdentifier.cpp", "r")
-		cur_source_str = cur_source_file.read()
-		cur_source_file.close()
-	except:
-		cur_source_str = ""
-	new_source_str = source_str.getvalue()
-	if new_source_str != cur_source_str:
-		source_file = open(base_dir + "/../CacheIdentifier.cpp", "w")
-		source_file.write(new_source_str)
-		source_file.close()
+	if WriteIfChanged(source_str.getvalue(), base_dir + "/../CacheIdentifier.cpp"):
 		print("CacheIdentifier.cpp has been updated")
 	else:
 		print("No change detected. Skip CacheIdentifier.cpp")
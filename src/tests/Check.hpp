@@ -0,0 +1,83 @@
+/**
+ * @file Check.hpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of the CPUTSDK tests, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#ifndef _CPUTTESTS_CHECK_HPP
+#define _CPUTTESTS_CHECK_HPP
+
+#include <CPU-T/CPU.hpp>
+#include <CPU-T/CPUIDDump.hpp>
+#include <cstdio>
+#include <memory>
+
+// A failed check is reported and counted, and the test goes on. main() returns the count, so CTest fails.
+#define CPUT_CHECK(cond) \
+	do \
+	{ \
+		if (!(cond)) \
+		{ \
+			fprintf(stderr, "%s(%d): check failed: %s\n", __FILE__, __LINE__, #cond); \
+			++ CPUTTests::Failures(); \
+		} \
+	} while (0)
+
+namespace CPUTTests
+{
+	inline int& Failures()
+	{
+		static int failures = 0;
+		return failures;
+	}
+
+	// The CPUInfo of a recorded dump, nullptr if it can't be loaded.
+	inline std::unique_ptr<CPUT::CPUInfo> LoadDump(char const * path)
+	{
+		CPUT::CPUIDDump dump;
+		if (!dump.Load(path))
+		{
+			fprintf(stderr, "Can't load the dump %s\n", path);
+			return std::unique_ptr<CPUT::CPUInfo>();
+		}
+		return std::unique_ptr<CPUT::CPUInfo>(new CPUT::CPUInfo(dump));
+	}
+
+	// Every CPU of the machine, whatever the process is allowed to run on.
+	inline CPUT::CPUSet AllCPUs(CPUT::CPUInfo const & cpu)
+	{
+		CPUT::CPUSet ret;
+		std::vector<CPUT::CPUInfo::LogicalProcessorInfo> const & lps = cpu.LogicalProcessors();
+		for (size_t i = 0; i < lps.size(); ++ i)
+		{
+			ret.Set(lps[i].os_index);
+		}
+		return ret;
+	}
+}
+
+#endif		// _CPUTTESTS_CHECK_HPP
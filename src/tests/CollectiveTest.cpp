@@ -0,0 +1,114 @@
+/**
+ * @file CollectiveTest.cpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of the CPUTSDK tests, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#include <CPU-T/Collective.hpp>
+#include "Check.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Expects a multi-core dump, so the tree has more than one level. Nothing gets bound, more participants than
+// CPUs only slows it down.
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: CollectiveTest <dump>\n");
+		return 1;
+	}
+	std::unique_ptr<CPUT::CPUInfo> const cpu = CPUTTests::LoadDump(argv[1]);
+	if (!cpu)
+	{
+		return 1;
+	}
+
+	CPUT::PlacementAdvisor const advisor(*cpu, CPUTTests::AllCPUs(*cpu));
+	CPUT::Collective collective(*cpu, advisor.Place(0, CPUT::PlacementAdvisor::PP_Compact));
+	int const n = collective.NumParticipants();
+	CPUT_CHECK(n == 8);
+	CPUT_CHECK(collective.NumLevels() > 1);
+
+	int const ROUNDS = 200;
+	std::vector<int> wrong_sum(n, 0);
+	std::vector<int> wrong_broadcast(n, 0);
+	std::vector<double> totals(n * ROUNDS, 0);
+
+	std::vector<std::thread> threads;
+	for (int p = 0; p < n; ++ p)
+	{
+		threads.push_back(std::thread([&, p]
+			{
+				for (int r = 0; r < ROUNDS; ++ r)
+				{
+					int const sum = collective.AllReduce(p, p + r, [](int a, int b) { return a + b; });
+					if (sum != n * (n - 1) / 2 + n * r)
+					{
+						++ wrong_sum[p];
+					}
+
+					int const root = r % n;
+					if (collective.Broadcast(p, root, p * 1000 + r) != root * 1000 + r)
+					{
+						++ wrong_broadcast[p];
+					}
+
+					// Not associative in floating point, so every participant has to get the same one result
+					totals[r * n + p] = collective.AllReduce(p, 1.0 / (p + r + 3), [](double a, double b) { return a + b; });
+
+					collective.Barrier(p);
+				}
+			}));
+	}
+	for (size_t i = 0; i < threads.size(); ++ i)
+	{
+		threads[i].join();
+	}
+
+	for (int p = 0; p < n; ++ p)
+	{
+		CPUT_CHECK(0 == wrong_sum[p]);
+		CPUT_CHECK(0 == wrong_broadcast[p]);
+	}
+	int mismatches = 0;
+	for (int r = 0; r < ROUNDS; ++ r)
+	{
+		for (int p = 1; p < n; ++ p)
+		{
+			if (totals[r * n + p] != totals[r * n])
+			{
+				++ mismatches;
+			}
+		}
+	}
+	CPUT_CHECK(0 == mismatches);
+
+	return CPUTTests::Failures();
+}
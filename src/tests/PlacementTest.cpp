@@ -0,0 +1,116 @@
+/**
+ * @file PlacementTest.cpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of the CPUTSDK tests, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#include <CPU-T/Placement.hpp>
+#include "Check.hpp"
+
+#include <string>
+
+namespace
+{
+	// The CPU picked for each worker, in worker order, such as "0,2,1,3".
+	std::string PickedCPUs(CPUT::PlacementAdvisor::Plan const & plan)
+	{
+		std::string ret;
+		for (size_t i = 0; i < plan.workers.size(); ++ i)
+		{
+			if (!ret.empty())
+			{
+				ret += ',';
+			}
+			ret += std::to_string(plan.workers[i].cpu);
+		}
+		return ret;
+	}
+}
+
+// Expects xeon_4c8t_2l3.txt: 4 cores with 2 threads each, CPUs 0-3 sharing one L3 and 4-7 the other.
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: PlacementTest <dump>\n");
+		return 1;
+	}
+	std::unique_ptr<CPUT::CPUInfo> const cpu = CPUTTests::LoadDump(argv[1]);
+	if (!cpu)
+	{
+		return 1;
+	}
+
+	typedef CPUT::PlacementAdvisor PA;
+	PA const advisor(*cpu, CPUTTests::AllCPUs(*cpu));
+
+	CPUT_CHECK(advisor.NumUsableCores() == 4);
+	CPUT_CHECK(advisor.Domains().size() == 2);
+	if (advisor.Domains().size() == 2)
+	{
+		CPUT_CHECK(advisor.Domains()[0].cpus.ToString() == "0-3");
+		CPUT_CHECK(advisor.Domains()[1].cpus.ToString() == "4-7");
+		CPUT_CHECK(advisor.Domains()[0].cores == 2);
+	}
+
+	// Compact fills a domain, SMT siblings included, before the next one
+	CPUT_CHECK(PickedCPUs(advisor.Place(0, PA::PP_Compact)) == "0,2,1,3,4,6,5,7");
+	CPUT_CHECK(PickedCPUs(advisor.Place(0, PA::PP_Compact, PA::PF_AvoidSMT)) == "0,2,4,6");
+	CPUT_CHECK(PickedCPUs(advisor.Place(0, PA::PP_Compact, PA::PF_AvoidSMT | PA::PF_ReserveCore0)) == "2,4,6");
+
+	// Spread alternates the domains, and only then comes back for the siblings
+	CPUT_CHECK(PickedCPUs(advisor.Place(0, PA::PP_Spread)) == "0,4,2,6,1,5,3,7");
+	CPUT_CHECK(PickedCPUs(advisor.Place(0, PA::PP_Spread, PA::PF_AvoidSMT)) == "0,4,2,6");
+
+	PA::Plan plan = advisor.Place(3, PA::PP_Spread, PA::PF_AvoidSMT);
+	CPUT_CHECK(!plan.oversubscribed);
+	CPUT_CHECK(PickedCPUs(plan) == "0,4,2");
+	CPUT_CHECK((plan.workers.size() == 3) && (0 == plan.workers[0].domain) && (1 == plan.workers[1].domain));
+
+	plan = advisor.Place(6, PA::PP_Compact, PA::PF_AvoidSMT);
+	CPUT_CHECK(plan.oversubscribed);
+	CPUT_CHECK(PickedCPUs(plan) == "0,2,4,6,0,2");
+
+	// The scope only widens what each worker is bound to
+	plan = advisor.Place(2, PA::PP_Compact, PA::PF_AvoidSMT, PA::PS_Thread);
+	CPUT_CHECK((plan.workers.size() == 2) && (plan.workers[1].cpus.ToString() == "2"));
+	plan = advisor.Place(2, PA::PP_Compact, PA::PF_AvoidSMT, PA::PS_Core);
+	CPUT_CHECK((plan.workers.size() == 2) && (plan.workers[1].cpus.ToString() == "2-3"));
+	plan = advisor.Place(2, PA::PP_Compact, PA::PF_AvoidSMT, PA::PS_Domain);
+	CPUT_CHECK((plan.workers.size() == 2) && (plan.workers[1].cpus.ToString() == "0-3"));
+	plan = advisor.Place(2, PA::PP_Compact, PA::PF_AvoidSMT, PA::PS_Node);
+	CPUT_CHECK((plan.workers.size() == 2) && (plan.workers[1].cpus.ToString() == "0-7"));
+
+	// Only the allowed CPUs are handed out
+	CPUT::CPUSet allowed;
+	allowed.FromString("1,4-5");
+	PA const restricted(*cpu, allowed);
+	CPUT_CHECK(restricted.NumUsableCores() == 2);
+	CPUT_CHECK(PickedCPUs(restricted.Place(0, PA::PP_Compact)) == "1,4,5");
+
+	return CPUTTests::Failures();
+}
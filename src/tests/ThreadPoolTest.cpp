@@ -0,0 +1,122 @@
+/**
+ * @file ThreadPoolTest.cpp
+ * @author Minmin Gong
+ *
+ * @section DESCRIPTION
+ *
+ * This source file is part of the CPUTSDK tests, a subproject of CPU-T
+ * For the latest info, see http://www.klayge.org
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ * You may alternatively use this source under the terms of
+ * the KlayGE Proprietary License (KPL). You can obtained such a license
+ * from http://www.klayge.org/licensing/.
+ */
+
+#include <CPU-T/ThreadPool.hpp>
+#include "Check.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace
+{
+	// Sum of [begin, end), split in halves through a task group down to small ranges.
+	long long ForkJoinSum(CPUT::ThreadPool& pool, int begin, int end)
+	{
+		if (end - begin <= 16)
+		{
+			long long sum = 0;
+			for (int i = begin; i < end; ++ i)
+			{
+				sum += i;
+			}
+			return sum;
+		}
+
+		int const mid = begin + (end - begin) / 2;
+		long long left = 0;
+		long long right = 0;
+		CPUT::TaskGroup group;
+		pool.Submit(group, [&pool, &left, begin, mid] { left = ForkJoinSum(pool, begin, mid); });
+		pool.Submit(group, [&pool, &right, mid, end] { right = ForkJoinSum(pool, mid, end); });
+		pool.Wait(group);
+		return left + right;
+	}
+}
+
+int main()
+{
+	{
+		CPUT::ThreadPool pool(CPUT::CPUInfo::Instance(), 4);
+		CPUT_CHECK(pool.NumWorkers() == 4);
+		CPUT_CHECK(pool.CurrentWorker() == -1);
+
+		// Nested fork/join, each level waiting on its own group from inside a task
+		for (int round = 0; round < 20; ++ round)
+		{
+			long long sum = 0;
+			CPUT::TaskGroup group;
+			pool.Submit(group, [&pool, &sum] { sum = ForkJoinSum(pool, 0, 10000); });
+			pool.Wait(group);
+			CPUT_CHECK(group.Done());
+			CPUT_CHECK(sum == 10000LL * 9999 / 2);
+		}
+
+		// Flat submits, with a pause in between so the workers get parked and woken again
+		std::atomic<int> count(0);
+		std::atomic<int> bad_worker(0);
+		for (int round = 0; round < 5; ++ round)
+		{
+			for (int i = 0; i < 1000; ++ i)
+			{
+				pool.Submit([&pool, &count, &bad_worker]
+					{
+						int const worker = pool.CurrentWorker();
+						if ((worker < 0) || (worker >= pool.NumWorkers()))
+						{
+							++ bad_worker;
+						}
+						++ count;
+					});
+			}
+			pool.Wait();
+			CPUT_CHECK(count == (round + 1) * 1000);
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		}
+		CPUT_CHECK(0 == bad_worker);
+	}
+
+	// The destructor runs what's still queued
+	std::atomic<int> drained(0);
+	{
+		CPUT::ThreadPool pool(CPUT::CPUInfo::Instance(), 2);
+		for (int i = 0; i < 500; ++ i)
+		{
+			pool.Submit([&drained]
+				{
+					std::this_thread::yield();
+					++ drained;
+				});
+		}
+	}
+	CPUT_CHECK(500 == drained);
+
+	return CPUTTests::Failures();
+}
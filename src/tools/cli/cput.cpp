@@ -0,0 +1,601 @@
+#include <CPU-T/CPU.hpp>
+#include <CPU-T/CPUIDDump.hpp>
+#include <CPU-T/CPUSet.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// Prints nested objects and arrays either as JSON, or as one key=value line per field with the keys
+	// of the enclosing objects and the array indices joined by dots. Arrays of plain values are one
+	// comma separated line in the flat form.
+	class Writer
+	{
+	public:
+		explicit Writer(bool json)
+			: json_(json)
+		{
+		}
+
+		void BeginObject(char const * name)
+		{
+			this->Begin(name, '{', false);
+		}
+		void EndObject()
+		{
+			this->End('}');
+		}
+		void BeginArray(char const * name)
+		{
+			this->Begin(name, '[', false);
+		}
+		void BeginValueArray(char const * name)
+		{
+			this->Begin(name, '[', true);
+		}
+		void EndArray()
+		{
+			this->End(']');
+		}
+
+		void Field(char const * name, char const * value)
+		{
+			std::string str;
+			if (json_)
+			{
+				str = "\"";
+				for (char const * p = value; *p != '\0'; ++ p)
+				{
+					if (('"' == *p) || ('\\' == *p))
+					{
+						str += '\\';
+						str += *p;
+					}
+					else if (static_cast<unsigned char>(*p) < 0x20)
+					{
+						char buf[8];
+						sprintf(buf, "\\u%04x", static_cast<unsigned char>(*p));
+						str += buf;
+					}
+					else
+					{
+						str += *p;
+					}
+				}
+				str += "\"";
+			}
+			else
+			{
+				str = value;
+			}
+			this->Emit(name, str);
+		}
+		void Field(char const * name, std::string const & value)
+		{
+			this->Field(name, value.c_str());
+		}
+		void Field(char const * name, CPUT::uint64 value)
+		{
+			char buf[32];
+			sprintf(buf, "%llu", static_cast<unsigned long long>(value));
+			this->Emit(name, buf);
+		}
+		void Field(char const * name, unsigned int value)
+		{
+			this->Field(name, static_cast<CPUT::uint64>(value));
+		}
+		void Field(char const * name, int value)
+		{
+			char buf[16];
+			sprintf(buf, "%d", value);
+			this->Emit(name, buf);
+		}
+		void Field(char const * name, bool value)
+		{
+			this->Emit(name, value ? "true" : "false");
+		}
+		void Field(char const * name, double value)
+		{
+			char buf[32];
+			sprintf(buf, "%.3f", value);
+			this->Emit(name, buf);
+		}
+
+		void Finish()
+		{
+			if (json_)
+			{
+				fputc('\n', stdout);
+			}
+		}
+
+	private:
+		struct Scope
+		{
+			std::string prefix;			// Flat form, the key of this scope followed by a dot
+			int count;					// Children written so far
+			bool values;				// An array of plain values
+			std::string line;			// Flat form, the values of a value array
+		};
+
+		std::string Key(char const * name)
+		{
+			Scope& scope = scopes_.back();
+			std::string key = scope.prefix;
+			if (name != nullptr)
+			{
+				key += name;
+			}
+			else
+			{
+				char buf[16];
+				sprintf(buf, "%d", scope.count);
+				key += buf;
+			}
+			return key;
+		}
+
+		void Separate(char const * name)
+		{
+			Scope& scope = scopes_.back();
+			if (scope.count > 0)
+			{
+				fputc(',', stdout);
+			}
+			if (!scope.values)
+			{
+				fputc('\n', stdout);
+				for (size_t i = 0; i < scopes_.size(); ++ i)
+				{
+					fputc('\t', stdout);
+				}
+			}
+			if (name != nullptr)
+			{
+				printf("\"%s\": ", name);
+			}
+		}
+
+		void Begin(char const * name, char open, bool values)
+		{
+			Scope scope;
+			scope.count = 0;
+			scope.values = values;
+			if (scopes_.empty())
+			{
+				if (json_)
+				{
+					fputc(open, stdout);
+				}
+			}
+			else
+			{
+				if (json_)
+				{
+					this->Separate(name);
+					fputc(open, stdout);
+				}
+				else
+				{
+					scope.prefix = this->Key(name) + ".";
+				}
+				++ scopes_.back().count;
+			}
+			scopes_.push_back(scope);
+		}
+
+		void End(char close)
+		{
+			Scope const & scope = scopes_.back();
+			if (json_)
+			{
+				if ((scope.count > 0) && !scope.values)
+				{
+					fputc('\n', stdout);
+					for (size_t i = 1; i < scopes_.size(); ++ i)
+					{
+						fputc('\t', stdout);
+					}
+				}
+				fputc(close, stdout);
+			}
+			else if (scope.values)
+			{
+				// Drops the trailing dot of the prefix
+				printf("%s=%s\n", scope.prefix.substr(0, scope.prefix.size() - 1).c_str(), scope.line.c_str());
+			}
+			scopes_.pop_back();
+		}
+
+		void Emit(char const * name, std::string const & value)
+		{
+			Scope& scope = scopes_.back();
+			if (json_)
+			{
+				this->Separate(scope.values ? nullptr : name);
+				fputs(value.c_str(), stdout);
+			}
+			else if (scope.values)
+			{
+				if (scope.count > 0)
+				{
+					scope.line += ',';
+				}
+				scope.line += value;
+			}
+			else
+			{
+				printf("%s=%s\n", this->Key(name).c_str(), value.c_str());
+			}
+			++ scope.count;
+		}
+
+	private:
+		bool json_;
+		std::vector<Scope> scopes_;
+	};
+
+	char const * CacheTypeName(CPUT::CPUInfo::CacheType type)
+	{
+		switch (type)
+		{
+		case CPUT::CPUInfo::CT_Data:
+			return "data";
+		case CPUT::CPUInfo::CT_Code:
+			return "code";
+		default:
+			return "unified";
+		}
+	}
+
+	char const * CoreTypeName(CPUT::CPUInfo::CoreType type)
+	{
+		switch (type)
+		{
+		case CPUT::CPUInfo::HCT_Core:
+			return "core";
+		case CPUT::CPUInfo::HCT_Atom:
+			return "atom";
+		default:
+			return "unknown";
+		}
+	}
+
+	char const * TLBTypeName(CPUT::CPUInfo::TLBType type)
+	{
+		switch (type)
+		{
+		case CPUT::CPUInfo::TT_Data:
+			return "data";
+		case CPUT::CPUInfo::TT_Code:
+			return "code";
+		case CPUT::CPUInfo::TT_LoadOnly:
+			return "load";
+		case CPUT::CPUInfo::TT_StoreOnly:
+			return "store";
+		default:
+			return "unified";
+		}
+	}
+
+	void WriteCache(Writer& writer, char const * name, CPUT::CPUInfo::CacheInfo const & cache)
+	{
+		writer.BeginObject(name);
+		writer.Field("size_kb", cache.size);
+		writer.Field("way", cache.way);
+		writer.Field("line", cache.line);
+		writer.EndObject();
+	}
+
+	void WritePageSizes(Writer& writer, CPUT::uint64 page_sizes)
+	{
+		writer.BeginValueArray("page_sizes");
+		for (int shift = 0; shift < 64; ++ shift)
+		{
+			if ((page_sizes >> shift) & 1)
+			{
+				writer.Field(nullptr, static_cast<CPUT::uint64>(1) << shift);
+			}
+		}
+		writer.EndArray();
+	}
+
+	void WriteFeatures(Writer& writer, char const * name, CPUT::CPUInfo::FeatureSet const & features)
+	{
+		writer.BeginValueArray(name);
+		for (int i = 0; i < CPUT::CPUInfo::CF_NumFeatures; ++ i)
+		{
+			if (features.test(i) && (i != CPUT::CPUInfo::CF_HTT))
+			{
+				writer.Field(nullptr, CPUT::CPUInfo::FeatureName(static_cast<CPUT::CPUInfo::CPUFeature>(i)));
+			}
+		}
+		writer.EndArray();
+	}
+
+	void PrintUsage()
+	{
+		printf("Usage: cput [options]\n"
+			"  --json                   Prints JSON (default)\n"
+			"  --flat                   Prints one key=value line per field\n"
+			"  --fast                   Skips the frequency calibration and the per-CPU topology probe,\n"
+			"                           unless they come from a probe cache or a dump\n"
+			"  --probe-cache <path>     Loads the probe cache if it matches this boot\n"
+			"  --save-probe-cache <path> Writes the probe cache for later runs\n"
+			"  --replay <path>          Decodes a CPUID dump instead of this machine\n"
+			"  --save-dump <path>       Writes the CPUID dump of this machine\n");
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	bool json = true;
+	bool fast = false;
+	char const * probe_cache_path = nullptr;
+	char const * save_probe_cache_path = nullptr;
+	char const * replay_path = nullptr;
+	char const * save_dump_path = nullptr;
+	for (int i = 1; i < argc; ++ i)
+	{
+		bool const has_value = (i + 1 < argc);
+		if (0 == strcmp(argv[i], "--json"))
+		{
+			json = true;
+		}
+		else if (0 == strcmp(argv[i], "--flat"))
+		{
+			json = false;
+		}
+		else if (0 == strcmp(argv[i], "--fast"))
+		{
+			fast = true;
+		}
+		else if ((0 == strcmp(argv[i], "--probe-cache")) && has_value)
+		{
+			probe_cache_path = argv[++ i];
+		}
+		else if ((0 == strcmp(argv[i], "--save-probe-cache")) && has_value)
+		{
+			save_probe_cache_path = argv[++ i];
+		}
+		else if ((0 == strcmp(argv[i], "--replay")) && has_value)
+		{
+			replay_path = argv[++ i];
+		}
+		else if ((0 == strcmp(argv[i], "--save-dump")) && has_value)
+		{
+			save_dump_path = argv[++ i];
+		}
+		else
+		{
+			PrintUsage();
+			return (0 == strcmp(argv[i], "--help")) ? 0 : 1;
+		}
+	}
+
+	std::unique_ptr<CPUT::CPUInfo> cpu_ptr;
+	if (replay_path != nullptr)
+	{
+		CPUT::CPUIDDump dump;
+		if (!dump.Load(replay_path))
+		{
+			fprintf(stderr, "cput: can't load the dump %s\n", replay_path);
+			return 1;
+		}
+		cpu_ptr.reset(new CPUT::CPUInfo(dump));
+	}
+	else
+	{
+		cpu_ptr.reset(new CPUT::CPUInfo(probe_cache_path));
+	}
+	CPUT::CPUInfo const & cpu = *cpu_ptr;
+
+	// Anything that would pin threads or sleep is skipped in fast mode, unless it's already known.
+	bool const cheap_topology = !fast || cpu.FromProbeCache() || (replay_path != nullptr);
+	bool const cheap_frequency = cheap_topology || (cpu.TSCFrequency() != 0) || (cpu.NominalFrequency() != 0);
+
+	Writer writer(json);
+	writer.BeginObject(nullptr);
+
+	writer.Field("name", cpu.CPUName());
+	writer.Field("vendor", cpu.VendorString());
+	writer.Field("brand", cpu.BrandString());
+	writer.Field("codename", cpu.CodeName());
+	writer.Field("technology", cpu.Technology());
+	writer.Field("transistors", cpu.Transistors());
+	writer.Field("package", cpu.Package());
+	if (cpu.SerialNumber()[0] != '\0')
+	{
+		writer.Field("serial_number", cpu.SerialNumber());
+	}
+	writer.Field("type", cpu.Type());
+	writer.Field("family", cpu.Family());
+	writer.Field("model", cpu.Model());
+	writer.Field("stepping", cpu.Stepping());
+	writer.Field("probe_cache", cpu.FromProbeCache());
+
+	writer.BeginObject("frequency");
+	if (cheap_frequency)
+	{
+		writer.Field("current_mhz", cpu.Frequency());
+	}
+	writer.Field("tsc_mhz", cpu.TSCFrequency());
+	writer.Field("nominal_mhz", cpu.NominalFrequency());
+	writer.Field("max_mhz", cpu.MaxFrequency());
+	writer.Field("bus_mhz", cpu.BusFrequency());
+	writer.Field("invariant_tsc", cpu.IsInvariantTSC());
+	writer.EndObject();
+
+	char xcr0[32];
+	sprintf(xcr0, "0x%llx", static_cast<unsigned long long>(cpu.XCR0()));
+	writer.Field("xcr0", xcr0);
+	WriteFeatures(writer, "features", cpu.FeatureMask());
+	WriteFeatures(writer, "hardware_features", cpu.HardwareFeatureMask());
+
+	writer.BeginObject("caches");
+	WriteCache(writer, "l1_code", cpu.L1CodeCache());
+	WriteCache(writer, "l1_data", cpu.L1DataCache());
+	WriteCache(writer, "l2", cpu.L2Cache());
+	WriteCache(writer, "l3", cpu.L3Cache());
+	writer.EndObject();
+
+	writer.BeginArray("tlbs");
+	for (size_t i = 0; i < cpu.TLBs().size(); ++ i)
+	{
+		CPUT::CPUInfo::TLBLevelInfo const & tlb = cpu.TLBs()[i];
+		writer.BeginObject(nullptr);
+		writer.Field("level", tlb.level);
+		writer.Field("type", TLBTypeName(tlb.type));
+		WritePageSizes(writer, tlb.page_sizes);
+		writer.Field("way", tlb.way);
+		writer.Field("entries", tlb.entries);
+		writer.Field("max_sharing", tlb.max_sharing);
+		writer.EndObject();
+	}
+	writer.EndArray();
+
+	writer.BeginObject("tlb_reach");
+	writer.Field("4k", cpu.TLBReach(4096));
+	writer.Field("2m", cpu.TLBReach(2ULL << 20));
+	writer.Field("1g", cpu.TLBReach(1ULL << 30));
+	writer.EndObject();
+
+	if (nullptr == replay_path)
+	{
+		CPUT::EffectiveCPUs const effective = CPUT::QueryEffectiveCPUs();
+		writer.BeginObject("effective");
+		writer.Field("cpus", effective.cpus.ToString());
+		writer.Field("quota", effective.quota);
+		writer.Field("budget", effective.budget);
+		writer.Field("parallelism", effective.Parallelism());
+		writer.EndObject();
+	}
+
+	writer.BeginObject("topology");
+	writer.Field("hw_threads", cpu.NumHWThreads());
+	if (cheap_topology)
+	{
+		writer.Field("cores", cpu.NumCores());
+		writer.Field("probe_time_us", cpu.TopologyProbeTime());
+
+		writer.BeginArray("packages");
+		for (size_t p = 0; p < cpu.Packages().size(); ++ p)
+		{
+			CPUT::CPUInfo::PackageInfo const & package = cpu.Packages()[p];
+			writer.BeginObject(nullptr);
+			writer.Field("id", package.id);
+			writer.Field("cpus", package.cpus.ToString());
+			writer.BeginArray("dies");
+			for (size_t d = 0; d < package.dies.size(); ++ d)
+			{
+				CPUT::CPUInfo::DieInfo const & die = package.dies[d];
+				writer.BeginObject(nullptr);
+				writer.Field("id", die.id);
+				writer.Field("cpus", die.cpus.ToString());
+				writer.BeginArray("cores");
+				for (size_t c = 0; c < die.cores.size(); ++ c)
+				{
+					writer.BeginObject(nullptr);
+					writer.Field("id", die.cores[c].id);
+					writer.Field("cpus", die.cores[c].cpus.ToString());
+					writer.EndObject();
+				}
+				writer.EndArray();
+				writer.EndObject();
+			}
+			writer.EndArray();
+			writer.EndObject();
+		}
+		writer.EndArray();
+
+		writer.BeginArray("caches");
+		for (size_t i = 0; i < cpu.Caches().size(); ++ i)
+		{
+			CPUT::CPUInfo::CacheLevelInfo const & cache = cpu.Caches()[i];
+			writer.BeginObject(nullptr);
+			writer.Field("level", cache.level);
+			writer.Field("type", CacheTypeName(cache.type));
+			writer.Field("size_kb", cache.size);
+			writer.Field("way", cache.way);
+			writer.Field("sets", cache.sets);
+			writer.Field("line", cache.line);
+			writer.Field("partitions", cache.partitions);
+			writer.Field("inclusive", cache.inclusive);
+			writer.Field("max_sharing", cache.max_sharing);
+			writer.BeginValueArray("instances");
+			for (size_t j = 0; j < cache.instances.size(); ++ j)
+			{
+				writer.Field(nullptr, cache.instances[j].ToString());
+			}
+			writer.EndArray();
+			writer.EndObject();
+		}
+		writer.EndArray();
+
+		writer.BeginArray("numa_nodes");
+		for (size_t i = 0; i < cpu.NumaNodes().size(); ++ i)
+		{
+			CPUT::CPUInfo::NumaNodeInfo const & node = cpu.NumaNodes()[i];
+			writer.BeginObject(nullptr);
+			writer.Field("id", node.id);
+			writer.Field("cpus", node.cpus.ToString());
+			writer.Field("total_memory", node.total_memory);
+			writer.Field("free_memory", node.free_memory);
+			writer.BeginValueArray("distances");
+			for (size_t j = 0; j < node.distances.size(); ++ j)
+			{
+				writer.Field(nullptr, node.distances[j]);
+			}
+			writer.EndArray();
+			writer.EndObject();
+		}
+		writer.EndArray();
+
+		writer.Field("hybrid", cpu.IsHybrid());
+		writer.BeginArray("core_types");
+		for (size_t i = 0; i < cpu.CoreTypes().size(); ++ i)
+		{
+			CPUT::CPUInfo::CoreTypeInfo const & core_type = cpu.CoreTypes()[i];
+			writer.BeginObject(nullptr);
+			writer.Field("type", CoreTypeName(core_type.type));
+			writer.Field("native_model", core_type.native_model);
+			writer.Field("cpus", core_type.cpus.ToString());
+			writer.Field("max_mhz", core_type.max_frequency);
+			writer.BeginArray("caches");
+			for (size_t j = 0; j < core_type.caches.size(); ++ j)
+			{
+				CPUT::CPUInfo::CacheLevelInfo const & cache = core_type.caches[j];
+				writer.BeginObject(nullptr);
+				writer.Field("level", cache.level);
+				writer.Field("type", CacheTypeName(cache.type));
+				writer.Field("size_kb", cache.size);
+				writer.Field("instances", static_cast<unsigned int>(cache.instances.size()));
+				writer.EndObject();
+			}
+			writer.EndArray();
+			writer.EndObject();
+		}
+		writer.EndArray();
+	}
+	writer.EndObject();
+
+	writer.EndObject();
+	writer.Finish();
+
+	int ret = 0;
+	if ((save_probe_cache_path != nullptr) && !cpu.SaveProbeCache(save_probe_cache_path))
+	{
+		fprintf(stderr, "cput: can't write the probe cache %s\n", save_probe_cache_path);
+		ret = 1;
+	}
+	if ((save_dump_path != nullptr) && !cpu.Dump().Save(save_dump_path))
+	{
+		fprintf(stderr, "cput: can't write the dump %s\n", save_dump_path);
+		ret = 1;
+	}
+	return ret;
+}
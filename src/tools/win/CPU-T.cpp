@@ -12,7 +12,6 @@ DWORD const IDT_UPDATE_FREQ_TIMER = 1;
 
 HINSTANCE g_instance;
 bool g_in_chs;
-CPUT::CPUInfo g_CpuInfo;
 bool g_quit;
 
 INT_PTR CALLBACK AboutDlgProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM /*lParam*/)
@@ -66,7 +65,7 @@ DWORD WINAPI UpdateFreqThread(LPVOID /*lpParameter*/)
 {
     while (!g_quit)
     {
-        g_CpuInfo.UpdateFrequency();
+        CPUT::CPUInfo::Instance().UpdateFrequency();
     }
 
     return 0;
@@ -74,6 +73,8 @@ DWORD WINAPI UpdateFreqThread(LPVOID /*lpParameter*/)
 
 INT_PTR CALLBACK CPUInfoDlgProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM lParam)
 {
+	CPUT::CPUInfo const & cpu_info = CPUT::CPUInfo::Instance();
+
 	switch (uMsg) 
 	{
 	case WM_INITDIALOG:
@@ -82,152 +83,72 @@ INT_PTR CALLBACK CPUInfoDlgProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM l
 
 	case WM_SHOWWINDOW:
 		{
-			if (g_CpuInfo.CPUName() != NULL)
+			if (cpu_info.CPUName() != NULL)
 			{
-				::SetDlgItemTextA(hwndDlg, IDC_CPU, g_CpuInfo.CPUName());
+				::SetDlgItemTextA(hwndDlg, IDC_CPU, cpu_info.CPUName());
 			}
 	
-			if (g_CpuInfo.BrandString()[0] != '\0')
+			if (cpu_info.BrandString()[0] != '\0')
 			{
-				::SetDlgItemTextA(hwndDlg, IDC_SPEC, g_CpuInfo.BrandString());
+				::SetDlgItemTextA(hwndDlg, IDC_SPEC, cpu_info.BrandString());
 			}
 
-			::SetDlgItemTextA(hwndDlg, IDC_CODENAME, g_CpuInfo.CodeName());
-			::SetDlgItemTextA(hwndDlg, IDC_PACKAGE, g_CpuInfo.Package());
-			::SetDlgItemTextA(hwndDlg, IDC_TECHNOLOGY, g_CpuInfo.Technology());
-			::SetDlgItemTextA(hwndDlg, IDC_TRANSISTORS, g_CpuInfo.Transistors());
+			::SetDlgItemTextA(hwndDlg, IDC_CODENAME, cpu_info.CodeName());
+			::SetDlgItemTextA(hwndDlg, IDC_PACKAGE, cpu_info.Package());
+			::SetDlgItemTextA(hwndDlg, IDC_TECHNOLOGY, cpu_info.Technology());
+			::SetDlgItemTextA(hwndDlg, IDC_TRANSISTORS, cpu_info.Transistors());
 
 			TCHAR buf[256];
-			_stprintf(buf, TEXT("%d MHz"), g_CpuInfo.Frequency());
+			_stprintf(buf, TEXT("%d MHz"), cpu_info.Frequency());
 			::SetDlgItemText(hwndDlg, IDC_FREQUENCY, buf);
 
-			if (g_CpuInfo.Ratio() > 0)
+			if (cpu_info.Ratio() > 0)
 			{
-				_stprintf(buf, TEXT("%d"), g_CpuInfo.Ratio());
+				_stprintf(buf, TEXT("%d"), cpu_info.Ratio());
 				::SetDlgItemText(hwndDlg, IDC_RATIO, buf);
 
-				_stprintf(buf, TEXT("%f"), g_CpuInfo.Frequency() / g_CpuInfo.Ratio());
+				_stprintf(buf, TEXT("%f"), cpu_info.Frequency() / cpu_info.Ratio());
 				::SetDlgItemText(hwndDlg, IDC_MAINBOARD, buf);
 			}
 
-			_stprintf(buf, TEXT("%X"), g_CpuInfo.Type());
+			_stprintf(buf, TEXT("%X"), cpu_info.Type());
 			::SetDlgItemText(hwndDlg, IDC_TYPE, buf);
 
-			_stprintf(buf, TEXT("%X"), g_CpuInfo.Family());
+			_stprintf(buf, TEXT("%X"), cpu_info.Family());
 			::SetDlgItemText(hwndDlg, IDC_FAMILY, buf);
 
-			_stprintf(buf, TEXT("%X"), g_CpuInfo.Model());
+			_stprintf(buf, TEXT("%X"), cpu_info.Model());
 			::SetDlgItemText(hwndDlg, IDC_MODEL, buf);
 
-			_stprintf(buf, TEXT("%X"), g_CpuInfo.Stepping());
+			_stprintf(buf, TEXT("%X"), cpu_info.Stepping());
 			::SetDlgItemText(hwndDlg, IDC_STEPPING, buf);
 
-			_stprintf(buf, TEXT("%d"), g_CpuInfo.NumCores());
+			_stprintf(buf, TEXT("%d"), cpu_info.NumCores());
 			::SetDlgItemText(hwndDlg, IDC_NUM_CORES, buf);
 
-			_stprintf(buf, TEXT("%d"), g_CpuInfo.NumHWThreads());
+			_stprintf(buf, TEXT("%d"), cpu_info.NumHWThreads());
 			::SetDlgItemText(hwndDlg, IDC_NUM_THREADS, buf);
 
 			char abuf[MAX_PATH];
-			CacheDesc(abuf, g_CpuInfo.L1DataCache());
+			CacheDesc(abuf, cpu_info.L1DataCache());
 			::SetDlgItemTextA(hwndDlg, IDC_L1_DATA_CACHE, abuf);
-			CacheDesc(abuf, g_CpuInfo.L1CodeCache());
+			CacheDesc(abuf, cpu_info.L1CodeCache());
 			::SetDlgItemTextA(hwndDlg, IDC_L1_CODE_CACHE, abuf);
-			CacheDesc(abuf, g_CpuInfo.L2Cache());
+			CacheDesc(abuf, cpu_info.L2Cache());
 			::SetDlgItemTextA(hwndDlg, IDC_L2_CACHE, abuf);
-			CacheDesc(abuf, g_CpuInfo.L3Cache());
+			CacheDesc(abuf, cpu_info.L3Cache());
 			::SetDlgItemTextA(hwndDlg, IDC_L3_CACHE, abuf);
 
 			using namespace CPUT;
 
 			std::vector<std::string> instructions;
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_CMPXCHG8B))
-			{
-				instructions.push_back("CX8");
-			}
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_CMPXCHG16B))
-			{
-				instructions.push_back("CX16");
-			}
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_SYSENTER))
-			{
-				instructions.push_back("SYSENTER");
-			}
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_CMOV))
-			{
-				instructions.push_back("CMOV");
-			}
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_MMX))
-			{
-				instructions.push_back("MMX");
-			}
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_3DNow))
-			{
-				instructions.push_back("3DNow!");
-			}			
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_3DNowExt))
-			{
-				instructions.push_back("Extended 3DNow!");
-			}
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_SSE))
-			{
-				instructions.push_back("SSE");
-			}
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_SSE2))
-			{
-				instructions.push_back("SSE2");
-			}
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_SSE3))
-			{
-				instructions.push_back("SSE3");
-			}
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_SSSE3))
-			{
-				instructions.push_back("SSSE3");
-			}
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_SSE41))
-			{
-				instructions.push_back("SSE4.1");
-			}
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_SSE42))
-			{
-				instructions.push_back("SSE4.2");
-			}
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_SSE4A))
-			{
-				instructions.push_back("SSE4.A");
-			}
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_MisalignedSSE))
-			{
-				instructions.push_back("MisalignedSSE");
-			}
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_X64))
-			{
-				instructions.push_back("X64");
-			}
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_FMA3))
-			{
-				instructions.push_back("FMA3");
-			}
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_AVX))
-			{
-				instructions.push_back("AVX");
-			}
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_AVX2))
-			{
-				instructions.push_back("AVX2");
-			}
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_AES))
-			{
-				instructions.push_back("AES");
-			}
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_FMA4))
-			{
-				instructions.push_back("FMA4");
-			}
-			if (g_CpuInfo.IsFeatureSupport(CPUInfo::CF_F16C))
+			for (int i = 0; i < CPUInfo::CF_NumFeatures; ++ i)
 			{
-				instructions.push_back("F16C");
+				CPUInfo::CPUFeature const feature = static_cast<CPUInfo::CPUFeature>(i);
+				if ((feature != CPUInfo::CF_HTT) && cpu_info.IsFeatureSupport(feature))
+				{
+					instructions.push_back(CPUInfo::FeatureName(feature));
+				}
 			}
 
 			std::string instructions_str;
@@ -275,7 +196,7 @@ INT_PTR CALLBACK CPUInfoDlgProc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM l
 		if (IDT_UPDATE_FREQ_TIMER == wParam)
 		{
 			TCHAR buf[256];
-			_stprintf(buf, TEXT("%d MHz"), g_CpuInfo.Frequency());
+			_stprintf(buf, TEXT("%d MHz"), cpu_info.Frequency());
 			::SetDlgItemText(hwndDlg, IDC_FREQUENCY, buf);
 		}
 		break;